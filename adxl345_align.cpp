@@ -0,0 +1,185 @@
+/*
+adxl345_align.cpp - Time alignment of several ADXL345 sample streams
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_align.hpp"
+#include <math.h>
+
+void ADXL345_Aligner::Reset() {
+	for (uint8_t d=0; d<DEVICES_MAX; d++) {
+		Stream &s = _streams[d];
+		s.started = false;
+		s.first = 0;
+		s.newest = 0;
+		s.samples = 0;
+		s.bridged = 0;
+		s.lastStamp = 0;
+		s.time = 0;
+		s.blocks = 0;
+		s.meanIndex = 0.0;
+		s.meanTime = 0.0;
+		s.cxx = 0.0;
+		s.cxy = 0.0;
+		s.period = _nominalUs;
+	}
+	_haveEpoch = false;
+	_epoch = 0;
+	_timeline = false;
+	_start = 0.0;
+	_next = 0;
+	_skipped = 0;
+}
+
+void ADXL345_Aligner::_Store(Stream *s, uint32_t index, const int16_t sample[3]) {
+	if (s->started && index <= s->newest) { return; }
+	if (s->started && index > s->newest + 1) {
+		// Bridge lost samples linearly, older ones than the ring holds are not written.
+		const uint32_t lost = index - s->newest - 1;
+		const int16_t *last = s->ring[s->newest % HISTORY];
+		const float a[3] = { float(last[0]), float(last[1]), float(last[2]) };
+		const uint32_t from = lost >= HISTORY ? index - HISTORY + 1 : s->newest + 1;
+		for (uint32_t j=from; j<index; j++) {
+			const float f = float(j - s->newest) / float(lost + 1);
+			for (uint8_t k=0; k<3; k++) {
+				s->ring[j % HISTORY][k] = int16_t(lrintf(a[k] + (sample[k] - a[k]) * f));
+			}
+		}
+		s->bridged += lost;
+		s->samples += lost;
+	}
+	if (!s->started) {
+		s->first = index;
+		s->started = true;
+	}
+	s->ring[index % HISTORY][0] = sample[0];
+	s->ring[index % HISTORY][1] = sample[1];
+	s->ring[index % HISTORY][2] = sample[2];
+	s->newest = index;
+	s->samples++;
+}
+
+void ADXL345_Aligner::_Fit(Stream *s, uint32_t index, uint32_t timestamp) {
+	if (!_haveEpoch) {
+		_epoch = timestamp;
+		_haveEpoch = true;
+	}
+	// All streams share the epoch, so their times are comparable across the 32 bit wrap.
+	if (!s->blocks) {
+		s->time = int32_t(timestamp - _epoch);
+	}
+	else {
+		s->time += uint32_t(timestamp - s->lastStamp);
+	}
+	s->lastStamp = timestamp;
+	s->blocks++;
+	const double w = s->blocks < FIT_WEIGHT ? 1.0 / s->blocks : 1.0 / double(FIT_WEIGHT);
+	const double dx = double(index) - s->meanIndex;
+	const double dy = double(s->time) - s->meanTime;
+	s->meanIndex += w * dx;
+	s->meanTime += w * dy;
+	s->cxx = (1.0 - w) * (s->cxx + w * dx * dx);
+	s->cxy = (1.0 - w) * (s->cxy + w * dx * dy);
+	// Until the blocks spread enough the nominal period is more reliable.
+	const double period = s->cxx > 0.0 ? s->cxy / s->cxx : 0.0;
+	s->period = period > 0.8 * _nominalUs && period < 1.25 * _nominalUs ? period : _nominalUs;
+}
+
+void ADXL345_Aligner::Push(uint8_t device, const int16_t data[][3], const ADXL345_StreamMonitor::Block &block) {
+	if (device >= _devices || !block.samples) { return; }
+	Stream &s = _streams[device];
+	// A gap marker frame, if any, precedes the samples.
+	const uint8_t offset = block.frames - block.samples;
+	for (uint8_t i=0; i<block.samples; i++) {
+		_Store(&s, block.firstSample + i, data[offset + i]);
+	}
+	// The block was drained right after its last sample was taken.
+	_Fit(&s, block.firstSample + block.samples - 1, block.timestamp);
+}
+
+uint16_t ADXL345_Aligner::Pull(int16_t out[][3], uint16_t maxSamples, uint32_t *firstIndex) {
+	if (!maxSamples || !_devices) { return 0; }
+	for (uint8_t d=0; d<_devices; d++) {
+		if (_streams[d].blocks < 2) { return 0; }
+	}
+	// Cubic interpolation at position p needs samples floor(p)-1 to floor(p)+2.
+	double begin = -HUGE_VAL;
+	double end = HUGE_VAL;
+	for (uint8_t d=0; d<_devices; d++) {
+		const Stream &s = _streams[d];
+		uint32_t oldest = s.newest - s.first >= HISTORY ? s.newest - HISTORY + 1 : s.first;
+		const double b = _TimeOf(s, double(oldest) + 1.0);
+		const double e = _TimeOf(s, double(s.newest) - 2.0);
+		if (b > begin) { begin = b; }
+		if (e < end) { end = e; }
+	}
+	if (!_timeline) {
+		_start = begin;
+		_next = 0;
+		_timeline = true;
+	}
+	double t = _start + _next * _outputUs;
+	if (t < begin) {
+		const uint32_t k = uint32_t(ceil((begin - _start) / _outputUs));
+		_skipped += k - _next;
+		_next = k;
+		t = _start + _next * _outputUs;
+	}
+	if (t > end) { return 0; }
+	const double available = floor((end - t) / _outputUs) + 1.0;
+	const uint16_t n = available < maxSamples ? uint16_t(available) : maxSamples;
+
+	for (uint8_t d=0; d<_devices; d++) {
+		const Stream &s = _streams[d];
+		const double p0 = _IndexOf(s, t);
+		const double step = _outputUs / s.period;
+		for (uint16_t k=0; k<n; k++) {
+			const double p = p0 + k * step;
+			const uint32_t i = uint32_t(p);
+			const float u = float(p - i);
+			// Catmull-Rom weights
+			const float u2 = u * u;
+			const float u3 = u2 * u;
+			const float w0 = 0.5f * (-u3 + 2.0f * u2 - u);
+			const float w1 = 0.5f * (3.0f * u3 - 5.0f * u2 + 2.0f);
+			const float w2 = 0.5f * (-3.0f * u3 + 4.0f * u2 + u);
+			const float w3 = 0.5f * (u3 - u2);
+			const int16_t *a = s.ring[(i - 1) % HISTORY];
+			const int16_t *b = s.ring[i % HISTORY];
+			const int16_t *c = s.ring[(i + 1) % HISTORY];
+			const int16_t *e = s.ring[(i + 2) % HISTORY];
+			// The overshoot of the kernel is clamped, INT16_MIN is reserved for gap markers.
+			int16_t *o = out[uint32_t(k) * _devices + d];
+			for (uint8_t j=0; j<3; j++) {
+				const long v = lrintf(w0 * a[j] + w1 * b[j] + w2 * c[j] + w3 * e[j]);
+				o[j] = int16_t(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN + 1 ? INT16_MIN + 1 : v));
+			}
+		}
+	}
+	if (firstIndex) { *firstIndex = _next; }
+	_next += n;
+	return n;
+}
+
+void ADXL345_Aligner::GetDrift(uint8_t device, Drift *drift) {
+	const Stream &s = _streams[device < DEVICES_MAX ? device : 0];
+	drift->odr = float(1e6 / s.period);
+	drift->ppm = float((_nominalUs / s.period - 1.0) * 1e6);
+	drift->lag = _timeline ? float(double(s.newest) - _IndexOf(s, _start + _next * _outputUs)) : 0.0f;
+	drift->samples = s.samples;
+	drift->bridged = s.bridged;
+}
@@ -0,0 +1,105 @@
+/*
+adxl345_align.hpp - Time alignment of several ADXL345 sample streams
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_ALIGN_HPP_
+#define ADXL345_ALIGN_HPP_
+
+#include "adxl345_stream.hpp"
+
+// Resamples the streams of several sensors onto one uniform timeline.
+// Every sensor runs on its own oscillator, a few percent off the nominal output data rate.
+// The clock of each stream is estimated from the drain timestamps of its blocks
+// with an exponentially weighted linear fit of time over sample index, so drift and
+// offset are tracked continuously. Output samples are interpolated with a cubic
+// Catmull-Rom kernel from the last HISTORY samples of each stream.
+// An output sample is produced once every stream holds the two samples after it,
+// so the latency is bounded by the slowest stream's block period plus two samples.
+// Lost samples reported by gap markers are bridged linearly.
+class ADXL345_Aligner {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		DEVICES_MAX		=	8,
+		HISTORY			=	256,		// samples kept per stream, a power of two
+		FIT_WEIGHT		=	32,			// blocks of the clock fit's time constant
+	};
+
+	struct Drift {
+		float odr;				// measured output data rate in Hz
+		float ppm;				// deviation from the nominal rate
+		float lag;				// samples held beyond the next output sample
+		uint32_t samples;		// samples pushed, bridged ones included
+		uint32_t bridged;		// lost samples filled in
+	};
+
+//	rate is the VAL_BW_x all sensors are set to, outputRate the rate of the common timeline in Hz.
+	ADXL345_Aligner(uint8_t devices, uint8_t rate, float outputRate)
+	:	_devices (devices > DEVICES_MAX ? uint8_t(DEVICES_MAX) : devices),
+		_nominalUs (1e6 / ADXL345_Defs::OdrFromRate(rate)),
+		_outputUs (1e6 / outputRate)
+	{ Reset(); }
+
+	void Reset();
+	uint8_t GetDevices() { return _devices; }
+
+//	Adds a block drained by the ADXL345_StreamMonitor of device.
+	void Push(uint8_t device, const int16_t data[][3], const ADXL345_StreamMonitor::Block &block);
+//	Writes up to maxSamples output samples of all devices, out[k * devices + d] is sample k of device d.
+//	firstIndex receives the index of out[0] on the common timeline if not nullptr.
+//	Returns the number of output samples written.
+	uint16_t Pull(int16_t out[][3], uint16_t maxSamples, uint32_t *firstIndex = nullptr);
+
+	void GetDrift(uint8_t device, Drift *drift);
+//	Output samples skipped because a stream fell more than HISTORY samples behind the others.
+	uint32_t GetSkipped() { return _skipped; }
+private:
+	struct Stream {
+		int16_t ring[HISTORY][3];
+		bool started;
+		uint32_t first;			// index of the first sample
+		uint32_t newest;		// index of the newest sample
+		uint32_t samples;
+		uint32_t bridged;
+		uint32_t lastStamp;		// raw timestamp of the last block
+		int64_t time;			// unwrapped timestamp of the last block, us
+		uint32_t blocks;
+		// Weighted means and co-moments of the fit, centered for precision
+		double meanIndex;
+		double meanTime;
+		double cxx;
+		double cxy;
+		double period;			// us per sample
+	};
+	double _TimeOf(const Stream &s, double index) { return s.meanTime + s.period * (index - s.meanIndex); }
+	double _IndexOf(const Stream &s, double time) { return s.meanIndex + (time - s.meanTime) / s.period; }
+	void _Store(Stream *s, uint32_t index, const int16_t sample[3]);
+	void _Fit(Stream *s, uint32_t index, uint32_t timestamp);
+	uint8_t _devices;
+	double _nominalUs;
+	double _outputUs;
+	Stream _streams[DEVICES_MAX];
+	bool _haveEpoch;
+	uint32_t _epoch;			// raw timestamp all stream times are relative to
+	bool _timeline;				// the common timeline has started
+	double _start;				// time of output sample 0
+	uint32_t _next;				// next output index
+	uint32_t _skipped;
+};
+
+#endif /* ADXL345_ALIGN_HPP_ */
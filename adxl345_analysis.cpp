@@ -0,0 +1,465 @@
+/*
+adxl345_analysis.cpp - Parallel offline analysis of ADXL345 bus recordings
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_analysis.hpp"
+#include "adxl345_replay.hpp"
+#include <atomic>
+#include <complex>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+/*********************** THREAD POOL **********************/
+
+// Every worker owns a deque, tasks pushed by a worker go to its own deque and are
+// taken newest first, idle workers steal the oldest tasks of the others.
+class WorkPool {
+public:
+	typedef function<void()> Task;
+	explicit WorkPool(unsigned threads);
+	~WorkPool();
+	void Push(Task task);
+//	Returns once all tasks, including the ones pushed by tasks, are done.
+	void Wait();
+private:
+	struct Queue {
+		mutex lock;
+		deque<Task> tasks;
+	};
+	bool _Pop(unsigned self, Task *task);
+	void _Work(unsigned self);
+	vector<unique_ptr<Queue> > _queues;
+	vector<thread> _threads;
+	mutex _lock;
+	condition_variable _wake;
+	condition_variable _done;
+	unsigned _queued;		// tasks in the deques
+	unsigned _pending;		// queued or running tasks
+	unsigned _next;			// round robin for pushes from outside the pool
+	bool _stop;
+	static thread_local int _self;
+};
+
+thread_local int WorkPool::_self = -1;
+
+WorkPool::WorkPool(unsigned threads)
+:	_queued (0),
+	_pending (0),
+	_next (0),
+	_stop (false)
+{
+	for (unsigned i=0; i<threads; i++) {
+		_queues.push_back(unique_ptr<Queue>(new Queue));
+	}
+	for (unsigned i=0; i<threads; i++) {
+		_threads.push_back(thread(&WorkPool::_Work, this, i));
+	}
+}
+
+WorkPool::~WorkPool() {
+	{
+		lock_guard<mutex> l(_lock);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (size_t i=0; i<_threads.size(); i++) {
+		_threads[i].join();
+	}
+}
+
+void WorkPool::Push(Task task) {
+	unsigned q;
+	if (_self >= 0) {
+		q = unsigned(_self);
+	}
+	else {
+		lock_guard<mutex> l(_lock);
+		q = _next++ % _queues.size();
+	}
+	{
+		lock_guard<mutex> l(_queues[q]->lock);
+		_queues[q]->tasks.push_back(task);
+	}
+	{
+		lock_guard<mutex> l(_lock);
+		_queued++;
+		_pending++;
+	}
+	_wake.notify_one();
+}
+
+void WorkPool::Wait() {
+	unique_lock<mutex> l(_lock);
+	_done.wait(l, [this] { return _pending == 0; });
+}
+
+bool WorkPool::_Pop(unsigned self, Task *task) {
+	{
+		Queue &own = *_queues[self];
+		lock_guard<mutex> l(own.lock);
+		if (!own.tasks.empty()) {
+			*task = move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (size_t i=1; i<_queues.size(); i++) {
+		Queue &victim = *_queues[(self + i) % _queues.size()];
+		lock_guard<mutex> l(victim.lock);
+		if (!victim.tasks.empty()) {
+			*task = move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkPool::_Work(unsigned self) {
+	_self = int(self);
+	for (;;) {
+		Task task;
+		if (_Pop(self, &task)) {
+			{
+				lock_guard<mutex> l(_lock);
+				_queued--;
+			}
+			task();
+			lock_guard<mutex> l(_lock);
+			if (--_pending == 0) { _done.notify_all(); }
+			continue;
+		}
+		unique_lock<mutex> l(_lock);
+		_wake.wait(l, [this] { return _queued > 0 || _stop; });
+		if (_stop && !_queued) { return; }
+	}
+}
+
+/************************ SPECTRUM ************************/
+
+struct Tables {
+	double window[ADXL345_Analysis::FFT_SIZE];
+	complex<double> twiddle[ADXL345_Analysis::FFT_SIZE / 2];
+	Tables() {
+		const int n = ADXL345_Analysis::FFT_SIZE;
+		for (int i=0; i<n; i++) {
+			window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+		}
+		for (int i=0; i<n/2; i++) {
+			twiddle[i] = polar(1.0, -2 * M_PI * i / n);
+		}
+	}
+};
+
+static const Tables &GetTables() {
+	static const Tables tables;
+	return tables;
+}
+
+// In-place iterative radix-2 FFT of FFT_SIZE points
+static void Fft(complex<double> x[]) {
+	const int n = ADXL345_Analysis::FFT_SIZE;
+	const Tables &t = GetTables();
+	for (int i=1, j=0; i<n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) { j ^= bit; }
+		j ^= bit;
+		if (i < j) { swap(x[i], x[j]); }
+	}
+	for (int len=2; len<=n; len<<=1) {
+		const int step = n / len;
+		for (int i=0; i<n; i+=len) {
+			for (int k=0; k<len/2; k++) {
+				const complex<double> u = x[i+k];
+				const complex<double> v = x[i+k+len/2] * t.twiddle[k*step];
+				x[i+k] = u + v;
+				x[i+k+len/2] = u - v;
+			}
+		}
+	}
+}
+
+/************************* FILES **************************/
+
+// Mergeable results of one chunk
+struct Partial {
+	uint64_t samples;
+	double sum[3];
+	double sumSq[3];
+	double min[3];
+	double max[3];
+	double spectrum[3][ADXL345_Analysis::BINS];
+	uint32_t segments;
+	Partial() {
+		samples = 0;
+		segments = 0;
+		for (int a=0; a<3; a++) {
+			sum[a] = 0;
+			sumSq[a] = 0;
+			min[a] = HUGE_VAL;
+			max[a] = -HUGE_VAL;
+			for (int b=0; b<ADXL345_Analysis::BINS; b++) { spectrum[a][b] = 0; }
+		}
+	}
+	void Merge(const Partial &p) {
+		samples += p.samples;
+		segments += p.segments;
+		for (int a=0; a<3; a++) {
+			sum[a] += p.sum[a];
+			sumSq[a] += p.sumSq[a];
+			if (p.min[a] < min[a]) { min[a] = p.min[a]; }
+			if (p.max[a] > max[a]) { max[a] = p.max[a]; }
+			for (int b=0; b<ADXL345_Analysis::BINS; b++) { spectrum[a][b] += p.spectrum[a][b]; }
+		}
+	}
+};
+
+struct Chunk {
+	size_t begin;			// record range
+	size_t end;
+	uint8_t dataFormat;		// register values at begin
+	uint8_t rate;
+};
+
+struct FileJob {
+	ADXL345_Analysis::Result *result;
+	const ADXL345_BusRecord *records;
+	size_t count;
+	void *map;
+	size_t mapSize;
+	float gain[3];
+	float offset[3];
+	mutex lock;
+	Partial total;
+	atomic<size_t> chunksLeft;
+};
+
+static bool IsSample(const ADXL345_BusRecord &r) {
+	return !(r.flags & ADXL345_BusRecord::FLAG_WRITE) && r.reg == ADXL345_Defs::REG_DATAX0 && r.n == 6 && !r.status;
+}
+
+// Tracks the registers that affect the conversion, returns true if one changed.
+static bool ApplyWrite(const ADXL345_BusRecord &r, uint8_t *dataFormat, uint8_t *rate) {
+	bool changed = false;
+	if (!(r.flags & ADXL345_BusRecord::FLAG_WRITE)) { return false; }
+	for (uint8_t i=0; i<r.n && i<ADXL345_Defs::BUFFER_MAX; i++) {
+		if (r.reg + i == ADXL345_Defs::REG_DATA_FORMAT && *dataFormat != r.data[i]) {
+			*dataFormat = r.data[i];
+			changed = true;
+		}
+		if (r.reg + i == ADXL345_Defs::REG_BW_RATE && *rate != r.data[i]) {
+			*rate = r.data[i];
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+static void LoadCalibration(const string &path, float gain[3], float offset[3]) {
+	for (int a=0; a<3; a++) {
+		gain[a] = 1.0f;
+		offset[a] = 0.0f;
+	}
+	FILE *f = fopen((path + ".cal").c_str(), "r");
+	if (!f) { return; }
+	float v[6];
+	if (fscanf(f, "%f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6) {
+		for (int a=0; a<3; a++) {
+			gain[a] = v[a];
+			offset[a] = v[3+a];
+		}
+	}
+	fclose(f);
+}
+
+static void Finish(FileJob *job) {
+	ADXL345_Analysis::Result *r = job->result;
+	const Partial &t = job->total;
+	const double odr = ADXL345_Defs::OdrFromRate(r->rate);
+	r->samples = t.samples;
+	r->seconds = t.samples / odr;
+	r->segments = t.segments;
+	for (int a=0; a<3; a++) {
+		const double mean = t.samples ? t.sum[a] / t.samples : 0;
+		const double var = t.samples ? t.sumSq[a] / t.samples - mean * mean : 0;
+		r->mean[a] = mean;
+		r->rms[a] = var > 0 ? sqrt(var) : 0;
+		r->min[a] = t.samples ? t.min[a] : 0;
+		r->max[a] = t.samples ? t.max[a] : 0;
+		// Bin 0 holds what is left of the mean, a flat axis has no peak.
+		int peak = 0;
+		for (int b=1; b<ADXL345_Analysis::BINS; b++) {
+			if (t.spectrum[a][b] > (peak ? t.spectrum[a][peak] : 0.0)) { peak = b; }
+		}
+		r->peakHz[a] = peak * odr / double(ADXL345_Analysis::FFT_SIZE);
+	}
+	r->ok = true;
+	munmap(job->map, job->mapSize);
+	delete job;
+}
+
+// Converts the samples of one chunk, spectrum segments restart at a configuration change
+// and only segments at the rate of the file are averaged.
+static void AnalyzeChunk(FileJob *job, Chunk chunk) {
+	const Tables &tables = GetTables();
+	const uint8_t fileRate = job->result->rate;
+	unique_ptr<Partial> p(new Partial);
+	uint8_t dataFormat = chunk.dataFormat;
+	uint8_t rate = chunk.rate;
+	float scale = ADXL345_Defs::ScaleFromFormat(dataFormat);
+	double segment[3][ADXL345_Analysis::FFT_SIZE];
+	int fill = 0;
+	for (size_t i=chunk.begin; i<chunk.end; i++) {
+		const ADXL345_BusRecord &r = job->records[i];
+		if (ApplyWrite(r, &dataFormat, &rate)) {
+			scale = ADXL345_Defs::ScaleFromFormat(dataFormat);
+			fill = 0;
+			continue;
+		}
+		if (!IsSample(r)) { continue; }
+		int16_t raw[3];
+		ADXL345_Defs::RawFromBuffer(dataFormat, r.data, raw);
+		for (int a=0; a<3; a++) {
+			const double v = job->gain[a] * raw[a] * scale + job->offset[a];
+			p->sum[a] += v;
+			p->sumSq[a] += v * v;
+			if (v < p->min[a]) { p->min[a] = v; }
+			if (v > p->max[a]) { p->max[a] = v; }
+			segment[a][fill] = v;
+		}
+		p->samples++;
+		if (++fill < ADXL345_Analysis::FFT_SIZE) { continue; }
+		fill = 0;
+		if (ADXL345_Defs::FIELD_BW_RATE_RATE::Decode(rate) != ADXL345_Defs::FIELD_BW_RATE_RATE::Decode(fileRate)) { continue; }
+		for (int a=0; a<3; a++) {
+			complex<double> x[ADXL345_Analysis::FFT_SIZE];
+			double mean = 0;
+			for (int k=0; k<ADXL345_Analysis::FFT_SIZE; k++) { mean += segment[a][k]; }
+			mean /= double(ADXL345_Analysis::FFT_SIZE);
+			for (int k=0; k<ADXL345_Analysis::FFT_SIZE; k++) {
+				x[k] = (segment[a][k] - mean) * tables.window[k];
+			}
+			Fft(x);
+			for (int b=0; b<ADXL345_Analysis::BINS; b++) {
+				p->spectrum[a][b] += norm(x[b]);
+			}
+		}
+		p->segments++;
+	}
+	{
+		lock_guard<mutex> l(job->lock);
+		job->total.Merge(*p);
+	}
+	if (--job->chunksLeft == 0) { Finish(job); }
+}
+
+// Maps a file and queues its chunks, each starting with the register state it needs.
+static void ScanFile(WorkPool *pool, ADXL345_Analysis::Result *result) {
+	const int fd = open(result->path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) { close(fd); }
+		result->error = "cannot open";
+		return;
+	}
+	const size_t count = size_t(st.st_size) / sizeof(ADXL345_BusRecord);
+	void *map = count ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+	close(fd);
+	if (!count || map == MAP_FAILED) {
+		result->error = count ? "cannot map" : "empty";
+		return;
+	}
+	FileJob *job = new FileJob;
+	job->result = result;
+	job->records = static_cast<const ADXL345_BusRecord*>(map);
+	job->count = count;
+	job->map = map;
+	job->mapSize = st.st_size;
+	LoadCalibration(result->path, job->gain, job->offset);
+
+	vector<Chunk> chunks;
+	// Reset values
+	uint8_t dataFormat = 0x00;
+	uint8_t rate = ADXL345_Defs::VAL_BW_50_Hz;
+	bool haveRate = false;
+	Chunk chunk = { 0, 0, dataFormat, rate };
+	uint32_t samples = 0;
+	for (size_t i=0; i<count; i++) {
+		const ADXL345_BusRecord &r = job->records[i];
+		ApplyWrite(r, &dataFormat, &rate);
+		if (!IsSample(r)) { continue; }
+		if (!haveRate) {
+			result->rate = rate;
+			haveRate = true;
+		}
+		if (++samples == ADXL345_Analysis::CHUNK_SAMPLES) {
+			chunk.end = i + 1;
+			chunks.push_back(chunk);
+			chunk.begin = i + 1;
+			chunk.dataFormat = dataFormat;
+			chunk.rate = rate;
+			samples = 0;
+		}
+	}
+	chunk.end = count;
+	chunks.push_back(chunk);
+	if (!haveRate) { result->rate = rate; }
+	job->chunksLeft = chunks.size();
+	for (size_t i=0; i<chunks.size(); i++) {
+		pool->Push(bind(AnalyzeChunk, job, chunks[i]));
+	}
+}
+
+} // namespace
+
+void ADXL345_Analysis::Run(const vector<string> &paths, unsigned threads, vector<Result> *results) {
+	if (!threads) { threads = thread::hardware_concurrency(); }
+	if (!threads) { threads = 1; }
+	results->assign(paths.size(), Result());
+	for (size_t i=0; i<paths.size(); i++) {
+		Result &r = (*results)[i];
+		r.path = paths[i];
+		r.ok = false;
+		r.samples = 0;
+		r.rate = ADXL345_Defs::VAL_BW_50_Hz;
+		r.seconds = 0;
+		r.segments = 0;
+		for (int a=0; a<3; a++) {
+			r.mean[a] = r.rms[a] = r.min[a] = r.max[a] = r.peakHz[a] = 0;
+		}
+	}
+	WorkPool pool(threads);
+	for (size_t i=0; i<paths.size(); i++) {
+		pool.Push(bind(ScanFile, &pool, &(*results)[i]));
+	}
+	pool.Wait();
+}
@@ -0,0 +1,64 @@
+/*
+adxl345_analysis.hpp - Parallel offline analysis of ADXL345 bus recordings
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host only (C++11 threads, POSIX mmap), see tools/adxl345_batch.cpp.
+
+#ifndef ADXL345_ANALYSIS_HPP_
+#define ADXL345_ANALYSIS_HPP_
+
+#include <string>
+#include <vector>
+#include "adxl345_core.hpp"
+
+// Converts, summarizes and analyzes the spectrum of capture files, i.e. arrays of
+// ADXL345_BusRecord as written by ADXL345_RecordingBus. Samples are the 6 byte reads
+// of DATAX0, converted like GetData() with the DATA_FORMAT written in the recording.
+// An optional capture.bin.cal text file next to a capture holds the calibration
+// "gx gy gz ox oy oz": value = gain * converted + offset, in g.
+// Files are split into chunks of CHUNK_SAMPLES samples that run as separate tasks
+// on a work-stealing thread pool, chunk results are merged per file.
+class ADXL345_Analysis {
+public:
+	enum {
+		FFT_SIZE		=	256,				// samples per Welch segment, Hann window
+		BINS			=	FFT_SIZE / 2 + 1,
+		CHUNK_SAMPLES	=	64 * FFT_SIZE,
+	};
+
+	struct Result {
+		std::string path;
+		bool ok;
+		std::string error;
+		uint64_t samples;
+		uint8_t rate;			// VAL_BW_x at the first sample
+		double seconds;			// samples / output data rate
+		double mean[3];			// g
+		double rms[3];			// AC RMS around the mean, g
+		double min[3];
+		double max[3];
+		double peakHz[3];		// strongest non-DC frequency of the averaged spectrum
+		uint32_t segments;		// spectrum segments averaged
+	};
+
+//	Analyzes all paths on threads workers, 0 uses every core.
+//	results receives one entry per path in the same order.
+	static void Run(const std::vector<std::string> &paths, unsigned threads, std::vector<Result> *results);
+};
+
+#endif /* ADXL345_ANALYSIS_HPP_ */
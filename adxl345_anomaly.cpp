@@ -0,0 +1,208 @@
+/*
+adxl345_anomaly.cpp - Online anomaly scoring of ADXL345 vibration against a learned baseline
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_anomaly.hpp"
+#include "adxl345_stream.hpp"
+#include <math.h>
+
+// Mean square added to every energy before the logarithm, -20 dB of an LSB^2.
+static const float ENERGY_FLOOR = 0.01f;
+
+ADXL345_Anomaly::ADXL345_Anomaly()
+:	_setup (),
+	_baseline ()
+{
+	_setup.windowShift = WINDOW_SHIFT_MIN;
+	_setup.bands = 1;
+	_setup.timeConstant = 1;
+	ClearBaseline();
+	Reset();
+}
+
+ADXL345_Anomaly::StatusType ADXL345_Anomaly::Configure(const Setup &setup) {
+	if (setup.axis > AXIS_Z || setup.windowShift < WINDOW_SHIFT_MIN || setup.windowShift > WINDOW_SHIFT_MAX) {
+		return StatusType(HAL_ERROR);
+	}
+	if (!setup.bands || setup.bands > BANDS_MAX || setup.bands > setup.windowShift || !setup.timeConstant) {
+		return StatusType(HAL_ERROR);
+	}
+	// The floor keeps the z-scores finite while a feature has not varied yet, NaN fails too.
+	if (!(setup.minSigma > 0.0f)) {
+		return StatusType(HAL_ERROR);
+	}
+	_setup = setup;
+	ClearBaseline();
+	Reset();
+	return StatusType(0);
+}
+
+void ADXL345_Anomaly::ClearBaseline() {
+	_baseline.magic = ADXL345_AnomalyBaseline::MAGIC;
+	_baseline.version = ADXL345_AnomalyBaseline::VERSION;
+	_baseline.rate = _setup.rate;
+	_baseline.axis = _setup.axis;
+	_baseline.windowShift = _setup.windowShift;
+	_baseline.bands = _setup.bands;
+	_baseline.features = uint8_t(FEATURE_BAND + _setup.bands);
+	_baseline.reserved = 0;
+	_baseline.windows = 0;
+	for (uint8_t i=0; i<FEATURES_MAX; i++) {
+		_baseline.mean[i] = 0.0f;
+		_baseline.var[i] = 0.0f;
+	}
+}
+
+void ADXL345_Anomaly::Save(ADXL345_AnomalyBaseline *image) {
+	*image = _baseline;
+}
+
+ADXL345_Anomaly::StatusType ADXL345_Anomaly::Restore(const ADXL345_AnomalyBaseline &image) {
+	if (image.magic != ADXL345_AnomalyBaseline::MAGIC || image.version != ADXL345_AnomalyBaseline::VERSION) {
+		return ADXL345_Defs::STATUS_INVALID_ID;
+	}
+	if (image.rate != _baseline.rate || image.axis != _baseline.axis
+		|| image.windowShift != _baseline.windowShift || image.bands != _baseline.bands
+		|| image.features != _baseline.features) {
+		return StatusType(HAL_ERROR);
+	}
+	_baseline = image;
+	return StatusType(0);
+}
+
+void ADXL345_Anomaly::Reset(uint32_t firstSample) {
+	_next = firstSample;
+	_ready = false;
+	_Restart();
+}
+
+void ADXL345_Anomaly::_Restart() {
+	for (uint8_t i=0; i<BANDS_MAX; i++) {
+		_pending[i] = 0;
+		_energy[i] = 0;
+	}
+	_sum = 0;
+	_sumSq = 0;
+	_min = INT16_MAX;
+	_max = INT16_MIN;
+	_fill = 0;
+}
+
+bool ADXL345_Anomaly::_Sample(int16_t v) {
+	if (!_fill) { _windowFirst = _next; }
+	_next++;
+	_sum += v;
+	_sumSq += uint64_t(int32_t(v) * v);
+	if (v < _min) { _min = v; }
+	if (v > _max) { _max = v; }
+	// Haar decomposition: level j pairs sums of 2^j samples, their difference is the
+	// detail of octave j. The window is a multiple of every pair, so none stays open.
+	int32_t s = v;
+	uint16_t k = _fill;
+	for (uint8_t j=0; j<_setup.bands; j++, k >>= 1) {
+		if (!(k & 1)) {
+			_pending[j] = s;
+			break;
+		}
+		const int64_t d = _pending[j] - s;
+		_energy[j] += uint64_t(d * d);
+		s += _pending[j];
+	}
+	if (uint32_t(++_fill) < (uint32_t(1) << _setup.windowShift)) { return false; }
+	_Score();
+	_Restart();
+	return true;
+}
+
+void ADXL345_Anomaly::_Score() {
+	const uint8_t features = _baseline.features;
+	const int64_t n = int64_t(1) << _setup.windowShift;
+	// n * sumSq - sum^2 is exact in 64 bit for windows up to 2^15 samples.
+	const float variance = float(int64_t(_sumSq) * n - _sum * _sum) / float(n) / float(n);
+	const float halfRange = (int32_t(_max) - _min) / 2.0f;
+	float *feature = _result.feature;
+	feature[FEATURE_RMS] = 10 * log10f(variance + ENERGY_FLOOR);
+	feature[FEATURE_CREST] = 10 * log10f((halfRange * halfRange + ENERGY_FLOOR) / (variance + ENERGY_FLOOR));
+	for (uint8_t j=0; j<_setup.bands; j++) {
+		// Unnormalized sums grow by 2 per level, the orthonormal detail is d / 2^((j+1)/2).
+		const float meanSquare = float(_energy[j]) / float(n) / float(uint32_t(2) << j);
+		feature[FEATURE_BAND + j] = 10 * log10f(meanSquare + ENERGY_FLOOR);
+	}
+
+	_result.firstSample = _windowFirst;
+	_result.features = features;
+	_result.worst = 0;
+	const float minVar = _setup.minSigma * _setup.minSigma;
+	float sumZ = 0.0f;
+	float worst = 0.0f;
+	for (uint8_t i=0; i<features; i++) {
+		const float z = _baseline.windows ? (feature[i] - _baseline.mean[i]) / sqrtf(_baseline.var[i] + minVar) : 0.0f;
+		_result.z[i] = z;
+		sumZ += z * z;
+		if (fabsf(z) > worst) {
+			worst = fabsf(z);
+			_result.worst = i;
+		}
+	}
+	_result.score = sqrtf(sumZ / features);
+	_result.learning = _baseline.windows < _setup.learnWindows;
+	_result.anomaly = !_result.learning && _result.score > _setup.threshold;
+	if (_result.anomaly) { return; }
+
+	// Exponentially weighted mean and variance. The first windows are averaged with equal
+	// weight, so the baseline does not depend on the very first window for long.
+	const uint32_t weight = _baseline.windows + 1 < _setup.timeConstant ? _baseline.windows + 1 : _setup.timeConstant;
+	const float alpha = 1.0f / float(weight);
+	for (uint8_t i=0; i<features; i++) {
+		const float diff = feature[i] - _baseline.mean[i];
+		const float increment = alpha * diff;
+		_baseline.mean[i] += increment;
+		_baseline.var[i] = (1 - alpha) * (_baseline.var[i] + diff * increment);
+	}
+	if (_baseline.windows < UINT32_MAX) { _baseline.windows++; }
+}
+
+uint32_t ADXL345_Anomaly::Process(const int16_t data[][3], uint32_t frames) {
+	uint32_t i = 0;
+	_ready = false;
+	while (i < frames && !_ready) {
+		const int16_t *frame = data[i++];
+		uint32_t lost;
+		if (ADXL345_StreamMonitor::IsGapFrame(frame, &lost)) {
+			_next += lost;
+			_Restart();
+			continue;
+		}
+		_ready = _Sample(frame[_setup.axis]);
+	}
+	return i;
+}
+
+uint16_t ADXL345_Anomaly::Process(const ADXL345_SampleBlock &block, uint16_t offset) {
+	const int16_t *column = block.axis[_setup.axis];
+	uint16_t i = offset;
+	_ready = false;
+	if (!offset && block.firstSample != _next) {
+		_next = block.firstSample;
+		_Restart();
+	}
+	while (i < block.samples && !_ready) {
+		_ready = _Sample(column[i++]);
+	}
+	return uint16_t(i - offset);
+}
@@ -0,0 +1,150 @@
+/*
+adxl345_anomaly.hpp - Online anomaly scoring of ADXL345 vibration against a learned baseline
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_ANOMALY_HPP_
+#define ADXL345_ANOMALY_HPP_
+
+#include "adxl345_core.hpp"
+
+// Learned baseline, a plain image that may be written to flash or a file and
+// handed to ADXL345_Anomaly::Restore() after a reboot. Uses the byte order of the host.
+struct ADXL345_AnomalyBaseline {
+	enum {
+		MAGIC			=	0x4E415841,	// "AXAN"
+		VERSION			=	0x1,
+		BANDS_MAX		=	10,
+		FEATURES_MAX	=	2 + BANDS_MAX,
+	};
+	uint32_t magic;
+	uint16_t version;
+	uint8_t rate;						// VAL_BW_x of the samples
+	uint8_t axis;
+	uint8_t windowShift;
+	uint8_t bands;
+	uint8_t features;
+	uint8_t reserved;
+	uint32_t windows;					// windows learned
+	float mean[FEATURES_MAX];			// dB
+	float var[FEATURES_MAX];			// dB^2
+};
+
+// Learns the normal vibration of one axis and scores every window by its deviation,
+// so a node can send a score per window instead of the samples.
+// Features of a window of 2^windowShift samples, all in dB:
+//	0			AC RMS
+//	1			crest factor, half the peak-to-peak range over the AC RMS
+//	2 + j		mean square of octave band j, ODR/2^(j+2) to ODR/2^(j+1), from a Haar
+//				wavelet decomposition, amortized two integer steps per sample
+// The baseline keeps an exponentially weighted mean and variance per feature,
+// updated in O(features) per window. The score is the RMS of the z-scores, about 1
+// for windows like the baseline. Windows scoring above threshold are not learned,
+// so a developing fault does not become the new normal.
+// An instance takes about 400 bytes, the baseline image about 110.
+class ADXL345_Anomaly {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		BANDS_MAX		=	ADXL345_AnomalyBaseline::BANDS_MAX,
+		FEATURES_MAX	=	ADXL345_AnomalyBaseline::FEATURES_MAX,
+		WINDOW_SHIFT_MIN	=	6,
+		WINDOW_SHIFT_MAX	=	15,
+
+		AXIS_X			=	0x0,
+		AXIS_Y			=	0x1,
+		AXIS_Z			=	0x2,
+
+		FEATURE_RMS		=	0x0,
+		FEATURE_CREST	=	0x1,
+		FEATURE_BAND	=	0x2,		// first octave band, the one below ODR/2
+	};
+
+	struct Setup {
+		uint8_t rate;			// VAL_BW_x of the samples
+		uint8_t axis;			// AXIS_x
+		uint8_t windowShift;	// window of 2^windowShift samples, WINDOW_SHIFT_MIN to WINDOW_SHIFT_MAX
+		uint8_t bands;			// octave bands, 1 to BANDS_MAX and at most windowShift
+		uint16_t learnWindows;	// windows learned unconditionally after the baseline was cleared
+		uint16_t timeConstant;	// windows, weight of a new window is 1/timeConstant
+		float threshold;		// score above which a window is anomalous
+		float minSigma;			// dB, floor of the standard deviation of every feature, above 0
+	};
+
+	struct Result {
+		uint32_t firstSample;			// stream index of the first sample of the window
+		float feature[FEATURES_MAX];	// dB
+		float z[FEATURES_MAX];			// deviation from the baseline in standard deviations
+		float score;					// RMS of z, 0 while the baseline is empty
+		uint8_t features;
+		uint8_t worst;					// feature with the largest |z|
+		bool learning;					// still within learnWindows
+		bool anomaly;					// score above threshold after learning
+	};
+
+	ADXL345_Anomaly();
+
+//	Returns HAL_ERROR for an unsupported axis, window, band count or time constant,
+//	or a minSigma that is not positive.
+//	Clears the baseline, restarts the stream index at 0.
+	StatusType Configure(const Setup &setup);
+//	Forgets the baseline and learns the next learnWindows windows unconditionally,
+//	e.g. after a repair or a new operating point.
+	void ClearBaseline();
+//	Restarts the stream index at firstSample and discards the window in progress.
+	void Reset(uint32_t firstSample = 0);
+
+//	Copies the baseline to image, to be stored across reboots.
+	void Save(ADXL345_AnomalyBaseline *image);
+//	Continues a saved baseline. Returns STATUS_INVALID_ID if image is no baseline of
+//	this version, HAL_ERROR if it was learned with another rate, axis, window or bands.
+	StatusType Restore(const ADXL345_AnomalyBaseline &image);
+
+//	Feeds drained frames and returns how many were consumed. Processing stops after
+//	the frame that completes a window; IsReady() is then true until the next call.
+//	Gap marker frames of ADXL345_StreamMonitor advance the index and restart the window.
+	uint32_t Process(const int16_t data[][3], uint32_t frames);
+//	Same for the samples of block from offset on. A block that does not continue the
+//	stream index restarts the window.
+	uint16_t Process(const ADXL345_SampleBlock &block, uint16_t offset = 0);
+	bool IsReady() { return _ready; }
+	const Result &GetResult() { return _result; }
+
+	uint32_t GetNextSample() { return _next; }
+	uint32_t GetWindowsLearned() { return _baseline.windows; }
+	uint8_t GetFeatures() { return _baseline.features; }
+private:
+	void _Restart();
+//	Returns true if v completed a window.
+	bool _Sample(int16_t v);
+	void _Score();
+	Setup _setup;
+	ADXL345_AnomalyBaseline _baseline;
+	int32_t _pending[BANDS_MAX];		// first half of the pair open on each level, sum of 2^j samples
+	uint64_t _energy[BANDS_MAX];		// summed squared differences of each level
+	int64_t _sum;
+	uint64_t _sumSq;
+	int16_t _min;
+	int16_t _max;
+	uint16_t _fill;
+	uint32_t _next;
+	uint32_t _windowFirst;
+	bool _ready;
+	Result _result;
+};
+
+#endif /* ADXL345_ANOMALY_HPP_ */
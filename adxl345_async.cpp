@@ -0,0 +1,302 @@
+/*
+adxl345_async.cpp - ADXL345 C++20 coroutine layer
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_async.hpp"
+#include "adxl345_critical.hpp"
+#include "main.h"
+
+using namespace std;
+
+/************************ FRAME POOL ***********************/
+
+union FrameBlock {
+	FrameBlock *next;
+	alignas(max_align_t) uint8_t storage[ADXL345_FRAME_BLOCK_SIZE];
+};
+
+static FrameBlock framePool[ADXL345_FRAME_POOL_BLOCKS];
+static FrameBlock *frameFreeList = nullptr;
+static bool framePoolInitialized = false;
+static uint8_t frameFreeCount = 0;
+
+void *ADXL345_FramePool::Allocate(size_t size) {
+	if (size > sizeof(FrameBlock)) { return nullptr; }
+	ADXL345_CriticalSection lock;
+	if (!framePoolInitialized) {
+		for (uint8_t i=0; i<ADXL345_FRAME_POOL_BLOCKS; i++) {
+			framePool[i].next = frameFreeList;
+			frameFreeList = &framePool[i];
+		}
+		frameFreeCount = ADXL345_FRAME_POOL_BLOCKS;
+		framePoolInitialized = true;
+	}
+	if (!frameFreeList) { return nullptr; }
+	FrameBlock *block = frameFreeList;
+	frameFreeList = block->next;
+	frameFreeCount--;
+	return block;
+}
+
+void ADXL345_FramePool::Free(void *block) {
+	if (!block) { return; }
+	FrameBlock *b = static_cast<FrameBlock*>(block);
+	ADXL345_CriticalSection lock;
+	b->next = frameFreeList;
+	frameFreeList = b;
+	frameFreeCount++;
+}
+
+uint8_t ADXL345_FramePool::GetFree() {
+	ADXL345_CriticalSection lock;
+	return framePoolInitialized ? frameFreeCount : uint8_t(ADXL345_FRAME_POOL_BLOCKS);
+}
+
+/************************ EXECUTORS ************************/
+
+void ADXL345_InlineExecutor::Post(coroutine_handle<> h) {
+	h.resume();
+}
+
+void ADXL345_LoopExecutor::Post(coroutine_handle<> h) {
+	const uint8_t head = _head.load(memory_order_relaxed);
+	const uint8_t next = (head + 1) & (QUEUE_SIZE - 1);
+	if (next == _tail.load(memory_order_acquire)) {
+		// Only coroutines with frames outside the pool can get here. Resuming in place
+		// is better than losing the completion, the task would never finish.
+		_overflows++;
+		h.resume();
+		return;
+	}
+	_queue[head] = h;
+	_head.store(next, memory_order_release);
+}
+
+unsigned ADXL345_LoopExecutor::Poll() {
+	unsigned resumed = 0;
+	uint8_t tail = _tail.load(memory_order_relaxed);
+	while (tail != _head.load(memory_order_acquire)) {
+		coroutine_handle<> h = _queue[tail];
+		tail = (tail + 1) & (QUEUE_SIZE - 1);
+		_tail.store(tail, memory_order_release);
+		h.resume();
+		resumed++;
+	}
+	return resumed;
+}
+
+/************************ TRANSPORTS ***********************/
+
+ADXL345::StatusType ADXL345_BlockingTransport::StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status = n == 1 ? _dev->_ReadFrom(reg, data) : _dev->_ReadFrom(reg, data, n);
+	callback(context, status);
+	return StatusType(0);
+}
+
+ADXL345::StatusType ADXL345_BlockingTransport::StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status = n == 1 ? _dev->_WriteTo(reg, data[0]) : _dev->_WriteTo(reg, data, n);
+	callback(context, status);
+	return StatusType(0);
+}
+
+ADXL345::StatusType ADXL345_I2C_IT::StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	if (_callback) { return HAL_BUSY; }
+	_context = context;
+	_callback = callback;
+	status = HAL_I2C_Mem_Read_IT(_hi2c, _devAddr, reg, I2C_MEMADD_SIZE_8BIT, data, n);
+	if (status) { _callback = nullptr; }
+	return status;
+}
+
+ADXL345::StatusType ADXL345_I2C_IT::StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	if (_callback) { return HAL_BUSY; }
+	for (uint8_t i=0; i<n; i++) {
+		_txBuffer[i] = data[i];
+	}
+	_context = context;
+	_callback = callback;
+	status = HAL_I2C_Mem_Write_IT(_hi2c, _devAddr, reg, I2C_MEMADD_SIZE_8BIT, _txBuffer, n);
+	if (status) { _callback = nullptr; }
+	return status;
+}
+
+void ADXL345_I2C_IT::OnComplete(StatusType status) {
+	Callback callback = _callback;
+	if (!callback) { return; }
+	// Cleared first so the callback can start the next transfer.
+	_callback = nullptr;
+	callback(_context, status);
+}
+
+ADXL345::StatusType ADXL345_I2C_DMA::StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	if (_callback) { return HAL_BUSY; }
+	_context = context;
+	_callback = callback;
+	status = HAL_I2C_Mem_Read_DMA(_hi2c, _devAddr, reg, I2C_MEMADD_SIZE_8BIT, data, n);
+	if (status) { _callback = nullptr; }
+	return status;
+}
+
+ADXL345::StatusType ADXL345_I2C_DMA::StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	if (_callback) { return HAL_BUSY; }
+	for (uint8_t i=0; i<n; i++) {
+		_txBuffer[i] = data[i];
+	}
+	_context = context;
+	_callback = callback;
+	status = HAL_I2C_Mem_Write_DMA(_hi2c, _devAddr, reg, I2C_MEMADD_SIZE_8BIT, _txBuffer, n);
+	if (status) { _callback = nullptr; }
+	return status;
+}
+
+void ADXL345_I2C_DMA::OnComplete(StatusType status) {
+	Callback callback = _callback;
+	if (!callback) { return; }
+	_callback = nullptr;
+	callback(_context, status);
+}
+
+ADXL345::StatusType ADXL345_SPI_DMA::StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	const bool read	=	true;
+	const bool mb	=	n > 1;	// multibyte
+	if (_callback) { return HAL_BUSY; }
+	_txBuffer[0] = reg | (read << 7) | (mb << 6);
+	for (uint8_t i=0; i<n; i++) {
+		_txBuffer[i+1] = 0;
+	}
+	_context = context;
+	_callback = callback;
+	_data = data;
+	_n = n;
+	HAL_GPIO_WritePin(_ssPort, _ssPin, GPIO_PIN_RESET);
+	status = HAL_SPI_TransmitReceive_DMA(_hspi, _txBuffer, _rxBuffer, n+1);
+	if (status) {
+		HAL_GPIO_WritePin(_ssPort, _ssPin, GPIO_PIN_SET);
+		_callback = nullptr;
+	}
+	return status;
+}
+
+ADXL345::StatusType ADXL345_SPI_DMA::StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) {
+	StatusType status;
+	const bool read	=	false;
+	const bool mb	=	n > 1;	// multibyte
+	if (_callback) { return HAL_BUSY; }
+	_txBuffer[0] = reg | (read << 7) | (mb << 6);
+	for (uint8_t i=0; i<n; i++) {
+		_txBuffer[i+1] = data[i];
+	}
+	_context = context;
+	_callback = callback;
+	_data = nullptr;
+	_n = n;
+	HAL_GPIO_WritePin(_ssPort, _ssPin, GPIO_PIN_RESET);
+	status = HAL_SPI_Transmit_DMA(_hspi, _txBuffer, n+1);
+	if (status) {
+		HAL_GPIO_WritePin(_ssPort, _ssPin, GPIO_PIN_SET);
+		_callback = nullptr;
+	}
+	return status;
+}
+
+void ADXL345_SPI_DMA::OnComplete(StatusType status) {
+	Callback callback = _callback;
+	if (!callback) { return; }
+	HAL_GPIO_WritePin(_ssPort, _ssPin, GPIO_PIN_SET);
+	if (_data && !status) {
+		for (uint8_t i=0; i<_n; i++) {
+			_data[i] = _rxBuffer[i+1];
+		}
+	}
+	_callback = nullptr;
+	callback(_context, status);
+}
+
+/************************* AWAITABLES **********************/
+
+bool ADXL345_Async::Transfer::await_suspend(coroutine_handle<> h) {
+	StatusType status;
+	_handle = h;
+	_state.store(STATE_STARTING);
+	uint8_t *data = _data ? _data : &_val;
+	if (_write) {
+		status = _async->_transport->StartWrite(_reg, data, _n, &Transfer::_Complete, this);
+	}
+	else {
+		status = _async->_transport->StartRead(_reg, data, _n, &Transfer::_Complete, this);
+	}
+	if (status) {
+		_status = status;
+		return false;
+	}
+	// If the transfer already completed inline, continue without a round trip through the executor.
+	return _state.exchange(STATE_SUSPENDED) != STATE_DONE;
+}
+
+void ADXL345_Async::Transfer::_Complete(void *context, StatusType status) {
+	Transfer *transfer = static_cast<Transfer*>(context);
+	transfer->_status = status;
+	if (transfer->_state.exchange(STATE_DONE) == STATE_SUSPENDED) {
+		transfer->_async->_executor->Post(transfer->_handle);
+	}
+}
+
+ADXL345_Async::Transfer ADXL345_Async::Read(uint8_t reg, uint8_t data[], uint8_t n) {
+	return Transfer(this, reg, data, n, false);
+}
+
+ADXL345_Async::Transfer ADXL345_Async::Write(uint8_t reg, const uint8_t data[], uint8_t n) {
+	// The transports never write through data for a write transfer.
+	return Transfer(this, reg, const_cast<uint8_t*>(data), n, true);
+}
+
+ADXL345_Async::Transfer ADXL345_Async::Write(uint8_t reg, uint8_t val) {
+	return Transfer(this, reg, nullptr, 1, true, val);
+}
+
+ADXL345_Task ADXL345_Async::ReadData(int16_t data[3]) {
+	StatusType status;
+	uint8_t buffer[6];
+	status = co_await Read(ADXL345::REG_DATAX0, buffer, 6);
+	if (status) { co_return status; }
+	_dev->_RawFromBuffer(buffer, data);
+	co_return StatusType(0);
+}
+
+ADXL345_Task ADXL345_Async::ReadFifo(int16_t data[][3], uint8_t maxEntries, uint8_t *entries) {
+	StatusType status;
+	uint8_t fifoStatus;
+	*entries = 0;
+	status = co_await Read(ADXL345::REG_FIFO_STATUS, &fifoStatus, 1);
+	if (status) { co_return status; }
+	uint8_t available = ADXL345::FIELD_FIFO_STATUS_ENTRIES::Decode(fifoStatus);
+	if (available > maxEntries) { available = maxEntries; }
+	for (uint8_t i=0; i<available; i++) {
+		uint8_t buffer[6];
+		status = co_await Read(ADXL345::REG_DATAX0, buffer, 6);
+		if (status) { co_return status; }
+		_dev->_RawFromBuffer(buffer, data[i]);
+		*entries = i + 1;
+	}
+	co_return StatusType(0);
+}
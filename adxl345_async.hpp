@@ -0,0 +1,314 @@
+/*
+adxl345_async.hpp - ADXL345 C++20 coroutine layer
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_ASYNC_HPP_
+#define ADXL345_ASYNC_HPP_
+
+#include "adxl345.hpp"
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+
+// Number and size of the statically allocated coroutine frames.
+// Every ADXL345_Task coroutine that is alive at the same time occupies one block.
+#ifndef ADXL345_FRAME_POOL_BLOCKS
+#define ADXL345_FRAME_POOL_BLOCKS	8
+#endif
+#ifndef ADXL345_FRAME_BLOCK_SIZE
+#define ADXL345_FRAME_BLOCK_SIZE	256
+#endif
+
+// Fixed pool the coroutine frames are allocated from, so no heap is used.
+// Allocate() returns nullptr if the pool is exhausted or size is too big,
+// the coroutine then evaluates to STATUS_NO_MEMORY.
+// Allocate() and Free() mask interrupts for a few instructions, frames may be
+// destroyed in the completion interrupt when ADXL345_InlineExecutor resumes there.
+class ADXL345_FramePool {
+public:
+	static void *Allocate(std::size_t size);
+	static void Free(void *block);
+	static uint8_t GetFree();
+};
+
+// Resumes suspended coroutines once their transfer completed.
+class ADXL345_Executor {
+public:
+	virtual ~ADXL345_Executor() {}
+//	Schedules h for resumption. May be called from interrupt context.
+	virtual void Post(std::coroutine_handle<> h) = 0;
+};
+
+// Resumes the coroutine directly in the completing context,
+// e.g. in the I2C interrupt handler.
+class ADXL345_InlineExecutor : public ADXL345_Executor {
+public:
+	virtual void Post(std::coroutine_handle<> h);
+};
+
+// Queues completions in a fixed ring, Poll() resumes them from an event loop.
+// The ring has a single producer: Post() must only be called from one context,
+// e.g. the completion interrupt of one bus, and Poll() from the loop.
+// Every suspended ADXL345_Task holds a pool frame and is posted at most once, so the
+// ring, sized from ADXL345_FRAME_POOL_BLOCKS, cannot overflow with pooled frames.
+class ADXL345_LoopExecutor : public ADXL345_Executor {
+public:
+	enum {
+		QUEUE_SIZE	=	ADXL345_FRAME_POOL_BLOCKS < 16 ? 16 : ADXL345_FRAME_POOL_BLOCKS < 32 ? 32
+						: ADXL345_FRAME_POOL_BLOCKS < 64 ? 64 : ADXL345_FRAME_POOL_BLOCKS < 128 ? 128 : 256,
+	};
+	static_assert(QUEUE_SIZE > ADXL345_FRAME_POOL_BLOCKS, "ADXL345_FRAME_POOL_BLOCKS must be below 256");
+	ADXL345_LoopExecutor()
+	:	_head (0),
+		_tail (0),
+		_overflows (0)
+	{}
+	virtual void Post(std::coroutine_handle<> h);
+//	Resumes every queued coroutine, returns how many were resumed.
+	unsigned Poll();
+//	Number of completions resumed inside Post() because the queue was full.
+	uint32_t GetOverflows() { return _overflows; }
+private:
+	std::coroutine_handle<> _queue[QUEUE_SIZE];
+	std::atomic<uint8_t> _head;		// written by Post()
+	std::atomic<uint8_t> _tail;		// written by Poll()
+	uint32_t _overflows;
+};
+
+// Non-blocking register transfers.
+// The callback is invoked exactly once per successfully started transfer,
+// possibly before Start*() returns and possibly from interrupt context.
+// If Start*() returns non-zero, the callback is not invoked.
+class ADXL345_AsyncTransport {
+public:
+	typedef ADXL345::StatusType StatusType;
+	typedef void (*Callback)(void *context, StatusType status);
+	virtual ~ADXL345_AsyncTransport() {}
+//	n is the number of bytes in data. It should be at most ADXL345::BUFFER_MAX.
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) = 0;
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) = 0;
+};
+
+// Runs the blocking register IO of an ADXL345 and completes inline.
+// Useful on Linux and for transports without interrupt support.
+class ADXL345_BlockingTransport : public ADXL345_AsyncTransport {
+public:
+	ADXL345_BlockingTransport(ADXL345 *dev)
+	:	_dev (dev)
+	{}
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context);
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context);
+private:
+	ADXL345 *_dev;
+};
+
+// Interrupt driven I2C transfers using the HAL memory functions.
+// Forward HAL_I2C_MemRxCpltCallback() and HAL_I2C_MemTxCpltCallback() to OnComplete(HAL_OK)
+// and HAL_I2C_ErrorCallback() to OnComplete(HAL_ERROR) for the corresponding handle.
+// Only one transfer can be in flight per instance.
+class ADXL345_I2C_IT : public ADXL345_AsyncTransport {
+public:
+	ADXL345_I2C_IT(I2C_HandleTypeDef *hi2c, uint8_t sdoState = ADXL345::PIN_STATE_LOW)
+	:	_hi2c (hi2c),
+		_devAddr (sdoState == ADXL345::PIN_STATE_LOW ?
+				ADXL345_I2C::DEVICE_I2C_ADDR_SDO_LOW : ADXL345_I2C::DEVICE_I2C_ADDR_SDO_HIGH),
+		_callback (nullptr),
+		_context (nullptr)
+	{}
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context);
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context);
+	void OnComplete(StatusType status);
+private:
+	I2C_HandleTypeDef *_hi2c;
+	uint8_t _devAddr;
+	uint8_t _txBuffer[ADXL345::BUFFER_MAX];
+	Callback volatile _callback;
+	void *_context;
+};
+
+// DMA driven I2C transfers using the HAL memory functions, wired up like ADXL345_I2C_IT
+// with the same HAL callbacks. On cores with a data cache the read buffers
+// have to be in non-cacheable memory.
+class ADXL345_I2C_DMA : public ADXL345_AsyncTransport {
+public:
+	ADXL345_I2C_DMA(I2C_HandleTypeDef *hi2c, uint8_t sdoState = ADXL345::PIN_STATE_LOW)
+	:	_hi2c (hi2c),
+		_devAddr (sdoState == ADXL345::PIN_STATE_LOW ?
+				ADXL345_I2C::DEVICE_I2C_ADDR_SDO_LOW : ADXL345_I2C::DEVICE_I2C_ADDR_SDO_HIGH),
+		_callback (nullptr),
+		_context (nullptr)
+	{}
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context);
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context);
+	void OnComplete(StatusType status);
+private:
+	I2C_HandleTypeDef *_hi2c;
+	uint8_t _devAddr;
+	uint8_t _txBuffer[ADXL345::BUFFER_MAX];
+	Callback volatile _callback;
+	void *_context;
+};
+
+// DMA driven SPI transfers. Forward HAL_SPI_TxRxCpltCallback() and HAL_SPI_TxCpltCallback()
+// to OnComplete(HAL_OK) and HAL_SPI_ErrorCallback() to OnComplete(HAL_ERROR).
+// The command byte and the data move in one full-duplex transfer with the slave select
+// low, the received data is copied out of the internal buffer on completion.
+// Only one transfer can be in flight per instance.
+class ADXL345_SPI_DMA : public ADXL345_AsyncTransport {
+public:
+	ADXL345_SPI_DMA(SPI_HandleTypeDef *hspi, GPIO_TypeDef *ssPort, uint16_t ssPin)
+	:	_hspi (hspi),
+		_ssPort (ssPort),
+		_ssPin (ssPin),
+		_callback (nullptr),
+		_context (nullptr),
+		_data (nullptr),
+		_n (0)
+	{}
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context);
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context);
+	void OnComplete(StatusType status);
+private:
+	SPI_HandleTypeDef *_hspi;
+	GPIO_TypeDef *_ssPort;
+	uint16_t _ssPin;
+	uint8_t _txBuffer[ADXL345::BUFFER_MAX+1];
+	uint8_t _rxBuffer[ADXL345::BUFFER_MAX+1];
+	Callback volatile _callback;
+	void *_context;
+	uint8_t *_data;			// destination of a read, nullptr for a write
+	uint8_t _n;
+};
+
+// Coroutine returning a StatusType. Frames come from ADXL345_FramePool.
+// A task starts suspended. Either co_await it from another task,
+// or call Start() on a top-level task and keep the object alive until Done().
+class [[nodiscard]] ADXL345_Task {
+public:
+	typedef ADXL345::StatusType StatusType;
+	struct promise_type {
+		StatusType status = 0;
+		std::coroutine_handle<> continuation;
+
+		static void *operator new(std::size_t size) noexcept { return ADXL345_FramePool::Allocate(size); }
+		static void operator delete(void *block) noexcept { ADXL345_FramePool::Free(block); }
+		static ADXL345_Task get_return_object_on_allocation_failure() { return ADXL345_Task(); }
+
+		ADXL345_Task get_return_object() {
+			return ADXL345_Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		struct FinalAwaiter {
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+				std::coroutine_handle<> next = h.promise().continuation;
+				return next ? next : std::noop_coroutine();
+			}
+			void await_resume() noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_value(StatusType s) { status = s; }
+		// Keeping the exception would need a heap allocation, the awaiting task sees a failure instead.
+		void unhandled_exception() { status = StatusType(HAL_ERROR); }
+	};
+
+	ADXL345_Task(ADXL345_Task &&other) : _handle (other._handle) { other._handle = nullptr; }
+	ADXL345_Task(const ADXL345_Task &) = delete;
+	ADXL345_Task &operator=(const ADXL345_Task &) = delete;
+	~ADXL345_Task() { if (_handle) { _handle.destroy(); } }
+
+//	Runs a top-level task until its first suspension.
+	void Start() { if (_handle && !_handle.done()) { _handle.resume(); } }
+	bool Done() { return !_handle || _handle.done(); }
+	StatusType GetStatus() { return _handle ? _handle.promise().status : StatusType(ADXL345::STATUS_NO_MEMORY); }
+
+	bool await_ready() { return Done(); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+		_handle.promise().continuation = awaiting;
+		return _handle;
+	}
+	StatusType await_resume() { return GetStatus(); }
+private:
+	ADXL345_Task() : _handle (nullptr) {}
+	explicit ADXL345_Task(std::coroutine_handle<promise_type> h) : _handle (h) {}
+	std::coroutine_handle<promise_type> _handle;
+};
+
+// Awaitable register access on top of an ADXL345_AsyncTransport.
+// The ADXL345 instance provides the DATA_FORMAT state used for sample conversion,
+// call RefreshDataFormat() or a DATA_FORMAT setter on it before reading samples.
+class ADXL345_Async {
+public:
+	typedef ADXL345::StatusType StatusType;
+
+//	Awaitable of a single transfer, co_await yields its StatusType.
+	class Transfer {
+	public:
+		bool await_ready() { return false; }
+		bool await_suspend(std::coroutine_handle<> h);
+		StatusType await_resume() { return _status; }
+	private:
+		friend class ADXL345_Async;
+		enum {
+			STATE_STARTING	=	0x0,
+			STATE_SUSPENDED	=	0x1,
+			STATE_DONE		=	0x2,
+		};
+		Transfer(ADXL345_Async *async, uint8_t reg, uint8_t *data, uint8_t n, bool write, uint8_t val = 0)
+		:	_async (async),
+			_reg (reg),
+			_n (n),
+			_write (write),
+			_val (val),
+			_data (data),
+			_status (0),
+			_state (STATE_STARTING)
+		{}
+		static void _Complete(void *context, StatusType status);
+		ADXL345_Async *_async;
+		uint8_t _reg;
+		uint8_t _n;
+		bool _write;
+		uint8_t _val;		// storage for single byte writes
+		uint8_t *_data;
+		StatusType _status;
+		std::atomic<uint8_t> _state;
+		std::coroutine_handle<> _handle;
+	};
+
+	ADXL345_Async(ADXL345 *dev, ADXL345_AsyncTransport *transport, ADXL345_Executor *executor)
+	:	_dev (dev),
+		_transport (transport),
+		_executor (executor)
+	{}
+
+//	n is the number of bytes in data. It should be at most ADXL345::BUFFER_MAX.
+	Transfer Read(uint8_t reg, uint8_t data[], uint8_t n);
+	Transfer Write(uint8_t reg, const uint8_t data[], uint8_t n);
+	Transfer Write(uint8_t reg, uint8_t val);
+
+	ADXL345_Task ReadData(int16_t data[3]);
+//	Drains up to maxEntries samples, see ADXL345::GetFifoDataRaw().
+	ADXL345_Task ReadFifo(int16_t data[][3], uint8_t maxEntries, uint8_t *entries);
+private:
+	ADXL345 *_dev;
+	ADXL345_AsyncTransport *_transport;
+	ADXL345_Executor *_executor;
+};
+
+#endif /* ADXL345_ASYNC_HPP_ */
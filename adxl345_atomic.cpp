@@ -0,0 +1,89 @@
+/*
+adxl345_atomic.cpp - Atomic read-modify-write helpers for cores without exclusive access instructions
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Cortex-M0 and M0+ (ARMv6-M) have no LDREX/STREX, so GCC compiles the compare-and-swap,
+// exchange and fetch-and-add of std::atomic to calls of __atomic_x_N, which the libgcc of
+// arm-none-eabi does not provide. They are implemented here with interrupts masked,
+// which is atomic on these single core parts. Plain loads and stores stay inline.
+// Other targets and hosts inline all of them, the file is empty there.
+#if defined(__ARM_ARCH_6M__) && !defined(ADXL345_NO_HAL)
+
+#include "adxl345_critical.hpp"
+
+namespace {
+
+template <class T>
+T Exchange(volatile void *mem, T val) {
+	ADXL345_CriticalSection cs;
+	volatile T *p = static_cast<volatile T*>(mem);
+	const T old = *p;
+	*p = val;
+	return old;
+}
+
+template <class T>
+bool CompareExchange(volatile void *mem, void *expected, T desired) {
+	ADXL345_CriticalSection cs;
+	volatile T *p = static_cast<volatile T*>(mem);
+	T *e = static_cast<T*>(expected);
+	const T old = *p;
+	if (old == *e) {
+		*p = desired;
+		return true;
+	}
+	*e = old;
+	return false;
+}
+
+template <class T>
+T FetchAdd(volatile void *mem, T val) {
+	ADXL345_CriticalSection cs;
+	volatile T *p = static_cast<volatile T*>(mem);
+	const T old = *p;
+	*p = T(old + val);
+	return old;
+}
+
+template <class T>
+T FetchSub(volatile void *mem, T val) {
+	ADXL345_CriticalSection cs;
+	volatile T *p = static_cast<volatile T*>(mem);
+	const T old = *p;
+	*p = T(old - val);
+	return old;
+}
+
+}
+
+// The assembler names keep the compiler from checking these against its builtins.
+#define ADXL345_ATOMIC_HELPERS(N, T) \
+	extern "C" T ADXL345_AtomicExchange##N(volatile void *mem, T val, int) __asm__("__atomic_exchange_" #N); \
+	extern "C" T ADXL345_AtomicExchange##N(volatile void *mem, T val, int) { return Exchange<T>(mem, val); } \
+	extern "C" bool ADXL345_AtomicCompareExchange##N(volatile void *mem, void *expected, T desired, bool, int, int) __asm__("__atomic_compare_exchange_" #N); \
+	extern "C" bool ADXL345_AtomicCompareExchange##N(volatile void *mem, void *expected, T desired, bool, int, int) { return CompareExchange<T>(mem, expected, desired); } \
+	extern "C" T ADXL345_AtomicFetchAdd##N(volatile void *mem, T val, int) __asm__("__atomic_fetch_add_" #N); \
+	extern "C" T ADXL345_AtomicFetchAdd##N(volatile void *mem, T val, int) { return FetchAdd<T>(mem, val); } \
+	extern "C" T ADXL345_AtomicFetchSub##N(volatile void *mem, T val, int) __asm__("__atomic_fetch_sub_" #N); \
+	extern "C" T ADXL345_AtomicFetchSub##N(volatile void *mem, T val, int) { return FetchSub<T>(mem, val); }
+
+ADXL345_ATOMIC_HELPERS(1, uint8_t)
+ADXL345_ATOMIC_HELPERS(2, uint16_t)
+ADXL345_ATOMIC_HELPERS(4, uint32_t)
+
+#endif
@@ -0,0 +1,62 @@
+/*
+adxl345_block.hpp - Column-wise block of ADXL345 samples
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_BLOCK_HPP_
+#define ADXL345_BLOCK_HPP_
+
+#include "main.h"
+
+// Samples per ADXL345_SampleBlock, a multiple of 16 so every column is 32 byte aligned.
+#ifndef ADXL345_SAMPLE_BLOCK_SIZE
+#define ADXL345_SAMPLE_BLOCK_SIZE	64
+#endif
+
+// Samples of consecutive stream indices, one array per axis, as filled by
+// ADXL345_Core::GetFifoDataBlock() and ADXL345_StreamMonitor::DrainBlock().
+// Values are converted like GetDataRaw(). Lost samples are not marked by a gap
+// frame as in the interleaved frames, but by gap, the samples missing right before
+// axis[.][0]; firstSample already counts them.
+struct alignas(32) ADXL345_SampleBlock {
+	enum {
+		CAPACITY		=	ADXL345_SAMPLE_BLOCK_SIZE,
+		AXIS_X			=	0x0,
+		AXIS_Y			=	0x1,
+		AXIS_Z			=	0x2,
+	};
+	static_assert(CAPACITY % 16 == 0 && CAPACITY >= 48, "ADXL345_SAMPLE_BLOCK_SIZE must be a multiple of 16 holding a full FIFO");
+
+	int16_t axis[3][CAPACITY];	// first, so every column starts 32 byte aligned
+	uint32_t firstSample;		// stream index of axis[.][0], lost samples count too
+	uint32_t timestamp;			// estimated time of axis[.][0] in us, see ADXL345_StreamMonitor::FirstSampleTime()
+	uint32_t gap;				// samples lost right before axis[.][0]
+	uint16_t samples;
+	uint8_t dataFormat;			// DATA_FORMAT the samples were converted with
+	uint8_t rate;				// VAL_BW_x of the samples
+	uint8_t flags;				// ADXL345_StreamMonitor::FLAG_x
+	uint8_t intSource;			// INT_SOURCE read at drain time
+
+//	Empties the block, keeping no metadata.
+	void Clear() {
+		firstSample = timestamp = gap = 0;
+		samples = 0;
+		dataFormat = rate = flags = intSource = 0;
+	}
+};
+
+#endif /* ADXL345_BLOCK_HPP_ */
@@ -0,0 +1,33 @@
+/*
+adxl345_capture.cpp - ADXL345 trigger mode shock capture
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_capture.hpp"
+
+uint8_t ADXL345_TriggerCapture::_FifoCtl(uint8_t mode) {
+	typedef ADXL345_Defs D;
+	return D::FIELD_FIFO_CTL_MODE::Encode(mode)
+		| D::FIELD_FIFO_CTL_TRIGGER_INT2::Encode(_triggerPin == D::PIN_INT2)
+		| D::FIELD_FIFO_CTL_SAMPLES::Encode(_preTrigger);
+}
+
+void ADXL345_TriggerCapture::Release() {
+	if (_state != STATE_DONE) { return; }
+	// The FIFO was re-armed when the capture finished.
+	_state = _armed ? STATE_ARMED : STATE_IDLE;
+}
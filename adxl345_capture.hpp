@@ -0,0 +1,158 @@
+/*
+adxl345_capture.hpp - ADXL345 trigger mode shock capture
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_CAPTURE_HPP_
+#define ADXL345_CAPTURE_HPP_
+
+#include "adxl345_core.hpp"
+
+// Captures a window around a trigger event at full output data rate.
+// Arm() puts the FIFO into trigger mode, keeping preTrigger samples of history.
+// When the interrupt selected as trigger fires (the event mapped to INT1 or INT2),
+// OnTrigger() drains the history and switches the FIFO to stream mode.
+// Poll() is called on every watermark or data interrupt afterwards
+// until postTrigger further samples are collected, then the FIFO is re-armed.
+// The finished capture stays in the buffer until Release() is called,
+// triggers in the meantime are only counted.
+// Clearing the event that caused the trigger (reading INT_SOURCE) is up to the application.
+// The window is kept as interleaved frames rather than an ADXL345_SampleBlock,
+// it spans several drains that the capture performs itself.
+class ADXL345_TriggerCapture {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		STATE_IDLE			=	0x0,
+		STATE_ARMED			=	0x1,
+		STATE_COLLECTING	=	0x2,
+		STATE_DONE			=	0x3,
+	};
+
+	struct Capture {
+		uint32_t sequence;		// counts finished captures
+		uint32_t timestamp;		// time of the trigger interrupt, as passed to OnTrigger()
+		uint16_t preSamples;	// samples before the trigger, they come first in the buffer
+		uint16_t samples;		// total samples in the buffer
+	};
+
+//	preTrigger can range from 0 to 31, buffer must hold preTrigger + postTrigger frames.
+	ADXL345_TriggerCapture(int16_t buffer[][3], uint16_t capacity, uint8_t preTrigger, uint16_t postTrigger, uint8_t triggerPin = ADXL345_Defs::PIN_INT1)
+	:	_buffer (buffer),
+		_capacity (capacity),
+		_preTrigger (ADXL345_Defs::FIELD_FIFO_CTL_SAMPLES::Decode(preTrigger)),
+		_postTrigger (postTrigger),
+		_triggerPin (triggerPin),
+		_state (STATE_IDLE),
+		_armed (false),
+		_missed (0)
+	{
+		_capture.sequence = 0;
+		_capture.timestamp = 0;
+		_capture.preSamples = 0;
+		_capture.samples = 0;
+	}
+
+	template <class Derived>
+	StatusType Arm(ADXL345_Core<Derived> *dev);
+//	Call from the trigger interrupt (or a task it wakes), timestamp is the interrupt time.
+	template <class Derived>
+	StatusType OnTrigger(ADXL345_Core<Derived> *dev, uint32_t timestamp);
+//	Collects post-trigger samples, re-arms once the window is complete.
+	template <class Derived>
+	StatusType Poll(ADXL345_Core<Derived> *dev);
+
+	uint8_t GetState() { return _state; }
+	bool Ready() { return _state == STATE_DONE; }
+//	Valid while Ready().
+	const Capture &GetCapture() { return _capture; }
+	const int16_t (*GetBuffer())[3] { return _buffer; }
+//	Hands the buffer back for the next capture.
+	void Release();
+//	Triggers that occurred while a capture was still unreleased or collecting.
+	uint32_t GetMissed() { return _missed; }
+private:
+	uint8_t _FifoCtl(uint8_t mode);
+	uint16_t _Window() { return _capacity < uint16_t(_preTrigger + _postTrigger) ? _capacity : _preTrigger + _postTrigger; }
+	int16_t (*_buffer)[3];
+	uint16_t _capacity;
+	uint8_t _preTrigger;
+	uint16_t _postTrigger;
+	uint8_t _triggerPin;
+	volatile uint8_t _state;
+	bool _armed;		// FIFO is in trigger mode, also while a capture is held
+	uint32_t _missed;
+	Capture _capture;
+};
+
+template <class Derived>
+ADXL345_TriggerCapture::StatusType ADXL345_TriggerCapture::Arm(ADXL345_Core<Derived> *dev) {
+	StatusType status;
+	// Going through bypass clears the FIFO and the trigger flag.
+	status = dev->SetFifoCtl(_FifoCtl(ADXL345_Defs::VAL_FIFO_MODE_BYPASS));
+	if (status) { return status; }
+	status = dev->SetFifoCtl(_FifoCtl(ADXL345_Defs::VAL_FIFO_MODE_TRIGGER));
+	if (status) { return status; }
+	_armed = true;
+	if (_state != STATE_DONE) { _state = STATE_ARMED; }
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_TriggerCapture::StatusType ADXL345_TriggerCapture::OnTrigger(ADXL345_Core<Derived> *dev, uint32_t timestamp) {
+	StatusType status;
+	uint8_t drained;
+	if (_state != STATE_ARMED) {
+		_missed++;
+		// A held capture keeps the buffer, start over with fresh history.
+		return _state == STATE_DONE ? Arm(dev) : StatusType(0);
+	}
+	const uint16_t window = _Window();
+	const uint8_t maxEntries = window < ADXL345_Defs::FIFO_MAX ? uint8_t(window) : uint8_t(ADXL345_Defs::FIFO_MAX);
+	status = dev->GetFifoDataRaw(_buffer, maxEntries, &drained);
+	if (status) { return status; }
+	_capture.timestamp = timestamp;
+	_capture.preSamples = drained < _preTrigger ? drained : _preTrigger;
+	_capture.samples = drained;
+	_armed = false;
+	_state = STATE_COLLECTING;
+	// Stream mode keeps the remaining entries and collects the post-trigger window.
+	status = dev->SetFifoCtl(_FifoCtl(ADXL345_Defs::VAL_FIFO_MODE_STREAM));
+	if (status) { return status; }
+	return Poll(dev);
+}
+
+template <class Derived>
+ADXL345_TriggerCapture::StatusType ADXL345_TriggerCapture::Poll(ADXL345_Core<Derived> *dev) {
+	StatusType status;
+	if (_state != STATE_COLLECTING) { return StatusType(0); }
+	const uint16_t window = _Window();
+	while (_capture.samples < window) {
+		uint8_t drained;
+		const uint16_t remaining = window - _capture.samples;
+		const uint8_t maxEntries = remaining < ADXL345_Defs::FIFO_MAX ? uint8_t(remaining) : uint8_t(ADXL345_Defs::FIFO_MAX);
+		status = dev->GetFifoDataRaw(_buffer + _capture.samples, maxEntries, &drained);
+		if (status) { return status; }
+		if (!drained) { return StatusType(0); }
+		_capture.samples += drained;
+	}
+	_capture.sequence++;
+	_state = STATE_DONE;
+	return Arm(dev);
+}
+
+#endif /* ADXL345_CAPTURE_HPP_ */
@@ -0,0 +1,73 @@
+/*
+adxl345_config.hpp - Compile-time feature selection of the ADXL345 library
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_CONFIG_HPP_
+#define ADXL345_CONFIG_HPP_
+
+// Each ADXL345_FEATURE_x set to 0 removes the methods of a register group from
+// ADXL345_Core, so they are neither declared nor compiled, whatever the linker does.
+// Set the macros for every translation unit, e.g. with -D in the build flags.
+// ADXL345_FEATURE_DEFAULT is the value of all groups not set explicitly, so
+//	-DADXL345_FEATURE_DEFAULT=0 -DADXL345_FEATURE_FIFO=1
+// builds the register core with only the FIFO added.
+// DEVID, BW_RATE, POWER_CTL, the interrupt registers, DATA_FORMAT and GetDataRaw()
+// are always available.
+// The async, instrumentation and DSP parts live in their own translation units
+// (adxl345_async.cpp, adxl345_latency.cpp, adxl345_detect.cpp, ...) and are
+// selected by compiling and linking them or not. tools/adxl345_footprint.sh
+// reports what each group and unit costs.
+#ifndef ADXL345_FEATURE_DEFAULT
+#define ADXL345_FEATURE_DEFAULT		1
+#endif
+
+// float API: SetGain(), GetData() and the G and ms overloads of the threshold and time registers.
+// Without it no floating point code is pulled in by the core.
+#ifndef ADXL345_FEATURE_FLOAT
+#define ADXL345_FEATURE_FLOAT		ADXL345_FEATURE_DEFAULT
+#endif
+// THRESH_TAP, DUR, Latent, Window, TAP_AXES
+#ifndef ADXL345_FEATURE_TAP
+#define ADXL345_FEATURE_TAP			ADXL345_FEATURE_DEFAULT
+#endif
+// THRESH_ACT, THRESH_INACT, TIME_INACT, ACT_INACT_CTL, GetAsleep()
+#ifndef ADXL345_FEATURE_ACTIVITY
+#define ADXL345_FEATURE_ACTIVITY	ADXL345_FEATURE_DEFAULT
+#endif
+// THRESH_FF, TIME_FF
+#ifndef ADXL345_FEATURE_FREEFALL
+#define ADXL345_FEATURE_FREEFALL	ADXL345_FEATURE_DEFAULT
+#endif
+// OFSX, OFSY, OFSZ
+#ifndef ADXL345_FEATURE_OFFSET
+#define ADXL345_FEATURE_OFFSET		ADXL345_FEATURE_DEFAULT
+#endif
+// FIFO_CTL, FIFO_STATUS, GetFifoDataRaw(). Needed by the stream, capture,
+// governor and ping-pong modules.
+#ifndef ADXL345_FEATURE_FIFO
+#define ADXL345_FEATURE_FIFO		ADXL345_FEATURE_DEFAULT
+#endif
+
+// adxl345.cpp explicitly instantiates every enabled method of ADXL345_Core<ADXL345>
+// once. With 0, the methods of the virtual ADXL345 are instantiated where they
+// are used instead, so a build only gets those it calls.
+#ifndef ADXL345_EXPLICIT_INSTANCE
+#define ADXL345_EXPLICIT_INSTANCE	1
+#endif
+
+#endif /* ADXL345_CONFIG_HPP_ */
@@ -0,0 +1,1431 @@
+/*
+adxl345_core.hpp - ADXL345 register logic shared by all transports
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_CORE_HPP_
+#define ADXL345_CORE_HPP_
+
+#include "main.h"
+#include "adxl345_config.hpp"
+#include "adxl345_block.hpp"
+#include <math.h>
+
+// Bit field of a register, Width bits starting at bit Lsb.
+// All masks and shifts are computed at compile time.
+template <uint8_t Reg, uint8_t Lsb, uint8_t Width>
+struct ADXL345_Field {
+	static_assert(Width >= 1 && Lsb + Width <= 8, "field does not fit into a register");
+	enum : uint8_t {
+		reg		=	Reg,
+		lsb		=	Lsb,
+		max		=	(1u << Width) - 1,
+		mask	=	((1u << Width) - 1) << Lsb,
+		bits	=	0,		// a bare field assigns no value
+	};
+	static constexpr uint8_t Encode(uint8_t value) { return uint8_t((value << Lsb) & mask); }
+	static constexpr uint8_t Decode(uint8_t regValue) { return uint8_t((regValue & mask) >> Lsb); }
+
+//	Assignment of a constant value, values that do not fit are rejected at compile time.
+	template <uint8_t Value>
+	struct Is {
+		static_assert(Value <= max, "value does not fit into the field");
+		enum : uint8_t {
+			reg		=	Reg,
+			mask	=	((1u << Width) - 1) << Lsb,
+			bits	=	uint8_t(Value << Lsb),
+		};
+	};
+};
+
+// Merges fields or assignments of one register, so they are written in a single access.
+template <class... Fields>
+struct ADXL345_Merge;
+
+template <class Field>
+struct ADXL345_Merge<Field> {
+	enum : uint8_t {
+		reg		=	Field::reg,
+		mask	=	Field::mask,
+		bits	=	Field::bits,
+	};
+};
+
+template <class Field, class... Rest>
+struct ADXL345_Merge<Field, Rest...> {
+	typedef ADXL345_Merge<Rest...> Others;
+	static_assert(uint8_t(Field::reg) == uint8_t(Others::reg), "only fields of the same register can be merged");
+	static_assert((Field::mask & Others::mask) == 0, "merged fields overlap");
+	enum : uint8_t {
+		reg		=	Field::reg,
+		mask	=	Field::mask | Others::mask,
+		bits	=	Field::bits | Others::bits,
+	};
+};
+
+// Parameter type of a runtime field value.
+template <class Field>
+struct ADXL345_FieldValue {
+	typedef uint8_t Type;
+};
+
+// Register map and constants shared by all ADXL345 variants.
+class ADXL345_Defs {
+public:
+	// A StatusType of zero means success, non-zero means failure.
+	typedef uint8_t StatusType;
+	enum {
+		/******************* STATUS CODES *********************/
+		// inherited from HAL_StatusTypeDef plus following custom ones
+		STATUS_INVALID_ID	=	0x10,
+		STATUS_NO_MEMORY	=	0x11,		// A fixed-size pool or buffer is exhausted
+		STATUS_REPLAY_END	=	0x12,		// A replayed recording has no more matching records
+		STATUS_REPLAY_MISMATCH	=	0x13,	// A write differs from the replayed recording
+		STATUS_IO_ERROR		=	0x14,		// A system call failed, errno tells why
+		STATUS_INFEASIBLE	=	0x15,		// The bus cannot sustain the requested configuration
+
+		/******************* REGISTER MAP *********************/
+		REG_DEVID			=	0x00,		// Device ID
+		REG_RESERVED_FIRST	=	0x01,		// First reserved register. Reserved registers should not be accessed.
+		REG_RESERVED_LAST	=	0x1C,		// Last reserved register.
+		REG_THRESH_TAP		=	0x1D,		// Tap Threshold				// 62.5 mg/LSB (that is, 0xFF = +16g)
+		REG_OFSX			=	0x1E,		// X-Axis Offset				// )
+		REG_OFSY			=	0x1F,		// Y-Axis Offset				// } 15.6 mg/LSB (that is, 0x7F = +2g)
+		REG_OFSZ			=	0x20,		// Z-Axis Offset				// )
+		REG_DUR				=	0x21,		// Tap Duration					// 625 μs/LSB.  0 disables tap/double tap.
+		REG_LATENT			=	0x22,		// Tap Latency					// 1.25 ms/LSB. 0 disables double tap.
+		REG_WINDOW			=	0x23,		// Tap Window					// 1.25 ms/LSB. 0 disables double tap.
+		REG_THRESH_ACT		=	0x24,		// Activity Threshold			// 62.5 mg/LSB
+		REG_THRESH_INACT	=	0x25,		// Inactivity Threshold			// 62.5 mg/LSB
+		REG_TIME_INACT		=	0x26,		// Inactivity Time				// 1 sec/LSB
+		REG_ACT_INACT_CTL	=	0x27,		// Axis Enable Control for Activity and Inactivity Detection
+		REG_THRESH_FF		=	0x28,		// Free-Fall Threshold			// 62.5 mg/LSB. Between 300 and 600 mg (0x05 to 0x09) recommended.
+		REG_TIME_FF			=	0x29,		// Free-Fall Time				// 5 ms/LSB. Between 100 and 350 ms (0x14 to 0x46) recommended.
+		REG_TAP_AXES		=	0x2A,		// Axis Control for Tap/Double Tap
+		REG_ACT_TAP_STATUS	=	0x2B,		// Source of Tap/Double Tap
+		REG_BW_RATE			=	0x2C,		// Data Rate and Power mode Control
+		REG_POWER_CTL		=	0x2D,		// Power-Saving Features Control
+		REG_INT_ENABLE		=	0x2E,		// Interrupt Enable Control
+		REG_INT_MAP			=	0x2F,		// Interrupt Mapping Control
+		REG_INT_SOURCE		=	0x30,		// Source of Interrupts
+		REG_DATA_FORMAT		=	0x31,		// Data Format Control
+		REG_DATAX0			=	0x32,		// X-Axis Data 0
+		REG_DATAX1			=	0x33,		// X-Axis Data 1
+		REG_DATAY0			=	0x34,		// Y-Axis Data 0
+		REG_DATAY1			=	0x35,		// Y-Axis Data 1
+		REG_DATAZ0			=	0x36,		// Z-Axis Data 0
+		REG_DATAZ1			=	0x37,		// Z-Axis Data 1
+		REG_FIFO_CTL		=	0x38,		// FIFO Control
+		REG_FIFO_STATUS		=	0x39,		// FIFO Status
+
+		/******************** BIT POSITIONS *****************/
+//		Setting BIT_ACT_INACT_CTL_ACT_AC sets AC coupled activity detection.
+//		It is DC coupled by default.
+//		Setting BIT_ACT_INACT_CTL_ACT_X enables the X-axis for activity detection.
+//		Similar for inactivity and other axes.
+		BIT_ACT_INACT_CTL_ACT_AC		=	0x7,
+		BIT_ACT_INACT_CTL_ACT_X			=	0x6,
+		BIT_ACT_INACT_CTL_ACT_Y			=	0x5,
+		BIT_ACT_INACT_CTL_ACT_Z			=	0x4,
+		BIT_ACT_INACT_CTL_INACT_AC		=	0x3,
+		BIT_ACT_INACT_CTL_INACT_X		=	0x2,
+		BIT_ACT_INACT_CTL_INACT_Y		=	0x1,
+		BIT_ACT_INACT_CTL_INACT_Z		=	0x0,
+
+//		Setting an axis bit enables the corresponding axis' participation in tap detection.
+//		Tap detection is always AC-coupled.
+//		Setting the suppress bit suppresses double tap detection if
+//		acceleration greater than the value in THRESH_TAP is present
+//		between taps.
+		BIT_TAP_AXES_SUPPRESS	=	0x3,
+		BIT_TAP_AXES_TAP_X		=	0x2,
+		BIT_TAP_AXES_TAP_Y		=	0x1,
+		BIT_TAP_AXES_TAP_Z		=	0x0,
+
+//		The ACT_x and TAP_x bits indicate the first axis
+//		involved in a tap or activity event.
+//		A setting of 1 in the asleep bit indicates that the part is asleep. (autosleep)
+		BIT_ACT_TAP_STATUS_ACT_X	=	0x6,
+		BIT_ACT_TAP_STATUS_ACT_Y	=	0x5,
+		BIT_ACT_TAP_STATUS_ACT_Z	=	0x4,
+		BIT_ACT_TAP_STATUS_ASLEEP	=	0x3,
+		BIT_ACT_TAP_STATUS_TAP_X	=	0x2,
+		BIT_ACT_TAP_STATUS_TAP_Y	=	0x1,
+		BIT_ACT_TAP_STATUS_TAP_Z	=	0x0,
+
+		BIT_BW_RATE_LOW_POWER		=	0x4,
+		BIT_BW_RATE_RATE_MSB		=	0x3,
+		BIT_BW_RATE_RATE_LSB		=	0x0,
+
+		BIT_POWER_CTL_LINK			=	0x5,
+		BIT_POWER_CTL_AUTO_SLEEP	=	0x4,
+		BIT_POWER_CTL_MEASURE		=	0x3,
+		BIT_POWER_CTL_SLEEP			=	0x2,
+		BIT_POWER_CTL_WAKEUP_MSB	=	0x1,
+		BIT_POWER_CTL_WAKEUP_LSB	=	0x0,
+
+		BIT_INT_DATA_READY	=	0x7,
+		BIT_INT_SINGLE_TAP	=	0x6,
+		BIT_INT_DOUBLE_TAP	=	0x5,
+		BIT_INT_ACTIVITY	=	0x4,
+		BIT_INT_INACTIVITY	=	0x3,
+		BIT_INT_FREE_FALL	=	0x2,
+		BIT_INT_WATERMARK	=	0x1,
+		BIT_INT_OVERRUN		=	0x0,
+
+		BIT_DATA_FORMAT_SELF_TEST		=	0x7,
+		BIT_DATA_FORMAT_SPI_3WIRE		=	0x6,
+		BIT_DATA_FORMAT_INT_INVERT		=	0x5,	// reset: int pins active high;   set: active low
+		BIT_DATA_FORMAT_FULL_RES		=	0x3,
+		BIT_DATA_FORMAT_JUSTIFY_LEFT	=	0x2,
+		BIT_DATA_FORMAT_RANGE_MSB		=	0x1,
+		BIT_DATA_FORMAT_RANGE_LSB		=	0x0,
+
+		BIT_FIFO_CTL_MODE_MSB		=	0x7,
+		BIT_FIFO_CTL_MODE_LSB		=	0x6,
+		BIT_FIFO_CTL_TRIGGER_INT2	=	0x5,
+		BIT_FIFO_CTL_SAMPLES_MSB	=	0x4,
+		BIT_FIFO_CTL_SAMPLES_LSB	=	0x0,
+
+		BIT_FIFO_STATUS_FIFO_TRIG	=	0x7,
+		BIT_FIFO_STATUS_ENTRIES_MSB	=	0x5,
+		BIT_FIFO_STATUS_ENTRIES_LSB	=	0x0,
+
+		/****************** REGISTER VALUES ******************/
+		VAL_DEVICE_ID	=	0345,			// Read-only value in REG_DEVID
+
+		VAL_BW_1600_Hz		=	0xF,		// 1111		IDD = 140uA
+		VAL_BW_800_Hz		=	0xE,		// 1110		IDD = 90uA
+		VAL_BW_400_Hz		=	0xD,		// 1101		IDD = 140uA
+		VAL_BW_200_Hz		=	0xC,		// 1100		IDD = 140uA
+		VAL_BW_100_Hz		=	0xB,		// 1011		IDD = 140uA
+		VAL_BW_50_Hz		=	0xA,		// 1010		IDD = 140uA
+		VAL_BW_25_Hz		=	0x9,		// 1001		IDD = 90uA
+		VAL_BW_12_5_Hz		=	0x8,		// 1000		IDD = 60uA
+		VAL_BW_6_25_Hz		=	0x7,		// 0111		IDD = 50uA
+		VAL_BW_3_13_Hz		=	0x6,		// 0110		IDD = 45uA
+		VAL_BW_1_56_Hz		=	0x5,		// 0101		IDD = 40uA
+		VAL_BW_0_78_Hz		=	0x4,		// 0100		IDD = 34uA
+		VAL_BW_0_39_Hz		=	0x3,		// 0011		IDD = 23uA
+		VAL_BW_0_20_Hz		=	0x2,		// 0010		IDD = 23uA
+		VAL_BW_0_10_Hz		=	0x1,		// 0001		IDD = 23uA
+		VAL_BW_0_05_Hz		=	0x0,		// 0000		IDD = 23uA
+
+		VAL_WAKEUP_8_Hz	=	0x0,
+		VAL_WAKEUP_4_Hz	=	0x1,
+		VAL_WAKEUP_2_Hz	=	0x2,
+		VAL_WAKEUP_1_Hz	=	0x3,
+
+		VAL_RANGE_2G	=	0x0,
+		VAL_RANGE_4G	=	0x1,
+		VAL_RANGE_8G	=	0x2,
+		VAL_RANGE_16G	=	0x3,
+
+		VAL_FIFO_MODE_BYPASS	= 0x0,
+		VAL_FIFO_MODE_FIFO		= 0x1,
+		VAL_FIFO_MODE_STREAM	= 0x2,
+		VAL_FIFO_MODE_TRIGGER	= 0x3,
+
+		/******************* INTERRUPT PINS ******************/
+		PIN_INT1	=	0x0,
+		PIN_INT2	=	0x1,
+
+		/********************* PIN STATES ********************/
+		PIN_STATE_HIGH	=	0x1,
+		PIN_STATE_LOW	=	0x0,
+
+		/************************ MISC ***********************/
+		BUFFER_MAX		=	0x6,
+		FIFO_MAX		=	0x21,		// 32 FIFO entries plus the sample held in the DATAxx registers
+	};
+	// Enum with possibly larger constants.
+	enum {
+		COM_TIMEOUT	=	128, // communication timeout in ms
+	};
+
+	/******************** FIELDS ***********************/
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_ACT_AC, 1>		FIELD_ACT_INACT_CTL_ACT_AC;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_ACT_X, 1>		FIELD_ACT_INACT_CTL_ACT_X;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_ACT_Y, 1>		FIELD_ACT_INACT_CTL_ACT_Y;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_ACT_Z, 1>		FIELD_ACT_INACT_CTL_ACT_Z;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_INACT_AC, 1>		FIELD_ACT_INACT_CTL_INACT_AC;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_INACT_X, 1>		FIELD_ACT_INACT_CTL_INACT_X;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_INACT_Y, 1>		FIELD_ACT_INACT_CTL_INACT_Y;
+	typedef ADXL345_Field<REG_ACT_INACT_CTL, BIT_ACT_INACT_CTL_INACT_Z, 1>		FIELD_ACT_INACT_CTL_INACT_Z;
+
+	typedef ADXL345_Field<REG_TAP_AXES, BIT_TAP_AXES_SUPPRESS, 1>				FIELD_TAP_AXES_SUPPRESS;
+	typedef ADXL345_Field<REG_TAP_AXES, BIT_TAP_AXES_TAP_X, 1>					FIELD_TAP_AXES_TAP_X;
+	typedef ADXL345_Field<REG_TAP_AXES, BIT_TAP_AXES_TAP_Y, 1>					FIELD_TAP_AXES_TAP_Y;
+	typedef ADXL345_Field<REG_TAP_AXES, BIT_TAP_AXES_TAP_Z, 1>					FIELD_TAP_AXES_TAP_Z;
+
+	typedef ADXL345_Field<REG_ACT_TAP_STATUS, BIT_ACT_TAP_STATUS_ASLEEP, 1>		FIELD_ACT_TAP_STATUS_ASLEEP;
+
+	typedef ADXL345_Field<REG_BW_RATE, BIT_BW_RATE_LOW_POWER, 1>				FIELD_BW_RATE_LOW_POWER;
+	typedef ADXL345_Field<REG_BW_RATE, BIT_BW_RATE_RATE_LSB, 4>					FIELD_BW_RATE_RATE;
+
+	typedef ADXL345_Field<REG_POWER_CTL, BIT_POWER_CTL_LINK, 1>					FIELD_POWER_CTL_LINK;
+	typedef ADXL345_Field<REG_POWER_CTL, BIT_POWER_CTL_AUTO_SLEEP, 1>			FIELD_POWER_CTL_AUTO_SLEEP;
+	typedef ADXL345_Field<REG_POWER_CTL, BIT_POWER_CTL_MEASURE, 1>				FIELD_POWER_CTL_MEASURE;
+	typedef ADXL345_Field<REG_POWER_CTL, BIT_POWER_CTL_SLEEP, 1>				FIELD_POWER_CTL_SLEEP;
+	typedef ADXL345_Field<REG_POWER_CTL, BIT_POWER_CTL_WAKEUP_LSB, 2>			FIELD_POWER_CTL_WAKEUP;
+
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_SELF_TEST, 1>		FIELD_DATA_FORMAT_SELF_TEST;
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_SPI_3WIRE, 1>		FIELD_DATA_FORMAT_SPI_3WIRE;
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_INT_INVERT, 1>		FIELD_DATA_FORMAT_INT_INVERT;
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_FULL_RES, 1>			FIELD_DATA_FORMAT_FULL_RES;
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_JUSTIFY_LEFT, 1>		FIELD_DATA_FORMAT_JUSTIFY_LEFT;
+	typedef ADXL345_Field<REG_DATA_FORMAT, BIT_DATA_FORMAT_RANGE_LSB, 2>			FIELD_DATA_FORMAT_RANGE;
+
+	typedef ADXL345_Field<REG_FIFO_CTL, BIT_FIFO_CTL_MODE_LSB, 2>				FIELD_FIFO_CTL_MODE;
+	typedef ADXL345_Field<REG_FIFO_CTL, BIT_FIFO_CTL_TRIGGER_INT2, 1>			FIELD_FIFO_CTL_TRIGGER_INT2;
+	typedef ADXL345_Field<REG_FIFO_CTL, BIT_FIFO_CTL_SAMPLES_LSB, 5>			FIELD_FIFO_CTL_SAMPLES;
+
+	typedef ADXL345_Field<REG_FIFO_STATUS, BIT_FIFO_STATUS_FIFO_TRIG, 1>		FIELD_FIFO_STATUS_FIFO_TRIG;
+	typedef ADXL345_Field<REG_FIFO_STATUS, BIT_FIFO_STATUS_ENTRIES_LSB, 6>		FIELD_FIFO_STATUS_ENTRIES;
+
+//	Output data rate in Hz for a VAL_BW_x rate code.
+//	The VAL_BW_x names give the bandwidth, which is half the output data rate.
+	static float OdrFromRate(uint8_t rate) { return 3200.0f / float(1 << (15 - FIELD_BW_RATE_RATE::Decode(rate))); }
+//	Converts the 6 bytes read from DATAX0 to right-justified raw values for a DATA_FORMAT value.
+//	A right-justified INT16_MIN, which the sensor never outputs but a faulty bus can, is read
+//	as INT16_MIN + 1, INT16_MIN is reserved for the gap marker frames of ADXL345_StreamMonitor.
+	static void RawFromBuffer(uint8_t dataFormat, const uint8_t buffer[6], int16_t data[3]) {
+		const bool leftJustify	= FIELD_DATA_FORMAT_JUSTIFY_LEFT::Decode(dataFormat);
+		const bool fullRes		= FIELD_DATA_FORMAT_FULL_RES::Decode(dataFormat);
+		const uint8_t range		= FIELD_DATA_FORMAT_RANGE::Decode(dataFormat);
+		for (uint8_t i=0; i<3; i++) {
+			data[i] = _Raw(buffer[2*i], buffer[2*i+1], leftJustify);
+			if (leftJustify) {
+				uint8_t divisor = 64;
+				if (fullRes) {
+					divisor >>= range;
+				}
+				data[i] /= divisor;
+			}
+		}
+	}
+//	Converts n DATAX0..DATAZ1 register dumps like RawFromBuffer() into the columns x, y and z
+//	in one pass, the DATA_FORMAT is decoded once.
+	static void ColumnsFromBuffer(uint8_t dataFormat, const uint8_t buffer[], uint8_t n, int16_t x[], int16_t y[], int16_t z[]) {
+		const bool fullRes		= FIELD_DATA_FORMAT_FULL_RES::Decode(dataFormat);
+		const int16_t divisor	= int16_t(fullRes ? 64 >> FIELD_DATA_FORMAT_RANGE::Decode(dataFormat) : 64);
+		const bool leftJustify	= FIELD_DATA_FORMAT_JUSTIFY_LEFT::Decode(dataFormat);
+		for (uint8_t i=0; i<n; i++) {
+			const uint8_t *b = buffer + 6*i;
+			x[i] = _Raw(b[0], b[1], leftJustify);
+			y[i] = _Raw(b[2], b[3], leftJustify);
+			z[i] = _Raw(b[4], b[5], leftJustify);
+		}
+		// A division by a constant of the loop stays out of the common right justified case.
+		if (leftJustify) {
+			for (uint8_t i=0; i<n; i++) {
+				x[i] /= divisor;
+				y[i] /= divisor;
+				z[i] /= divisor;
+			}
+		}
+	}
+//	g per LSB of a raw value for a DATA_FORMAT value, before the gain.
+	static float ScaleFromFormat(uint8_t dataFormat) {
+		const float scale = 1.0f / 256;
+		if (FIELD_DATA_FORMAT_FULL_RES::Decode(dataFormat)) { return scale; }
+		return scale * (1 << FIELD_DATA_FORMAT_RANGE::Decode(dataFormat));
+	}
+//	Typical supply current in uA for a VAL_BW_x rate code while measuring.
+//	Low power mode only affects the rates from VAL_BW_6_25_Hz to VAL_BW_200_Hz.
+	static uint8_t SupplyCurrent(uint8_t rate, bool lowPower) {
+		static const uint8_t normal[16]		= { 23, 23, 23, 23, 34, 40, 45, 50, 60, 90, 140, 140, 140, 140, 90, 140 };
+		static const uint8_t reduced[16]	= { 23, 23, 23, 23, 34, 40, 45, 34, 40, 45, 50, 60, 90, 140, 90, 140 };
+		return lowPower ? reduced[FIELD_BW_RATE_RATE::Decode(rate)] : normal[FIELD_BW_RATE_RATE::Decode(rate)];
+	}
+private:
+//	Value of a DATAx0/DATAx1 byte pair. A right-justified INT16_MIN is moved to INT16_MIN + 1,
+//	left-justified it is a valid sample that the division moves away from INT16_MIN.
+	static int16_t _Raw(uint8_t low, uint8_t high, bool leftJustify) {
+		const int16_t v = int16_t(low + (int8_t(high) * 256));
+		return v == INT16_MIN && !leftJustify ? int16_t(INT16_MIN + 1) : v;
+	}
+};
+
+// Register logic of the ADXL345, independent of the bus.
+// Derived provides the register IO methods
+//	StatusType _WriteTo(uint8_t reg, uint8_t val);
+//	StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n);
+//	StatusType _ReadFrom(uint8_t reg, uint8_t *val);
+//	StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n);
+// which are called without virtual dispatch unless Derived declares them virtual.
+template <class Derived>
+class ADXL345_Core : public ADXL345_Defs {
+public:
+	ADXL345_Core()
+	:	_dataFormat (0x00)
+#if ADXL345_FEATURE_FLOAT
+	,	_gain {1.0f, 1.0f, 1.0f}
+#endif
+	{}
+	~ADXL345_Core() {}
+
+//	void methods never fail.
+//	If a method returns StatusType, it should be checked
+//	if it succeeded (zero) or not (non-zero).
+//	float acceleration arguments are in G.
+//	float time arguments are in ms.
+
+#if ADXL345_FEATURE_FLOAT
+	void SetGain(const float gain[3]);
+	void GetGain(      float gain[3]);
+#endif
+
+	/**************** DEVID ****************/
+	StatusType GetDeviceID(uint8_t *deviceID);
+	StatusType CheckDeviceID(); // Returns a non-zero status if it does not read 0345
+
+#if ADXL345_FEATURE_TAP
+	/************** THRESH_TAP *************/
+	StatusType SetThreshTapRaw(uint8_t  thresh);
+	StatusType GetThreshTapRaw(uint8_t *thresh);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetThreshTap(float  thresh);
+	StatusType GetThreshTap(float *thresh);
+#endif
+#endif
+
+#if ADXL345_FEATURE_OFFSET
+	/*********** OFSX, OFSY, OFSZ **********/
+	StatusType SetOffsetRaw(const int8_t offset[3]);
+	StatusType GetOffsetRaw(      int8_t offset[3]);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetOffset(const float offset[3]);
+	StatusType GetOffset(      float offset[3]);
+#endif
+#endif
+
+#if ADXL345_FEATURE_TAP
+	/***************** DUR *****************/
+	StatusType SetTapDurRaw(uint8_t  dur);
+	StatusType GetTapDurRaw(uint8_t *dur);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetTapDur(float  dur);
+	StatusType GetTapDur(float *dur);
+#endif
+
+	/**************** Latent ***************/
+	StatusType SetTapLatencyRaw(uint8_t  latency);
+	StatusType GetTapLatencyRaw(uint8_t *latency);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetTapLatency(float  latency);
+	StatusType GetTapLatency(float *latency);
+#endif
+
+	/**************** Window ***************/
+	StatusType SetTapWindowRaw(uint8_t  window);
+	StatusType GetTapWindowRaw(uint8_t *window);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetTapWindow(float  window);
+	StatusType GetTapWindow(float *window);
+#endif
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY
+	/************** THRESH_ACT *************/
+	StatusType SetThreshActRaw(uint8_t  thresh);
+	StatusType GetThreshActRaw(uint8_t *thresh);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetThreshAct(float  thresh);
+	StatusType GetThreshAct(float *thresh);
+#endif
+
+	/************* THRESH_INACT ************/
+	StatusType SetThreshInactRaw(uint8_t  thresh);
+	StatusType GetThreshInactRaw(uint8_t *thresh);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetThreshInact(float  thresh);
+	StatusType GetThreshInact(float *thresh);
+#endif
+
+	/************** TIME_INACT *************/
+	StatusType SetTimeInact(uint8_t  timeSec);
+	StatusType GetTimeInact(uint8_t *timeSec);
+
+	/************ ACT_INACT_CTL ************/
+	StatusType SetActInactCtl(uint8_t  bitfield);
+	StatusType GetActInactCtl(uint8_t *bitfield);
+#endif
+
+#if ADXL345_FEATURE_FREEFALL
+	/************** THRESH_FF **************/
+	StatusType SetThreshFFRaw(uint8_t  thresh);
+	StatusType GetThreshFFRaw(uint8_t *thresh);
+#if ADXL345_FEATURE_FLOAT
+	StatusType SetThreshFF(float  thresh);
+	StatusType GetThreshFF(float *thresh);
+#endif
+
+	/*************** TIME_FF ***************/
+	StatusType SetTimeFFRaw(uint8_t  time);
+	StatusType GetTimeFFRaw(uint8_t *time);
+	StatusType SetTimeFF(unsigned  time_ms);
+	StatusType GetTimeFF(unsigned *time_ms);
+#endif
+
+#if ADXL345_FEATURE_TAP
+	/************** TAP_AXES ***************/
+	StatusType SetTapAxes(uint8_t  bitfield);
+	StatusType GetTapAxes(uint8_t *bitfield);
+#endif
+
+#if ADXL345_FEATURE_TAP || ADXL345_FEATURE_ACTIVITY
+	/************ ACT_TAP_STATUS ***********/
+	StatusType GetActTapStatus(uint8_t *bitfield);
+
+#if ADXL345_FEATURE_ACTIVITY
+	StatusType GetAsleep(bool *asleep);
+#endif
+#endif
+
+	/*************** BW_RATE ***************/
+	StatusType SetBwRate(uint8_t  bitfield);
+	StatusType GetBwRate(uint8_t *bitfield);
+
+	StatusType SetLowPower(bool  lowPower);
+	StatusType GetLowPower(bool *lowPower);
+
+	StatusType SetRate(uint8_t  rate);
+	StatusType GetRate(uint8_t *rate);
+
+	/************** POWER_CTL **************/
+	StatusType SetPowerCtl(uint8_t  bitfield);
+	StatusType GetPowerCtl(uint8_t *bitfield);
+
+	StatusType SetLink(bool  link);
+	StatusType GetLink(bool *link);
+
+	StatusType SetAutoSleep(bool  autoSleep);
+	StatusType GetAutoSleep(bool *autoSleep);
+
+	StatusType SetMeasure(bool  measure);
+	StatusType GetMeasure(bool *measure);
+
+	StatusType SetSleep(bool  sleep);
+	StatusType GetSleep(bool *sleep);
+
+	StatusType SetWakeup(uint8_t  wakeup);
+	StatusType GetWakeup(uint8_t *wakeup);
+
+	/************** INT_ENABLE *************/
+	StatusType SetIntEnable(uint8_t  bitfield);
+	StatusType GetIntEnable(uint8_t *bitfield);
+
+	/*************** INT_MAP ***************/
+//	0 maps to INT1 pin, 1 maps to INT2 pin.
+	StatusType SetIntMap(uint8_t  bitfield);
+	StatusType GetIntMap(uint8_t *bitfield);
+
+	/************** INT_SOURCE *************/
+//	The DATA_READY, watermark, and overrun bits are always set
+//	if the corresponding events occur, regardless of the INT_ENABLE register settings.
+//	Other bits, and the corresponding interrupts,
+//	are cleared by reading the INT_SOURCE register.
+	StatusType GetIntSource(uint8_t *bitfield);
+
+	/************* DATA_FORMAT *************/
+//	All the DATA_FORMAT getter methods extract info from _dataFormat
+//	so it should be ensured that _dataFormat is up to date.
+//	A setter or a RefreshDataFormat() call updates _dataFormat.
+	StatusType	SetDataFormat(uint8_t  bitfield);
+	StatusType	RefreshDataFormat(); // Reads the DATA_FORMAT register value into _dataFormat
+	void		GetDataFormat(uint8_t *bitfield);
+
+	StatusType	SetSelfTest(bool  selfTest);
+	void		GetSelfTest(bool *selfTest);
+
+	StatusType	SetSPI3Wire(bool  spi3wire);
+	void		GetSPI3Wire(bool *spi3wire);
+
+	StatusType	SetIntActiveLow(bool  intActiveLow);
+	void		GetIntActiveLow(bool *intActiveLow);
+
+	StatusType	SetFullRes(bool  fullRes);
+	void		GetFullRes(bool *fullRes);
+
+	StatusType	SetLeftJustify(bool  leftJustify);
+	void		GetLeftJustify(bool *leftJustify);
+
+//	Expects VAL_RANGE_x as argument
+	StatusType	SetRange(uint8_t  range);
+	void		GetRange(uint8_t *range);
+
+	/**************** DATAxx ***************/
+	StatusType GetDataRaw(int16_t data[3]);
+#if ADXL345_FEATURE_FLOAT
+	StatusType GetData(float data[3]);
+#endif
+
+#if ADXL345_FEATURE_FIFO
+//	Drains up to maxEntries samples from the FIFO into data, converted like GetDataRaw().
+//	*entries receives the number of samples actually read.
+	StatusType GetFifoDataRaw(int16_t data[][3], uint8_t maxEntries, uint8_t *entries);
+//	Same, appending to the columns of block behind its samples as far as it has room.
+//	Only block->samples and block->dataFormat are updated.
+	StatusType GetFifoDataBlock(ADXL345_SampleBlock *block, uint8_t *entries);
+
+	/*************** FIFO_CTL **************/
+	StatusType SetFifoCtl(uint8_t  bitfield);
+	StatusType GetFifoCtl(uint8_t *bitfield);
+
+//	VAL_FIFO_MODE_x expected as argument
+	StatusType SetFifoMode(uint8_t  mode);
+	StatusType GetFifoMode(uint8_t *mode);
+
+	StatusType SetFifoTriggerInt2(bool  triggerInt2);
+	StatusType GetFifoTriggerInt2(bool *triggerInt2);
+
+//	samples can range from 0 to 31
+	StatusType SetFifoSamples(uint8_t  samples);
+	StatusType GetFifoSamples(uint8_t *samples);
+
+	/************* FIFO_STATUS *************/
+	StatusType GetFifoStatus(uint8_t *fifoStatus);
+
+	StatusType GetFifoTrig(bool *fifoTrig);
+
+	StatusType GetFifoEntries(uint8_t *entries);
+#endif
+
+	/**************** FIELDS ***************/
+//	Typed access to the FIELD_x bit fields. Fields of one register given together
+//	are merged into a single read-modify-write, DATA_FORMAT fields need no read at all.
+//	Constant values are checked at compile time:
+//	SetFields<FIELD_FIFO_CTL_MODE::Is<VAL_FIFO_MODE_STREAM>, FIELD_FIFO_CTL_SAMPLES::Is<16> >();
+	template <class... Assignments>
+	StatusType SetFields();
+//	Runtime values are masked to the width of their field:
+//	SetFields<FIELD_BW_RATE_LOW_POWER, FIELD_BW_RATE_RATE>(lowPower, rate);
+	template <class... Fields>
+	StatusType SetFields(typename ADXL345_FieldValue<Fields>::Type... values);
+	template <class Field>
+	StatusType GetField(uint8_t *value);
+	template <class Field>
+	StatusType GetField(bool *value);
+protected:
+	Derived *_Derived()	{ return static_cast<Derived*>(this); }
+	bool _SelfTest()		{ return FIELD_DATA_FORMAT_SELF_TEST::Decode(_dataFormat); }
+	bool _SPI3Wire()		{ return FIELD_DATA_FORMAT_SPI_3WIRE::Decode(_dataFormat); }
+	bool _IntActiveLow()	{ return FIELD_DATA_FORMAT_INT_INVERT::Decode(_dataFormat); }
+	bool _FullRes()			{ return FIELD_DATA_FORMAT_FULL_RES::Decode(_dataFormat); }
+	bool _LeftJustify()		{ return FIELD_DATA_FORMAT_JUSTIFY_LEFT::Decode(_dataFormat); }
+	uint8_t _Range()		{ return FIELD_DATA_FORMAT_RANGE::Decode(_dataFormat); }
+//	Replaces the mask bits of reg with bits, reading the register only if needed.
+	StatusType _UpdateRegister(uint8_t reg, uint8_t mask, uint8_t bits);
+//	Reads count blocks of n bytes from reg into data, one transfer per block.
+//	Derived classes whose transport can queue several transfers hide this.
+	StatusType _ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count);
+//	Converts one DATAX0..DATAZ1 register dump according to _dataFormat.
+	void _RawFromBuffer(const uint8_t buffer[6], int16_t data[3]);
+	uint8_t _dataFormat; // local backup of the value in the DATA_FORMAT register
+#if ADXL345_FEATURE_FLOAT
+	float _gain[3];
+#endif
+};
+
+inline uint8_t ADXL345_SquashLongIntoUint(long l) {
+	if (l <= 0) {
+		l = 0;
+	}
+	else if (l >= UINT8_MAX) {
+		l = UINT8_MAX;
+	}
+	return uint8_t(l);
+}
+
+inline int8_t ADXL345_SquashLongIntoInt(long l) {
+	if (l <= INT8_MIN) {
+		l = INT8_MIN;
+	}
+	else if (l >= INT8_MAX) {
+		l = INT8_MAX;
+	}
+	return int8_t(l);
+}
+
+#if ADXL345_FEATURE_FLOAT
+template <class Derived>
+void ADXL345_Core<Derived>::SetGain(const float gain[3]) {
+	for (uint8_t i=0; i<3; i++) {
+		_gain[i] = gain[i];
+	}
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetGain(float gain[3]) {
+	for (uint8_t i=0; i<3; i++) {
+		gain[i] = _gain[i];
+	}
+}
+#endif
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetDeviceID(uint8_t *deviceID) {
+	return _Derived()->_ReadFrom(REG_DEVID, deviceID);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::CheckDeviceID() {
+	StatusType status;
+	uint8_t dID;
+	status = GetDeviceID(&dID);
+	if (!status && dID != VAL_DEVICE_ID)
+	{ status = STATUS_INVALID_ID; }
+	return status;
+}
+
+#if ADXL345_FEATURE_TAP
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshTapRaw(uint8_t thresh) {
+	return _Derived()->_WriteTo(REG_THRESH_TAP, thresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshTapRaw(uint8_t *thresh) {
+	return _Derived()->_ReadFrom(REG_THRESH_TAP, thresh);
+}
+#endif
+
+#if ADXL345_FEATURE_TAP && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshTap(float thresh) {
+	// 62.5 mg/LSB
+	uint8_t rawThresh = ADXL345_SquashLongIntoUint(lrintf(thresh * 16));
+	return SetThreshTapRaw(rawThresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshTap(float *thresh) {
+	// 62.5 mg/LSB
+	StatusType status;
+	uint8_t rawThresh;
+	status = GetThreshTapRaw(&rawThresh);
+	*thresh = float(rawThresh) / 16;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_OFFSET
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetOffsetRaw(const int8_t offset[3]) {
+	return _Derived()->_WriteTo(REG_OFSX, (const uint8_t*)offset, 3);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetOffsetRaw(int8_t offset[3]) {
+	return _Derived()->_ReadFrom(REG_OFSX, (uint8_t*)offset, 3);
+}
+#endif
+
+#if ADXL345_FEATURE_OFFSET && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetOffset(const float offset[3]) {
+	int8_t raw[3];
+	for (uint8_t i=0; i<3; i++) {
+		// Assuming two's complement internal integer representation.
+		raw[i] = ADXL345_SquashLongIntoInt(lrintf(64 * offset[i]));
+	}
+	return SetOffsetRaw(raw);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetOffset(float offset[3]) {
+	StatusType status;
+	int8_t raw[3];
+	status = GetOffsetRaw(raw);
+	for (uint8_t i=0; i<3; i++) {
+		offset[i] = float(raw[i]) / 64;
+	}
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_TAP
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapDurRaw(uint8_t dur) {
+	return _Derived()->_WriteTo(REG_DUR, dur);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapDurRaw(uint8_t *dur) {
+	return _Derived()->_ReadFrom(REG_DUR, dur);
+}
+#endif
+
+#if ADXL345_FEATURE_TAP && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapDur(float dur) {
+	// 625 μs/LSB
+	uint8_t rawDur = ADXL345_SquashLongIntoUint(lrintf(dur * 8/5));
+	return SetTapDurRaw(rawDur);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapDur(float *dur) {
+	// 625 μs/LSB
+	StatusType status;
+	uint8_t rawDur;
+	status = GetTapDurRaw(&rawDur);
+	*dur = float(rawDur) * 5/8;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_TAP
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapLatencyRaw(uint8_t latency) {
+	return _Derived()->_WriteTo(REG_LATENT, latency);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapLatencyRaw(uint8_t *latency) {
+	return _Derived()->_ReadFrom(REG_LATENT, latency);
+}
+#endif
+
+#if ADXL345_FEATURE_TAP && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapLatency(float latency) {
+	// 1.25 ms/LSB
+	uint8_t rawLatency = ADXL345_SquashLongIntoUint(lrintf(latency * 4/5));
+	return SetTapLatencyRaw(rawLatency);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapLatency(float *latency) {
+	// 1.25 ms/LSB
+	StatusType status;
+	uint8_t rawLatency;
+	status = GetTapLatencyRaw(&rawLatency);
+	*latency = float(rawLatency) * 5/4;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_TAP
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapWindowRaw(uint8_t window) {
+	return _Derived()->_WriteTo(REG_WINDOW, window);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapWindowRaw(uint8_t *window) {
+	return _Derived()->_ReadFrom(REG_WINDOW, window);
+}
+#endif
+
+#if ADXL345_FEATURE_TAP && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapWindow(float window) {
+	// 1.25 ms/LSB
+	uint8_t rawWindow = ADXL345_SquashLongIntoUint(lrintf(window * 4/5));
+	return SetTapWindowRaw(rawWindow);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapWindow(float *window) {
+	// 1.25 ms/LSB
+	StatusType status;
+	uint8_t rawWindow;
+	status = GetTapWindowRaw(&rawWindow);
+	*window = float(rawWindow) * 5/4;
+	return status;
+}
+#endif
+
+
+#if ADXL345_FEATURE_ACTIVITY
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshActRaw(uint8_t thresh) {
+	return _Derived()->_WriteTo(REG_THRESH_ACT, thresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshActRaw(uint8_t *thresh) {
+	return _Derived()->_ReadFrom(REG_THRESH_ACT, thresh);
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshAct(float thresh) {
+	// 62.5 mg/LSB
+	uint8_t rawThresh = ADXL345_SquashLongIntoUint(lrintf(thresh * 16));
+	return SetThreshActRaw(rawThresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshAct(float *thresh) {
+	// 62.5 mg/LSB
+	StatusType status;
+	uint8_t rawThresh;
+	status = GetThreshActRaw(&rawThresh);
+	*thresh = float(rawThresh) / 16;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshInactRaw(uint8_t thresh) {
+	return _Derived()->_WriteTo(REG_THRESH_INACT, thresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshInactRaw(uint8_t *thresh) {
+	return _Derived()->_ReadFrom(REG_THRESH_INACT, thresh);
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshInact(float thresh) {
+	// 62.5 mg/LSB
+	uint8_t rawThresh = ADXL345_SquashLongIntoUint(lrintf(thresh * 16));
+	return SetThreshInactRaw(rawThresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshInact(float *thresh) {
+	// 62.5 mg/LSB
+	StatusType status;
+	uint8_t rawThresh;
+	status = GetThreshInactRaw(&rawThresh);
+	*thresh = float(rawThresh) / 16;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTimeInact(uint8_t time) {
+	return _Derived()->_WriteTo(REG_TIME_INACT, time);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTimeInact(uint8_t *time) {
+	return _Derived()->_ReadFrom(REG_TIME_INACT, time);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetActInactCtl(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_ACT_INACT_CTL, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetActInactCtl(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_ACT_INACT_CTL, bitfield);
+}
+#endif
+
+#if ADXL345_FEATURE_FREEFALL
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshFFRaw(uint8_t thresh) {
+	return _Derived()->_WriteTo(REG_THRESH_FF, thresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshFFRaw(uint8_t *thresh) {
+	return _Derived()->_ReadFrom(REG_THRESH_FF, thresh);
+}
+#endif
+
+#if ADXL345_FEATURE_FREEFALL && ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetThreshFF(float thresh) {
+	// 62.5 mg/LSB
+	uint8_t rawThresh = ADXL345_SquashLongIntoUint(lrintf(thresh * 16));
+	return SetThreshFFRaw(rawThresh);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetThreshFF(float *thresh) {
+	// 62.5 mg/LSB
+	StatusType status;
+	uint8_t rawThresh;
+	status = GetThreshFFRaw(&rawThresh);
+	*thresh = float(rawThresh) / 16;
+	return status;
+}
+#endif
+
+#if ADXL345_FEATURE_FREEFALL
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTimeFFRaw(uint8_t time) {
+	return _Derived()->_WriteTo(REG_TIME_FF, time);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTimeFFRaw(uint8_t *time) {
+	return _Derived()->_ReadFrom(REG_TIME_FF, time);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTimeFF(unsigned time_ms) {
+	const unsigned max_time_ms = 1275;
+	uint8_t rawTime;
+	if (time_ms >= max_time_ms) {
+		rawTime = 0xFF;
+	}
+	else {
+		rawTime = time_ms / 5;
+		if (time_ms % 5 >= 3)
+		{ rawTime++; }
+	}
+	return SetTimeFFRaw(rawTime);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTimeFF(unsigned *time_ms) {
+	StatusType status;
+	uint8_t rawTime;
+	status = GetTimeFFRaw(&rawTime);
+	*time_ms = unsigned(rawTime) * 5;
+	return status;
+}
+#endif
+
+
+#if ADXL345_FEATURE_TAP
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetTapAxes(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_TAP_AXES, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetTapAxes(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_TAP_AXES, bitfield);
+}
+#endif
+
+#if ADXL345_FEATURE_TAP || ADXL345_FEATURE_ACTIVITY
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetActTapStatus(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_ACT_TAP_STATUS, bitfield);
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetAsleep(bool *asleep) {
+	return GetField<FIELD_ACT_TAP_STATUS_ASLEEP>(asleep);
+}
+#endif
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetBwRate(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_BW_RATE, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetBwRate(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_BW_RATE, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetLowPower(bool lowPower) {
+	return SetFields<FIELD_BW_RATE_LOW_POWER>(lowPower);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetLowPower(bool *lowPower) {
+	return GetField<FIELD_BW_RATE_LOW_POWER>(lowPower);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetRate(uint8_t rate) {
+	return SetFields<FIELD_BW_RATE_RATE>(rate);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetRate(uint8_t *rate) {
+	return GetField<FIELD_BW_RATE_RATE>(rate);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetPowerCtl(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_POWER_CTL, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetPowerCtl(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_POWER_CTL, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetLink(bool link) {
+	return SetFields<FIELD_POWER_CTL_LINK>(link);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetLink(bool *link) {
+	return GetField<FIELD_POWER_CTL_LINK>(link);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetAutoSleep(bool autoSleep) {
+	return SetFields<FIELD_POWER_CTL_AUTO_SLEEP>(autoSleep);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetAutoSleep(bool *autoSleep) {
+	return GetField<FIELD_POWER_CTL_AUTO_SLEEP>(autoSleep);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetMeasure(bool measure) {
+	return SetFields<FIELD_POWER_CTL_MEASURE>(measure);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetMeasure(bool *measure) {
+	return GetField<FIELD_POWER_CTL_MEASURE>(measure);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetSleep(bool sleep) {
+	return SetFields<FIELD_POWER_CTL_SLEEP>(sleep);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetSleep(bool *sleep) {
+	return GetField<FIELD_POWER_CTL_SLEEP>(sleep);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetWakeup(uint8_t wakeup) {
+	return SetFields<FIELD_POWER_CTL_WAKEUP>(wakeup);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetWakeup(uint8_t *wakeup) {
+	return GetField<FIELD_POWER_CTL_WAKEUP>(wakeup);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetIntEnable(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_INT_ENABLE, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetIntEnable(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_INT_ENABLE, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetIntMap(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_INT_MAP, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetIntMap(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_INT_MAP, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetIntSource(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_INT_SOURCE, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetDataFormat(uint8_t bitfield) {
+	StatusType status = _Derived()->_WriteTo(REG_DATA_FORMAT, bitfield);
+	if (!status) { _dataFormat = bitfield; }
+	return status;
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::RefreshDataFormat() {
+	return _Derived()->_ReadFrom(REG_DATA_FORMAT, &_dataFormat);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetDataFormat(uint8_t *bitfield) {
+	*bitfield = _dataFormat;
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetSelfTest(bool selfTest) {
+	return SetFields<FIELD_DATA_FORMAT_SELF_TEST>(selfTest);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetSelfTest(bool *selfTest) {
+	*selfTest = _SelfTest();
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetSPI3Wire(bool spi3wire) {
+	return SetFields<FIELD_DATA_FORMAT_SPI_3WIRE>(spi3wire);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetSPI3Wire(bool *spi3wire) {
+	*spi3wire = _SPI3Wire();
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetIntActiveLow(bool intActiveLow) {
+	return SetFields<FIELD_DATA_FORMAT_INT_INVERT>(intActiveLow);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetIntActiveLow(bool *intActiveLow) {
+	*intActiveLow = _IntActiveLow();
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFullRes(bool fullRes) {
+	return SetFields<FIELD_DATA_FORMAT_FULL_RES>(fullRes);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetFullRes(bool *fullRes) {
+	*fullRes = _FullRes();
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetLeftJustify(bool leftJustify) {
+	return SetFields<FIELD_DATA_FORMAT_JUSTIFY_LEFT>(leftJustify);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetLeftJustify(bool *leftJustify) {
+	*leftJustify = _LeftJustify();
+}
+
+//	Expects VAL_RANGE_x as argument
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetRange(uint8_t range) {
+	return SetFields<FIELD_DATA_FORMAT_RANGE>(range);
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::GetRange(uint8_t *range) {
+	*range = _Range();
+}
+
+template <class Derived>
+void ADXL345_Core<Derived>::_RawFromBuffer(const uint8_t buffer[6], int16_t data[3]) {
+	RawFromBuffer(_dataFormat, buffer, data);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetDataRaw(int16_t data[3]) {
+	StatusType status;
+	uint8_t buffer[6];
+	status = _Derived()->_ReadFrom(REG_DATAX0, buffer, 6);
+	if (status) { return status; }
+	_RawFromBuffer(buffer, data);
+	return StatusType(0);
+}
+
+
+#if ADXL345_FEATURE_FLOAT
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetData(float data[3]) {
+	const float scale	= ScaleFromFormat(_dataFormat);
+	StatusType status;
+	int16_t raw[3];
+	status = GetDataRaw(raw);
+	if (status) { return status; }
+	for (uint8_t i=0; i<3; i++) {
+		data[i] = _gain[i] * raw[i] * scale;
+	}
+	return StatusType(0);
+}
+#endif
+
+#if ADXL345_FEATURE_FIFO
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoDataRaw(int16_t data[][3], uint8_t maxEntries, uint8_t *entries) {
+	StatusType status;
+	uint8_t available;
+	*entries = 0;
+	status = GetFifoEntries(&available);
+	if (status) { return status; }
+	if (available > maxEntries) { available = maxEntries; }
+	// Each entry has to be read with its own multi-byte transfer,
+	// the FIFO pops one sample per DATAX0..DATAZ1 read.
+	// The raw bytes are read into data and converted in place.
+	uint8_t *raw = reinterpret_cast<uint8_t*>(data);
+	status = _Derived()->_ReadFromRepeated(REG_DATAX0, raw, 6, available);
+	if (status) { return status; }
+	for (uint8_t i=0; i<available; i++) {
+		uint8_t buffer[6];
+		for (uint8_t j=0; j<6; j++) {
+			buffer[j] = raw[6*i+j];
+		}
+		_RawFromBuffer(buffer, data[i]);
+	}
+	*entries = available;
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoDataBlock(ADXL345_SampleBlock *block, uint8_t *entries) {
+	StatusType status;
+	uint8_t available;
+	uint8_t raw[6 * FIFO_MAX];
+	const uint16_t room = ADXL345_SampleBlock::CAPACITY - block->samples;
+	*entries = 0;
+	status = GetFifoEntries(&available);
+	if (status) { return status; }
+	// The field holds up to 63, more than the FIFO, the staging buffer must not trust it.
+	if (available > FIFO_MAX) { available = FIFO_MAX; }
+	if (available > room) { available = uint8_t(room); }
+	// The bus delivers the entries interleaved and the columns have no room to split
+	// them in place, so they are staged once and split in a single pass.
+	status = _Derived()->_ReadFromRepeated(REG_DATAX0, raw, 6, available);
+	if (status) { return status; }
+	const uint16_t at = block->samples;
+	ColumnsFromBuffer(_dataFormat, raw, available, block->axis[0] + at, block->axis[1] + at, block->axis[2] + at);
+	block->samples += available;
+	block->dataFormat = _dataFormat;
+	*entries = available;
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFifoCtl(uint8_t bitfield) {
+	return _Derived()->_WriteTo(REG_FIFO_CTL, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoCtl(uint8_t *bitfield) {
+	return _Derived()->_ReadFrom(REG_FIFO_CTL, bitfield);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFifoMode(uint8_t mode) {
+	return SetFields<FIELD_FIFO_CTL_MODE>(mode);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoMode(uint8_t *mode) {
+	return GetField<FIELD_FIFO_CTL_MODE>(mode);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFifoTriggerInt2(bool triggerInt2) {
+	return SetFields<FIELD_FIFO_CTL_TRIGGER_INT2>(triggerInt2);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoTriggerInt2(bool *triggerInt2) {
+	return GetField<FIELD_FIFO_CTL_TRIGGER_INT2>(triggerInt2);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFifoSamples(uint8_t samples) {
+	return SetFields<FIELD_FIFO_CTL_SAMPLES>(samples);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoSamples(uint8_t *samples) {
+	return GetField<FIELD_FIFO_CTL_SAMPLES>(samples);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoStatus(uint8_t *fifoStatus) {
+	return _Derived()->_ReadFrom(REG_FIFO_STATUS, fifoStatus);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoTrig(bool *fifoTrig) {
+	return GetField<FIELD_FIFO_STATUS_FIFO_TRIG>(fifoTrig);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetFifoEntries(uint8_t *entries) {
+	return GetField<FIELD_FIFO_STATUS_ENTRIES>(entries);
+}
+#endif
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::_UpdateRegister(uint8_t reg, uint8_t mask, uint8_t bits) {
+	StatusType status;
+	uint8_t value = 0x00;
+	if (reg == REG_DATA_FORMAT) {
+		return SetDataFormat((_dataFormat & ~mask) | bits);
+	}
+	// A write covering the whole register needs no read.
+	if (mask != 0xFF) {
+		status = _Derived()->_ReadFrom(reg, &value);
+		if (status) { return status; }
+	}
+	value = (value & ~mask) | bits;
+	return _Derived()->_WriteTo(reg, value);
+}
+
+template <class Derived>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::_ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+	StatusType status;
+	for (uint8_t i=0; i<count; i++) {
+		status = _Derived()->_ReadFrom(reg, data + i*n, n);
+		if (status) { return status; }
+	}
+	return StatusType(0);
+}
+
+template <class Derived>
+template <class... Assignments>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFields() {
+	typedef ADXL345_Merge<Assignments...> Merged;
+	return _UpdateRegister(Merged::reg, Merged::mask, Merged::bits);
+}
+
+template <class Derived>
+template <class... Fields>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::SetFields(typename ADXL345_FieldValue<Fields>::Type... values) {
+	typedef ADXL345_Merge<Fields...> Merged;
+	const uint8_t encoded[] = { Fields::Encode(values)... };
+	uint8_t bits = 0x00;
+	for (uint8_t i=0; i<sizeof...(Fields); i++) {
+		bits |= encoded[i];
+	}
+	return _UpdateRegister(Merged::reg, Merged::mask, bits);
+}
+
+template <class Derived>
+template <class Field>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetField(uint8_t *value) {
+	StatusType status = 0;
+	uint8_t regValue = _dataFormat;
+	if (uint8_t(Field::reg) != REG_DATA_FORMAT) {
+		status = _Derived()->_ReadFrom(Field::reg, &regValue);
+	}
+	*value = Field::Decode(regValue);
+	return status;
+}
+
+template <class Derived>
+template <class Field>
+ADXL345_Defs::StatusType ADXL345_Core<Derived>::GetField(bool *value) {
+	StatusType status;
+	uint8_t fieldValue;
+	status = GetField<Field>(&fieldValue);
+	*value = fieldValue;
+	return status;
+}
+
+#endif /* ADXL345_CORE_HPP_ */
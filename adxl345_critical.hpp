@@ -0,0 +1,55 @@
+/*
+adxl345_critical.hpp - Short critical sections shared by interrupt handlers and the main loop
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_CRITICAL_HPP_
+#define ADXL345_CRITICAL_HPP_
+
+#include "main.h"
+
+#ifdef ADXL345_NO_HAL
+#include <atomic>
+#endif
+
+// Masks interrupts for its lifetime and restores the previous mask, so it nests and
+// may be used in interrupt handlers. Keep the protected code to a few instructions.
+// Hosts without the STM32 HAL use one global spin lock instead, which protects against
+// other threads; it must not be taken again by the same thread.
+class ADXL345_CriticalSection {
+public:
+#ifndef ADXL345_NO_HAL
+	ADXL345_CriticalSection()
+	:	_primask (__get_PRIMASK())
+	{ __disable_irq(); }
+	~ADXL345_CriticalSection() { __set_PRIMASK(_primask); }
+private:
+	uint32_t _primask;
+#else
+	ADXL345_CriticalSection() { while (_Lock().test_and_set(std::memory_order_acquire)) {} }
+	~ADXL345_CriticalSection() { _Lock().clear(std::memory_order_release); }
+private:
+	static std::atomic_flag &_Lock() {
+		static std::atomic_flag lock = ATOMIC_FLAG_INIT;
+		return lock;
+	}
+#endif
+	ADXL345_CriticalSection(const ADXL345_CriticalSection&) = delete;
+	ADXL345_CriticalSection &operator=(const ADXL345_CriticalSection&) = delete;
+};
+
+#endif /* ADXL345_CRITICAL_HPP_ */
@@ -0,0 +1,368 @@
+/*
+adxl345_detect.cpp - Software event detection on drained ADXL345 samples
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_detect.hpp"
+#include "adxl345_stream.hpp"
+#include <math.h>
+#include <stdlib.h>
+
+// Bit k is set if sample k of s exceeds limit, n at most 32.
+// Written without branches, the state machines only look at the set bits.
+static uint32_t PeakMask(uint8_t axes, uint32_t limit, const int16_t s[][3], uint8_t n) {
+	const int32_t ex = axes & ADXL345_Detector::AXIS_X ? 1 : 0;
+	const int32_t ey = axes & ADXL345_Detector::AXIS_Y ? 1 : 0;
+	const int32_t ez = axes & ADXL345_Detector::AXIS_Z ? 1 : 0;
+	uint32_t mask = 0;
+	if (axes & ADXL345_Detector::AXIS_MAGNITUDE) {
+		for (uint8_t k=0; k<n; k++) {
+			const uint32_t m = uint32_t(ex * s[k][0] * s[k][0]) + uint32_t(ey * s[k][1] * s[k][1]) + uint32_t(ez * s[k][2] * s[k][2]);
+			mask |= uint32_t(m > limit) << k;
+		}
+	}
+	else {
+		for (uint8_t k=0; k<n; k++) {
+			const int32_t x = ex * abs(s[k][0]);
+			const int32_t y = ey * abs(s[k][1]);
+			const int32_t z = ez * abs(s[k][2]);
+			const int32_t m = x > y ? (x > z ? x : z) : (y > z ? y : z);
+			mask |= uint32_t(uint32_t(m) > limit) << k;
+		}
+	}
+	return mask;
+}
+
+// Same for the change from the previous sample, prev is the sample before s[0].
+static uint32_t JerkMask(uint8_t axes, uint32_t limit, const int16_t prev[3], const int16_t s[][3], uint8_t n) {
+	int16_t d[32][3];
+	for (uint8_t k=0; k<n; k++) {
+		const int16_t *p = k ? s[k-1] : prev;
+		for (uint8_t j=0; j<3; j++) {
+			// Saturate, the difference of two samples can exceed int16_t.
+			const int32_t v = int32_t(s[k][j]) - p[j];
+			d[k][j] = int16_t(v > INT16_MAX ? INT16_MAX : (v < -INT16_MAX ? -INT16_MAX : v));
+		}
+	}
+	return PeakMask(axes, limit, d, n);
+}
+
+static uint8_t FirstBit(uint32_t bits) {
+	uint8_t k = 0;
+	while (!(bits & 1)) {
+		bits >>= 1;
+		k++;
+	}
+	return k;
+}
+
+ADXL345_Detector::StatusType ADXL345_Detector::AddRule(const Rule &rule, uint8_t *id) {
+	if (_rules >= RULES_MAX || rule.type > RULE_RMS) {
+		return ADXL345_Defs::STATUS_NO_MEMORY;
+	}
+	if (rule.type == RULE_RMS && rule.samples > HISTORY_MAX) {
+		return ADXL345_Defs::STATUS_NO_MEMORY;
+	}
+	const uint8_t r = _rules;
+	_rule[r] = rule;
+	if (!_rule[r].samples) { _rule[r].samples = 1; }
+	const float t = rule.threshold > 0.0f ? rule.threshold : 0.0f;
+	const float limit = rule.axes & AXIS_MAGNITUDE ? t * t : t;
+	_limit[r] = limit < 4.0e9f ? uint32_t(limit) : UINT32_MAX;
+	_cosLimit[r] = cosf(t * float(M_PI) / 180.0f);
+	_ResetState(&_state[r]);
+	_state[r].haveRef = false;
+	*id = r;
+	_rules++;
+	return StatusType(0);
+}
+
+void ADXL345_Detector::Reset(uint32_t firstSample) {
+	_next = firstSample;
+	_havePrev = false;
+	_dropped = 0;
+	for (uint8_t r=0; r<RULES_MAX; r++) {
+		_ResetState(&_state[r]);
+		_state[r].haveRef = false;
+	}
+}
+
+void ADXL345_Detector::_ResetState(State *state) {
+	state->onset = 0;
+	state->run = 0;
+	state->fired = false;
+	state->level = 0.0f;
+	state->filled = 0;
+	for (uint8_t j=0; j<3; j++) {
+		state->sum[j] = 0;
+		state->sumSq[j] = 0;
+	}
+}
+
+const int16_t *ADXL345_Detector::_Sample(const int16_t seg[][3], uint32_t segFirst, const int16_t history[][3], uint32_t index) {
+	// Older samples come from the ring, the difference wraps like the index.
+	if (index - segFirst < 0x80000000UL) { return seg[index - segFirst]; }
+	return history[index % HISTORY_MAX];
+}
+
+float ADXL345_Detector::_Level(uint8_t axes, const int16_t s[3]) {
+	if (axes & AXIS_MAGNITUDE) {
+		float m = 0.0f;
+		for (uint8_t j=0; j<3; j++) {
+			if (axes & (1 << j)) { m += float(s[j]) * s[j]; }
+		}
+		return sqrtf(m);
+	}
+	int32_t m = 0;
+	for (uint8_t j=0; j<3; j++) {
+		if ((axes & (1 << j)) && abs(s[j]) > m) { m = abs(s[j]); }
+	}
+	return float(m);
+}
+
+void ADXL345_Detector::_Emit(uint8_t rule, uint32_t sample, float value) {
+	if (_outCount >= _outMax) {
+		_dropped++;
+		return;
+	}
+	Event &e = _out[_outCount++];
+	e.sample = sample;
+	e.rule = rule;
+	e.type = _rule[rule].type;
+	e.value = value;
+}
+
+void ADXL345_Detector::_Peak(uint8_t r, const int16_t seg[][3], uint8_t n) {
+	const Rule &rule = _rule[r];
+	State &st = _state[r];
+	for (uint16_t base=0; base<n; base+=32) {
+		const uint8_t m = n - base < 32 ? uint8_t(n - base) : 32;
+		const uint32_t over = PeakMask(rule.axes, _limit[r], seg + base, m);
+		if (!over && !st.run) { continue; }
+		uint8_t k = 0;
+		while (k < m) {
+			if (!st.run) {
+				const uint32_t bits = over >> k;
+				if (!bits) { break; }
+				k += FirstBit(bits);
+				st.onset = _next + base + k;
+				st.level = 0.0f;
+			}
+			else if (!((over >> k) & 1)) {
+				st.run = 0;
+				st.fired = false;
+				continue;
+			}
+			if (st.run < UINT16_MAX) { st.run++; }
+			const float level = _Level(rule.axes, seg[base+k]);
+			if (level > st.level) { st.level = level; }
+			if (!st.fired && st.run >= rule.samples) {
+				_Emit(r, st.onset, st.level);
+				st.fired = true;
+			}
+			k++;
+		}
+	}
+}
+
+void ADXL345_Detector::_Jerk(uint8_t r, const int16_t seg[][3], uint8_t n) {
+	const Rule &rule = _rule[r];
+	State &st = _state[r];
+	for (uint16_t base=0; base<n; base+=32) {
+		const uint8_t m = n - base < 32 ? uint8_t(n - base) : 32;
+		const int16_t *prev = base ? seg[base-1] : _prev;
+		uint32_t over = JerkMask(rule.axes, _limit[r], prev, seg + base, m);
+		// Without a previous sample the first one has no jerk.
+		if (!base && !_havePrev) { over &= ~uint32_t(1); }
+		uint8_t k = 0;
+		while (k < m) {
+			if (st.run) {
+				const uint8_t skip = st.run < m - k ? uint8_t(st.run) : m - k;
+				st.run -= skip;
+				k += skip;
+				continue;
+			}
+			const uint32_t bits = over >> k;
+			if (!bits) { break; }
+			k += FirstBit(bits);
+			const int16_t *p = base + k ? seg[base+k-1] : _prev;
+			int16_t d[3];
+			for (uint8_t j=0; j<3; j++) {
+				const int32_t v = int32_t(seg[base+k][j]) - p[j];
+				d[j] = int16_t(v > INT16_MAX ? INT16_MAX : (v < -INT16_MAX ? -INT16_MAX : v));
+			}
+			_Emit(r, _next + base + k, _Level(rule.axes, d));
+			st.run = rule.samples;
+			k++;
+		}
+	}
+}
+
+void ADXL345_Detector::_Tilt(uint8_t r, const int16_t seg[][3], uint8_t n) {
+	const Rule &rule = _rule[r];
+	State &st = _state[r];
+	for (uint8_t k=0; k<n; k++) {
+		const float x = seg[k][0];
+		const float y = seg[k][1];
+		const float z = seg[k][2];
+		const float n2 = x * x + y * y + z * z;
+		if (n2 == 0.0f) { continue; }
+		if (!st.haveRef) {
+			st.ref[0] = x;
+			st.ref[1] = y;
+			st.ref[2] = z;
+			st.haveRef = true;
+			continue;
+		}
+		const float r2 = st.ref[0] * st.ref[0] + st.ref[1] * st.ref[1] + st.ref[2] * st.ref[2];
+		float c = (x * st.ref[0] + y * st.ref[1] + z * st.ref[2]) / sqrtf(n2 * r2);
+		if (c >= _cosLimit[r]) {
+			st.run = 0;
+			continue;
+		}
+		if (!st.run) {
+			st.onset = _next + k;
+			st.level = 0.0f;
+		}
+		st.run++;
+		if (c < -1.0f) { c = -1.0f; }
+		const float angle = acosf(c) * 180.0f / float(M_PI);
+		if (angle > st.level) { st.level = angle; }
+		if (st.run >= rule.samples) {
+			// The new orientation is the reference for the next change.
+			_Emit(r, st.onset, st.level);
+			st.ref[0] = x;
+			st.ref[1] = y;
+			st.ref[2] = z;
+			st.run = 0;
+		}
+	}
+}
+
+void ADXL345_Detector::_Rms(uint8_t r, const int16_t seg[][3], uint8_t n) {
+	const Rule &rule = _rule[r];
+	State &st = _state[r];
+	const int64_t w = rule.samples;
+	const float limit = rule.threshold * rule.threshold * float(w * w);
+	for (uint8_t k=0; k<n; k++) {
+		const uint32_t index = _next + k;
+		for (uint8_t j=0; j<3; j++) {
+			st.sum[j] += seg[k][j];
+			st.sumSq[j] += int32_t(seg[k][j]) * seg[k][j];
+		}
+		if (st.filled == rule.samples) {
+			const int16_t *old = _Sample(seg, _next, _history, index - rule.samples);
+			for (uint8_t j=0; j<3; j++) {
+				st.sum[j] -= old[j];
+				st.sumSq[j] -= int32_t(old[j]) * old[j];
+			}
+		}
+		else if (++st.filled < rule.samples) {
+			continue;
+		}
+		// w^2 times the variance, exact in integers
+		int64_t energy = 0;
+		for (uint8_t j=0; j<3; j++) {
+			if (rule.axes & (1 << j)) { energy += w * st.sumSq[j] - int64_t(st.sum[j]) * st.sum[j]; }
+		}
+		if (float(energy) <= limit) {
+			st.fired = false;
+		}
+		else if (!st.fired) {
+			_Emit(r, index, sqrtf(float(energy)) / float(w));
+			st.fired = true;
+		}
+	}
+}
+
+void ADXL345_Detector::_Segment(const int16_t seg[][3], uint8_t n) {
+	for (uint8_t r=0; r<_rules; r++) {
+		switch (_rule[r].type) {
+		case RULE_PEAK: _Peak(r, seg, n); break;
+		case RULE_JERK: _Jerk(r, seg, n); break;
+		case RULE_TILT: _Tilt(r, seg, n); break;
+		case RULE_RMS: _Rms(r, seg, n); break;
+		}
+	}
+	for (uint8_t k=0; k<n; k++) {
+		int16_t *h = _history[(_next + k) % HISTORY_MAX];
+		h[0] = seg[k][0];
+		h[1] = seg[k][1];
+		h[2] = seg[k][2];
+	}
+	_prev[0] = seg[n-1][0];
+	_prev[1] = seg[n-1][1];
+	_prev[2] = seg[n-1][2];
+	_havePrev = true;
+	_next += n;
+}
+
+uint8_t ADXL345_Detector::Process(const int16_t data[][3], uint8_t frames, Event events[], uint8_t maxEvents) {
+	_out = events;
+	_outCount = 0;
+	_outMax = maxEvents;
+	uint8_t start = 0;
+	for (uint8_t i=0; i<frames; i++) {
+		uint32_t lost;
+		if (!ADXL345_StreamMonitor::IsGapFrame(data[i], &lost)) { continue; }
+		if (i > start) { _Segment(data + start, i - start); }
+		_Gap(lost);
+		start = i + 1;
+	}
+	if (frames > start) { _Segment(data + start, frames - start); }
+	return _Sort(events);
+}
+
+uint8_t ADXL345_Detector::Process(const ADXL345_SampleBlock &block, Event events[], uint8_t maxEvents) {
+	_out = events;
+	_outCount = 0;
+	_outMax = maxEvents;
+	if (block.gap) { _Gap(block.gap); }
+	// The rules work on frames, 32 at a time matches their bit masks.
+	for (uint16_t i=0; i<block.samples; i+=32) {
+		int16_t seg[32][3];
+		const uint8_t n = uint8_t(block.samples - i < 32 ? block.samples - i : 32);
+		for (uint8_t k=0; k<n; k++) {
+			seg[k][0] = block.axis[0][i+k];
+			seg[k][1] = block.axis[1][i+k];
+			seg[k][2] = block.axis[2][i+k];
+		}
+		_Segment(seg, n);
+	}
+	return _Sort(events);
+}
+
+void ADXL345_Detector::_Gap(uint32_t lost) {
+	_next += lost;
+	_havePrev = false;
+	for (uint8_t r=0; r<_rules; r++) {
+		_ResetState(&_state[r]);
+	}
+}
+
+uint8_t ADXL345_Detector::_Sort(Event events[]) {
+	// Rules report in turn, order the events of the block by sample.
+	for (uint8_t i=1; i<_outCount; i++) {
+		const Event e = events[i];
+		uint8_t j = i;
+		for (; j>0 && events[j-1].sample > e.sample; j--) {
+			events[j] = events[j-1];
+		}
+		events[j] = e;
+	}
+	return _outCount;
+}
@@ -0,0 +1,123 @@
+/*
+adxl345_detect.hpp - Software event detection on drained ADXL345 samples
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_DETECT_HPP_
+#define ADXL345_DETECT_HPP_
+
+#include "adxl345_core.hpp"
+
+// Evaluates several detection rules on the blocks drained from the FIFO, as a finer
+// grained replacement for the single thresholds of the tap, activity and free-fall units.
+// Thresholds are in raw LSB, 3.9 mg in full resolution mode instead of 62.5 mg.
+// State is carried across blocks, so a condition may start in one block and complete
+// in the next one. Events carry the stream index of the sample that triggered them,
+// counted like ADXL345_StreamMonitor::Block::firstSample from the last Reset().
+// Peak and jerk rules first build a bit mask of the samples above the threshold
+// for up to 32 samples at once, quiet stretches are skipped without running the state machine.
+class ADXL345_Detector {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		RULES_MAX		=	8,
+		HISTORY_MAX		=	256,		// longest RMS window in samples
+		RULE_PEAK		=	0x0,		// level above threshold for at least samples samples
+		RULE_JERK		=	0x1,		// change between two samples above threshold, then samples samples hold off
+		RULE_TILT		=	0x2,		// direction differs by more than threshold degrees for samples samples
+		RULE_RMS		=	0x3,		// AC RMS of the last samples samples above threshold
+		AXIS_X			=	0x1,
+		AXIS_Y			=	0x2,
+		AXIS_Z			=	0x4,
+		AXIS_ALL		=	0x7,
+		AXIS_MAGNITUDE	=	0x8,		// peak and jerk: vector length instead of the largest selected axis
+	};
+
+	struct Rule {
+		uint8_t type;			// RULE_x
+		uint8_t axes;			// AXIS_x, ignored by tilt rules
+		uint16_t samples;		// duration, hold off, debounce or window length
+		float threshold;		// LSB, LSB per sample, degrees or LSB RMS
+	};
+
+	struct Event {
+		uint32_t sample;		// peak and tilt: first sample of the condition, jerk and RMS: the sample completing it
+		uint8_t rule;			// id returned by AddRule()
+		uint8_t type;			// RULE_x
+		float value;			// level, jerk, angle in degrees or RMS when the condition completed
+	};
+
+	ADXL345_Detector()
+	:	_rules (0),
+		_dropped (0)
+	{ Reset(); }
+
+//	Returns STATUS_NO_MEMORY if all rules are taken or an RMS window exceeds HISTORY_MAX.
+	StatusType AddRule(const Rule &rule, uint8_t *id);
+	void ClearRules() { _rules = 0; }
+//	Restarts the stream index at firstSample and forgets all conditions in progress.
+	void Reset(uint32_t firstSample = 0);
+
+//	Evaluates a block of drained frames, gap marker frames of ADXL345_StreamMonitor
+//	advance the index and restart the conditions in progress.
+//	Returns the number of events written to events, sorted by sample.
+	uint8_t Process(const int16_t data[][3], uint8_t frames, Event events[], uint8_t maxEvents);
+//	Same for a block, its gap restarts the conditions in progress.
+	uint8_t Process(const ADXL345_SampleBlock &block, Event events[], uint8_t maxEvents);
+
+	uint32_t GetNextSample() { return _next; }
+//	Events that did not fit into events since the last Reset().
+	uint32_t GetDropped() { return _dropped; }
+private:
+	struct State {
+		uint32_t onset;
+		uint16_t run;			// consecutive samples over the threshold, or hold off left
+		bool fired;
+		float level;
+		float ref[3];			// tilt reference direction
+		bool haveRef;
+		uint16_t filled;		// RMS window fill
+		int32_t sum[3];
+		int64_t sumSq[3];
+	};
+	static const int16_t *_Sample(const int16_t seg[][3], uint32_t segFirst, const int16_t history[][3], uint32_t index);
+	static float _Level(uint8_t axes, const int16_t s[3]);
+	void _Emit(uint8_t rule, uint32_t sample, float value);
+	void _ResetState(State *state);
+	void _Segment(const int16_t seg[][3], uint8_t n);
+	void _Gap(uint32_t lost);
+	uint8_t _Sort(Event events[]);
+	void _Peak(uint8_t r, const int16_t seg[][3], uint8_t n);
+	void _Jerk(uint8_t r, const int16_t seg[][3], uint8_t n);
+	void _Tilt(uint8_t r, const int16_t seg[][3], uint8_t n);
+	void _Rms(uint8_t r, const int16_t seg[][3], uint8_t n);
+	Rule _rule[RULES_MAX];
+	State _state[RULES_MAX];
+	uint32_t _limit[RULES_MAX];		// integer threshold, squared for magnitudes
+	float _cosLimit[RULES_MAX];		// tilt threshold
+	uint8_t _rules;
+	uint32_t _next;
+	bool _havePrev;
+	int16_t _prev[3];
+	int16_t _history[HISTORY_MAX][3];	// ring of the last samples, by stream index
+	Event *_out;
+	uint8_t _outCount;
+	uint8_t _outMax;
+	uint32_t _dropped;
+};
+
+#endif /* ADXL345_DETECT_HPP_ */
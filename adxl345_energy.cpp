@@ -0,0 +1,177 @@
+/*
+adxl345_energy.cpp - ADXL345 energy accounting from register and bus activity
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_energy.hpp"
+
+// uC per mAh
+static const double UC_PER_MAH = 3.6e6;
+
+ADXL345_EnergyMeter::BusCost ADXL345_EnergyMeter::I2CCost(float volts, float pullupOhms, uint32_t clock) {
+	// SCL is low for half of every bit, SDA for the whole of half of the bits.
+	const float lowBits = 0.5f + 0.5f;
+	const float bitNc = lowBits * volts / pullupOhms / clock * 1e9f;
+	BusCost cost = { 30 * bitNc, 9 * bitNc };
+	return cost;
+}
+
+ADXL345_EnergyMeter::BusCost ADXL345_EnergyMeter::SPICost(float volts, float capacitancePf) {
+	const float bitNc = 1.5f * capacitancePf * volts * 1e-3f;
+	// Command byte plus both chip select edges.
+	BusCost cost = { 8 * bitNc + 2 * capacitancePf * volts * 1e-3f, 8 * bitNc };
+	return cost;
+}
+
+void ADXL345_EnergyMeter::Reset(uint32_t now) {
+	_last = now;
+	_bwRate = ADXL345_Defs::VAL_BW_50_Hz;
+	_powerCtl = 0;
+	_asleep = false;
+	for (uint8_t i=0; i<STATE_COUNT; i++) {
+		_stateUc[i] = 0.0;
+		_stateUs[i] = 0.0;
+	}
+	for (uint8_t i=0; i<FEATURE_COUNT; i++) {
+		_featureUc[i] = 0.0;
+		_transfers[i] = 0;
+		_bytes[i] = 0;
+	}
+}
+
+uint8_t ADXL345_EnergyMeter::_FeatureOf(uint8_t reg) {
+	switch (reg) {
+	case ADXL345_Defs::REG_DATAX0:
+	case ADXL345_Defs::REG_DATAX1:
+	case ADXL345_Defs::REG_DATAY0:
+	case ADXL345_Defs::REG_DATAY1:
+	case ADXL345_Defs::REG_DATAZ0:
+	case ADXL345_Defs::REG_DATAZ1:
+		return FEATURE_SAMPLES;
+	case ADXL345_Defs::REG_FIFO_CTL:
+	case ADXL345_Defs::REG_FIFO_STATUS:
+		return FEATURE_FIFO;
+	case ADXL345_Defs::REG_THRESH_TAP:
+	case ADXL345_Defs::REG_DUR:
+	case ADXL345_Defs::REG_LATENT:
+	case ADXL345_Defs::REG_WINDOW:
+	case ADXL345_Defs::REG_THRESH_ACT:
+	case ADXL345_Defs::REG_THRESH_INACT:
+	case ADXL345_Defs::REG_TIME_INACT:
+	case ADXL345_Defs::REG_ACT_INACT_CTL:
+	case ADXL345_Defs::REG_THRESH_FF:
+	case ADXL345_Defs::REG_TIME_FF:
+	case ADXL345_Defs::REG_TAP_AXES:
+	case ADXL345_Defs::REG_ACT_TAP_STATUS:
+	case ADXL345_Defs::REG_INT_ENABLE:
+	case ADXL345_Defs::REG_INT_MAP:
+	case ADXL345_Defs::REG_INT_SOURCE:
+		return FEATURE_EVENTS;
+	default:
+		return FEATURE_CONFIG;
+	}
+}
+
+uint8_t ADXL345_EnergyMeter::GetState() {
+	if (!ADXL345_Defs::FIELD_POWER_CTL_MEASURE::Decode(_powerCtl)) { return STATE_STANDBY; }
+	if (ADXL345_Defs::FIELD_POWER_CTL_SLEEP::Decode(_powerCtl) || _asleep) { return STATE_SLEEP; }
+	if (ADXL345_Defs::FIELD_BW_RATE_LOW_POWER::Decode(_bwRate)) { return STATE_LOW_POWER; }
+	return STATE_MEASURE;
+}
+
+float ADXL345_EnergyMeter::GetCurrent() {
+	switch (GetState()) {
+	case STATE_STANDBY:
+		return float(STANDBY_NA) * 1e-3f;
+	case STATE_SLEEP:
+		// WAKEUP 0 to 3 is 8, 4, 2 and 1 Hz, charged as 12.5, 6.25, 3.13 and 1.56 Hz.
+		return ADXL345_Defs::SupplyCurrent(0x7 - ADXL345_Defs::FIELD_POWER_CTL_WAKEUP::Decode(_powerCtl), false);
+	case STATE_LOW_POWER:
+		return ADXL345_Defs::SupplyCurrent(_bwRate, true);
+	default:
+		return ADXL345_Defs::SupplyCurrent(_bwRate, false);
+	}
+}
+
+void ADXL345_EnergyMeter::Update(uint32_t now) {
+	const uint32_t elapsed = now - _last;
+	const uint8_t state = GetState();
+	_stateUs[state] += elapsed;
+	_stateUc[state] += double(GetCurrent()) * elapsed * 1e-6;
+	_last = now;
+}
+
+void ADXL345_EnergyMeter::Transfer(uint8_t reg, bool write, const uint8_t data[], uint8_t n, uint32_t now) {
+	// The state changes when the transfer completes.
+	Update(now);
+	const uint8_t feature = _FeatureOf(reg);
+	_transfers[feature]++;
+	_bytes[feature] += n;
+	_featureUc[feature] += (_cost.transactionNc + n * _cost.byteNc) * 1e-3;
+	if (!data) { return; }
+	for (uint8_t i=0; i<n; i++) {
+		const uint8_t r = reg + i;
+		if (write) {
+			if (r == ADXL345_Defs::REG_BW_RATE) { _bwRate = data[i]; }
+			else if (r == ADXL345_Defs::REG_POWER_CTL) {
+				_powerCtl = data[i];
+				// Leaving measurement or auto sleep wakes the part.
+				if (!ADXL345_Defs::FIELD_POWER_CTL_AUTO_SLEEP::Decode(_powerCtl) || !ADXL345_Defs::FIELD_POWER_CTL_MEASURE::Decode(_powerCtl)) {
+					_asleep = false;
+				}
+			}
+		}
+		else if (ADXL345_Defs::FIELD_POWER_CTL_AUTO_SLEEP::Decode(_powerCtl)) {
+			if (r == ADXL345_Defs::REG_ACT_TAP_STATUS) {
+				_asleep = ADXL345_Defs::FIELD_ACT_TAP_STATUS_ASLEEP::Decode(data[i]);
+			}
+			else if (r == ADXL345_Defs::REG_INT_SOURCE) {
+				if ((data[i] >> ADXL345_Defs::BIT_INT_ACTIVITY) & 1) { _asleep = false; }
+				else if ((data[i] >> ADXL345_Defs::BIT_INT_INACTIVITY) & 1) { _asleep = true; }
+			}
+		}
+	}
+}
+
+uint32_t ADXL345_EnergyMeter::Account(const ADXL345_BusRecord records[], uint32_t count) {
+	Reset(0);
+	for (uint32_t i=0; i<count; i++) {
+		const ADXL345_BusRecord &r = records[i];
+		const uint8_t n = r.n > ADXL345_Defs::BUFFER_MAX ? uint8_t(ADXL345_Defs::BUFFER_MAX) : r.n;
+		Transfer(r.reg, r.flags & ADXL345_BusRecord::FLAG_WRITE, r.status ? nullptr : r.data, n, r.timestamp);
+	}
+	return _last;
+}
+
+void ADXL345_EnergyMeter::GetReport(Report *report) {
+	double sensor = 0.0;
+	double bus = 0.0;
+	for (uint8_t i=0; i<STATE_COUNT; i++) {
+		sensor += _stateUc[i];
+		report->stateMAh[i] = float(_stateUc[i] / UC_PER_MAH);
+		report->stateSeconds[i] = float(_stateUs[i] * 1e-6);
+	}
+	for (uint8_t i=0; i<FEATURE_COUNT; i++) {
+		bus += _featureUc[i];
+		report->featureMAh[i] = float(_featureUc[i] / UC_PER_MAH);
+		report->transfers[i] = _transfers[i];
+		report->bytes[i] = _bytes[i];
+	}
+	report->sensorMAh = float(sensor / UC_PER_MAH);
+	report->busMAh = float(bus / UC_PER_MAH);
+	report->totalMAh = float((sensor + bus) / UC_PER_MAH);
+}
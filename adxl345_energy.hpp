@@ -0,0 +1,140 @@
+/*
+adxl345_energy.hpp - ADXL345 energy accounting from register and bus activity
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_ENERGY_HPP_
+#define ADXL345_ENERGY_HPP_
+
+#include "adxl345_replay.hpp"
+
+// Estimates the charge drawn by one ADXL345 from the transfers on its bus.
+// Writes to BW_RATE and POWER_CTL give the power state; the sensor current of each state,
+// ADXL345_Defs::SupplyCurrent() while measuring, is integrated over the time spent in it.
+// With AUTO_SLEEP set, reads of INT_SOURCE and ACT_TAP_STATUS tell when the part fell
+// asleep or woke up. In sleep the part samples at the WAKEUP rate, which is charged as the
+// next output data rate above it. Every transfer adds the bus charge of its bytes,
+// attributed to the feature the register belongs to.
+// The meter can run on the target through ADXL345_EnergyBus, or on the host over a
+// recording of ADXL345_RecordingBus, e.g. to compare the battery life of firmware builds in CI.
+// Times are in us of one free-running clock. Call Update() at least every 71 minutes
+// so the differences do not wrap.
+class ADXL345_EnergyMeter {
+public:
+	enum {
+		STATE_STANDBY	=	0x0,
+		STATE_MEASURE	=	0x1,
+		STATE_LOW_POWER	=	0x2,		// measuring with BW_RATE LOW_POWER set
+		STATE_SLEEP		=	0x3,
+		STATE_COUNT		=	0x4,
+
+		FEATURE_SAMPLES	=	0x0,		// DATAX0 to DATAZ1, single samples and FIFO drains
+		FEATURE_FIFO	=	0x1,		// FIFO_CTL and FIFO_STATUS
+		FEATURE_EVENTS	=	0x2,		// tap, activity and free-fall setup, interrupt control and sources
+		FEATURE_CONFIG	=	0x3,		// everything else
+		FEATURE_COUNT	=	0x4,
+
+		STANDBY_NA		=	100,		// typical standby current in nA
+	};
+
+	// Bus charge in nC, drawn from the supply of the bus for each transfer.
+	struct BusCost {
+		float transactionNc;		// addressing and framing of one transfer
+		float byteNc;				// one data byte
+	};
+
+	struct Report {
+		float totalMAh;
+		float sensorMAh;
+		float busMAh;
+		float stateMAh[STATE_COUNT];
+		float stateSeconds[STATE_COUNT];
+		float featureMAh[FEATURE_COUNT];
+		uint32_t transfers[FEATURE_COUNT];
+		uint32_t bytes[FEATURE_COUNT];
+	};
+
+//	Charge through the I2C pull-ups: SCL is low for half of every bit time and SDA for the
+//	whole bit time of half of the bits, one bit time of one low line per bit on average.
+//	Each line draws volts / pullupOhms while low. A read has 30 bits of framing
+//	(start, two addresses, register, stop) and 9 bits per byte.
+	static BusCost I2CCost(float volts, float pullupOhms, uint32_t clock);
+//	Charge of the SPI lines switching capacitancePf: SCLK charges once per bit, the data
+//	line for half of the bits. The command byte and chip select are the framing.
+	static BusCost SPICost(float volts, float capacitancePf);
+
+	ADXL345_EnergyMeter(const BusCost &cost, uint32_t now = 0)
+	:	_cost (cost)
+	{ Reset(now); }
+
+//	Starts a new account with the register reset values, standby at 100 Hz.
+	void Reset(uint32_t now);
+//	Accounts a transfer of n bytes starting at reg that completed at time now.
+//	data is nullptr for a failed transfer, which costs bus charge but changes no state.
+	void Transfer(uint8_t reg, bool write, const uint8_t data[], uint8_t n, uint32_t now);
+//	Integrates the current state up to now.
+	void Update(uint32_t now);
+//	Accounts a recording of ADXL345_RecordingBus at its timestamps, following Reset(0).
+//	Returns the time of the last record.
+	uint32_t Account(const ADXL345_BusRecord records[], uint32_t count);
+
+	uint8_t GetState();
+//	Present sensor current in uA.
+	float GetCurrent();
+	void GetReport(Report *report);
+private:
+	static uint8_t _FeatureOf(uint8_t reg);
+	BusCost _cost;
+	uint32_t _last;
+	uint8_t _bwRate;
+	uint8_t _powerCtl;
+	bool _asleep;				// the part entered sleep by itself, AUTO_SLEEP
+	double _stateUc[STATE_COUNT];
+	double _stateUs[STATE_COUNT];
+	double _featureUc[FEATURE_COUNT];
+	uint32_t _transfers[FEATURE_COUNT];
+	uint32_t _bytes[FEATURE_COUNT];
+};
+
+// Transport policy feeding every transfer of Bus into an ADXL345_EnergyMeter.
+// Clock returns the current time in us.
+template <class Bus>
+class ADXL345_EnergyBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	typedef uint32_t (*Clock)();
+	ADXL345_EnergyBus(const Bus &bus, ADXL345_EnergyMeter *meter, Clock clock)
+	:	_bus (bus),
+		_meter (meter),
+		_clock (clock)
+	{}
+	StatusType WriteTo(uint8_t reg, uint8_t val)						{ return _Account(reg, true, &val, 1, _bus.WriteTo(reg, val)); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _Account(reg, true, data, n, _bus.WriteTo(reg, data, n)); }
+	StatusType ReadFrom(uint8_t reg, uint8_t *val)						{ return _Account(reg, false, val, 1, _bus.ReadFrom(reg, val)); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)			{ return _Account(reg, false, data, n, _bus.ReadFrom(reg, data, n)); }
+	Bus *GetBus() { return &_bus; }
+private:
+	StatusType _Account(uint8_t reg, bool write, const uint8_t data[], uint8_t n, StatusType status) {
+		_meter->Transfer(reg, write, status ? nullptr : data, n, _clock());
+		return status;
+	}
+	Bus _bus;
+	ADXL345_EnergyMeter *_meter;
+	Clock _clock;
+};
+
+#endif /* ADXL345_ENERGY_HPP_ */
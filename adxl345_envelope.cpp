@@ -0,0 +1,286 @@
+/*
+adxl345_envelope.cpp - Envelope spectrum of one ADXL345 axis for bearing and gear faults
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_envelope.hpp"
+#include "adxl345_stream.hpp"
+#include <math.h>
+
+static const float PI = 3.14159265f;
+
+ADXL345_Envelope::ADXL345_Envelope()
+:	_setup (),
+	_odr (0.0f),
+	_faults (0),
+	_bandPass (),
+	_lowPass ()
+{
+	const int half = HILBERT_TAPS / 2;
+	_setup.decimation = 1;
+	_windowPower = 0.0f;
+	for (int k=0; k<FFT_SIZE; k++) {
+		const float w = 0.5f - 0.5f * cosf(2 * PI * k / float(FFT_SIZE));
+		_window[k] = int16_t(lrintf(w * 32767));
+		_windowPower += w * w;
+	}
+	for (int k=0; k<FFT_SIZE/2; k++) {
+		_cos[k] = int32_t(lrintf(cosf(2 * PI * k / float(FFT_SIZE)) * 1073741824.0f));
+		_sin[k] = int32_t(lrintf(sinf(2 * PI * k / float(FFT_SIZE)) * 1073741824.0f));
+	}
+	// Ideal Hilbert transformer 2 / (pi m) at odd m, Hamming window.
+	_hilbert[0] = 0;
+	for (int k=1; 2*k-1<=half; k++) {
+		const int m = 2*k - 1;
+		const float w = 0.54f + 0.46f * cosf(PI * m / half);
+		_hilbert[k] = int32_t(lrintf(2 / (PI * m) * w * 32768));
+	}
+	Reset();
+}
+
+void ADXL345_Envelope::_Design(Biquad *biquad, float b0, float b1, float b2, float a0, float a1, float a2) {
+	const float q28 = 268435456.0f;
+	biquad->b[0] = int32_t(lrintf(b0 / a0 * q28));
+	biquad->b[1] = int32_t(lrintf(b1 / a0 * q28));
+	biquad->b[2] = int32_t(lrintf(b2 / a0 * q28));
+	biquad->a[0] = int32_t(lrintf(a1 / a0 * q28));
+	biquad->a[1] = int32_t(lrintf(a2 / a0 * q28));
+}
+
+ADXL345_Envelope::StatusType ADXL345_Envelope::Configure(const Setup &setup) {
+	const float odr = ADXL345_Defs::OdrFromRate(setup.rate);
+	if (setup.axis > AXIS_Z || setup.detector > DETECTOR_HILBERT) { return StatusType(HAL_ERROR); }
+	if (!setup.decimation || setup.decimation > DECIMATION_MAX) { return StatusType(HAL_ERROR); }
+	if (!(setup.bandwidthHz > 0.0f) || setup.centerHz - setup.bandwidthHz / 2 <= 0.0f || setup.centerHz + setup.bandwidthHz / 2 >= odr / 2) {
+		return StatusType(HAL_ERROR);
+	}
+	const float envelopeRate = odr / setup.decimation;
+	const float cutoff = setup.cutoffHz > 0.0f ? setup.cutoffHz : envelopeRate / 4;
+	if (cutoff >= envelopeRate / 2) { return StatusType(HAL_ERROR); }
+	_setup = setup;
+	_setup.cutoffHz = cutoff;
+	_odr = odr;
+	// Band-pass with 0 dB peak gain and an exact -3 dB width, then Butterworth low-pass as two sections.
+	float w0 = 2 * PI * setup.centerHz / odr;
+	float alpha = tanf(PI * setup.bandwidthHz / odr);
+	for (uint8_t i=0; i<2; i++) {
+		_Design(&_bandPass[i], alpha, 0.0f, -alpha, 1 + alpha, -2 * cosf(w0), 1 - alpha);
+	}
+	const float butterworthQ[2] = { 0.54119610f, 1.30656296f };
+	w0 = 2 * PI * cutoff / odr;
+	for (uint8_t i=0; i<2; i++) {
+		alpha = sinf(w0) / (2 * butterworthQ[i]);
+		const float c = 1 - cosf(w0);
+		_Design(&_lowPass[i], c / 2, c, c / 2, 1 + alpha, -2 * cosf(w0), 1 - alpha);
+	}
+	// About five time constants of each filter.
+	_settleSamples = uint32_t(odr * (4 / setup.bandwidthHz + 1 / cutoff)) + HILBERT_TAPS;
+	Reset();
+	return StatusType(0);
+}
+
+ADXL345_Envelope::StatusType ADXL345_Envelope::AddFault(const Fault &fault, uint8_t *id) {
+	if (_faults >= FAULTS_MAX) { return StatusType(ADXL345_Defs::STATUS_NO_MEMORY); }
+	if (!fault.harmonics || fault.harmonics > HARMONICS_MAX) { return StatusType(HAL_ERROR); }
+	_fault[_faults] = fault;
+	if (id) { *id = _faults; }
+	_faults++;
+	return StatusType(0);
+}
+
+void ADXL345_Envelope::Reset(uint32_t firstSample) {
+	_next = firstSample;
+	_ready = false;
+	_Restart();
+}
+
+void ADXL345_Envelope::_Restart() {
+	for (uint8_t i=0; i<2; i++) {
+		_bandPass[i].x[0] = _bandPass[i].x[1] = _bandPass[i].y[0] = _bandPass[i].y[1] = 0;
+		_lowPass[i].x[0] = _lowPass[i].x[1] = _lowPass[i].y[0] = _lowPass[i].y[1] = 0;
+	}
+	for (uint8_t i=0; i<HILBERT_TAPS; i++) {
+		_delay[i] = 0;
+	}
+	_delayPos = 0;
+	_fill = 0;
+	_phase = 0;
+	_settle = _settleSamples;
+}
+
+int32_t ADXL345_Envelope::_Filter(Biquad *f, int32_t x) {
+	int64_t acc = int64_t(f->b[0]) * x + int64_t(f->b[1]) * f->x[0] + int64_t(f->b[2]) * f->x[1]
+				- int64_t(f->a[0]) * f->y[0] - int64_t(f->a[1]) * f->y[1];
+	const int32_t y = int32_t((acc + (int64_t(1) << 27)) >> 28);
+	f->x[1] = f->x[0];
+	f->x[0] = x;
+	f->y[1] = f->y[0];
+	f->y[0] = y;
+	return y;
+}
+
+uint32_t ADXL345_Envelope::_Sqrt(uint64_t v) {
+	uint64_t root = 0;
+	uint64_t bit = uint64_t(1) << 62;
+	while (bit > v) { bit >>= 2; }
+	while (bit) {
+		if (v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return uint32_t(root);
+}
+
+int32_t ADXL345_Envelope::_Detect(int32_t y) {
+	if (_setup.detector == DETECTOR_RECTIFY) {
+		return y < 0 ? -y : y;
+	}
+	const uint8_t half = HILBERT_TAPS / 2;
+	_delay[_delayPos] = y;
+	// The input j samples ago, the real part is delayed to the center tap.
+	auto delayed = [this](uint8_t j) { return _delay[(_delayPos + HILBERT_TAPS - j) % HILBERT_TAPS]; };
+	int64_t q = 0;
+	for (uint8_t k=1; 2*k-1<=half; k++) {
+		const uint8_t m = 2*k - 1;
+		q += int64_t(_hilbert[k]) * (delayed(half + m) - delayed(half - m));
+	}
+	const int64_t i = delayed(half);
+	_delayPos = (_delayPos + 1) % HILBERT_TAPS;
+	q >>= 15;
+	return int32_t(_Sqrt(uint64_t(i * i + q * q)));
+}
+
+bool ADXL345_Envelope::_Sample(int16_t v) {
+	// Q8 keeps the rounding of the narrow filters below one LSB.
+	const int32_t y = _Filter(&_bandPass[1], _Filter(&_bandPass[0], int32_t(v) * 256));
+	const int32_t e = _Filter(&_lowPass[1], _Filter(&_lowPass[0], _Detect(y)));
+	_next++;
+	if (_settle) {
+		_settle--;
+		return false;
+	}
+	if (++_phase < _setup.decimation) { return false; }
+	_phase = 0;
+	if (!_fill) { _windowFirst = _next - 1; }
+	_re[_fill++] = e;
+	if (_fill < FFT_SIZE) { return false; }
+	_Spectrum();
+	_fill = 0;
+	return true;
+}
+
+uint32_t ADXL345_Envelope::Process(const int16_t data[][3], uint32_t frames) {
+	uint32_t i = 0;
+	_ready = false;
+	while (i < frames && !_ready) {
+		const int16_t *frame = data[i++];
+		uint32_t lost;
+		if (ADXL345_StreamMonitor::IsGapFrame(frame, &lost)) {
+			_next += lost;
+			_Restart();
+			continue;
+		}
+		_ready = _Sample(frame[_setup.axis]);
+	}
+	return i;
+}
+
+uint16_t ADXL345_Envelope::Process(const ADXL345_SampleBlock &block, uint16_t offset) {
+	const int16_t *column = block.axis[_setup.axis];
+	uint16_t i = offset;
+	_ready = false;
+	if (!offset && block.firstSample != _next) {
+		_next = block.firstSample;
+		_Restart();
+	}
+	while (i < block.samples && !_ready) {
+		_ready = _Sample(column[i++]);
+	}
+	return uint16_t(i - offset);
+}
+
+void ADXL345_Envelope::_Spectrum() {
+	int64_t sum = 0;
+	for (uint16_t k=0; k<FFT_SIZE; k++) {
+		sum += _re[k];
+	}
+	const int32_t mean = int32_t(sum / FFT_SIZE);
+	// Q8 to Q4, so the growth of 8 radix-2 stages stays within 32 bit.
+	for (uint16_t k=0; k<FFT_SIZE; k++) {
+		_re[k] = int32_t((int64_t(_re[k] - mean) * _window[k]) >> (15 + 4));
+		_im[k] = 0;
+	}
+	for (uint16_t k=1, j=0; k<FFT_SIZE; k++) {
+		uint16_t bit = FFT_SIZE >> 1;
+		for (; j & bit; bit >>= 1) { j ^= bit; }
+		j ^= bit;
+		if (k < j) {
+			const int32_t t = _re[k];
+			_re[k] = _re[j];
+			_re[j] = t;
+		}
+	}
+	for (uint16_t len=2; len<=FFT_SIZE; len<<=1) {
+		const uint16_t step = FFT_SIZE / len;
+		for (uint16_t i=0; i<FFT_SIZE; i+=len) {
+			for (uint16_t j=0; j<len/2; j++) {
+				const int64_t c = _cos[j * step];
+				const int64_t s = _sin[j * step];
+				const uint16_t a = i + j;
+				const uint16_t b = a + len/2;
+				// Multiplication by exp(-2 pi i j / len)
+				const int32_t tr = int32_t((_re[b] * c + _im[b] * s) >> 30);
+				const int32_t ti = int32_t((_im[b] * c - _re[b] * s) >> 30);
+				_re[b] = _re[a] - tr;
+				_im[b] = _im[a] - ti;
+				_re[a] += tr;
+				_im[a] += ti;
+			}
+		}
+	}
+	// One-sided mean square per bin, undoing the window and Q4.
+	const float scale = 2 / (float(FFT_SIZE) * _windowPower * 256);
+	float total = 0.0f;
+	for (uint16_t k=0; k<BINS; k++) {
+		const int64_t p = int64_t(_re[k]) * _re[k] + int64_t(_im[k]) * _im[k];
+		_result.power[k] = float(p) * (k == 0 || k == FFT_SIZE/2 ? scale / 2 : scale);
+		if (k) { total += _result.power[k]; }
+	}
+	_result.firstSample = _windowFirst;
+	_result.binHz = GetEnvelopeRate() / float(FFT_SIZE);
+	_result.rms = sqrtf(total);
+	_result.faults = _faults;
+	for (uint8_t f=0; f<_faults; f++) {
+		float power = 0.0f;
+		for (uint8_t h=1; h<=_fault[f].harmonics; h++) {
+			const float hz = h * _fault[f].order * _setup.shaftHz;
+			if (!(hz > 0.0f)) { continue; }
+			// The Hann main lobe spans one bin to each side, the tolerance widens it.
+			const long center = lrintf(hz / _result.binHz);
+			const long width = 1 + long(hz * _setup.tolerance / _result.binHz);
+			for (long k=center-width; k<=center+width; k++) {
+				if (k >= 1 && k < BINS) { power += _result.power[k]; }
+			}
+		}
+		_result.faultPower[f] = power;
+	}
+}
@@ -0,0 +1,156 @@
+/*
+adxl345_envelope.hpp - Envelope spectrum of one ADXL345 axis for bearing and gear faults
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_ENVELOPE_HPP_
+#define ADXL345_ENVELOPE_HPP_
+
+#include "adxl345_core.hpp"
+
+// Envelope analysis of one axis of the drained sample stream, block by block.
+// Impacts of a damaged bearing or gear excite a structural resonance; the envelope
+// of that resonance repeats at the fault frequency, e.g. BPFO = order * shaft speed.
+//	band-pass	two second-order sections around centerHz
+//	detector	full-wave rectifier, or the magnitude of the analytic signal from a
+//				31 tap FIR Hilbert transformer, usable between ODR/20 and 9 ODR/20
+//	low-pass	fourth-order Butterworth at cutoffHz, then every decimation-th sample is kept
+//	spectrum	FFT_SIZE envelope samples, mean removed, Hann window
+// and per fault the power at its harmonics, within a tolerance for slip and speed error.
+// The per-sample path and the FFT run on integers only, 64 bit products on 32 bit
+// values, so they need no FPU. float is used in Configure() and once per window to
+// scale the spectrum.
+// Envelope values are in LSB of the input; the rectifier yields 2/pi of the amplitude
+// the Hilbert magnitude yields.
+// An instance takes about 4.5 KB, tables and the window buffer included.
+class ADXL345_Envelope {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		FFT_SIZE		=	256,
+		BINS			=	FFT_SIZE / 2 + 1,
+		FAULTS_MAX		=	8,
+		HARMONICS_MAX	=	8,
+		DECIMATION_MAX	=	64,
+		HILBERT_TAPS	=	31,
+
+		AXIS_X			=	0x0,
+		AXIS_Y			=	0x1,
+		AXIS_Z			=	0x2,
+
+		DETECTOR_RECTIFY	=	0x0,
+		DETECTOR_HILBERT	=	0x1,
+	};
+
+	struct Setup {
+		uint8_t rate;			// VAL_BW_x of the samples
+		uint8_t axis;			// AXIS_x
+		uint8_t detector;		// DETECTOR_x
+		uint8_t decimation;		// input samples per envelope sample, 1 to DECIMATION_MAX
+		float centerHz;			// resonance the band-pass is centered on
+		float bandwidthHz;		// -3 dB width of each band-pass section
+		float cutoffHz;			// envelope low-pass, 0 selects a quarter of the envelope rate
+		float shaftHz;			// shaft speed the fault orders refer to
+		float tolerance;		// relative width of a fault line, e.g. 0.02 for 2 % slip
+	};
+
+	// A fault frequency as a multiple of the shaft speed, e.g. BPFO or BPFI.
+	struct Fault {
+		float order;
+		uint8_t harmonics;		// 1 to HARMONICS_MAX lines at order, 2 order, ...
+	};
+
+	struct Result {
+		uint32_t firstSample;			// stream index of the first input sample of the window
+		float binHz;
+		float rms;						// AC RMS of the envelope, LSB
+		float power[BINS];				// mean square of the envelope per bin, LSB^2
+		float faultPower[FAULTS_MAX];	// summed over the lines of each fault, by id
+		uint8_t faults;
+	};
+
+	ADXL345_Envelope();
+
+//	Returns HAL_ERROR if the band, the cutoff or the decimation do not fit the output data rate.
+//	Keeps the faults, restarts the stream index at 0.
+	StatusType Configure(const Setup &setup);
+//	Returns STATUS_NO_MEMORY if FAULTS_MAX faults are set, HAL_ERROR for 0 or too many harmonics.
+	StatusType AddFault(const Fault &fault, uint8_t *id);
+	void ClearFaults() { _faults = 0; }
+//	Changes the speed the fault orders refer to, from the next window on.
+	void SetShaftHz(float shaftHz) { _setup.shaftHz = shaftHz; }
+//	Restarts the stream index at firstSample and discards the window in progress.
+	void Reset(uint32_t firstSample = 0);
+
+//	Feeds drained frames and returns how many were consumed. Processing stops after
+//	the frame that completes a window; IsReady() is then true until the next call.
+//	Gap marker frames of ADXL345_StreamMonitor advance the index and restart the window.
+//	for (uint32_t k=0; k<frames; ) {
+//		k += envelope.Process(data + k, frames - k);
+//		if (envelope.IsReady()) { Send(envelope.GetResult()); }
+//	}
+	uint32_t Process(const int16_t data[][3], uint32_t frames);
+//	Same for the samples of block from offset on. A block that does not continue the
+//	stream index, after lost samples or a Reset() to another index, restarts the window.
+	uint16_t Process(const ADXL345_SampleBlock &block, uint16_t offset = 0);
+	bool IsReady() { return _ready; }
+	const Result &GetResult() { return _result; }
+
+	uint32_t GetNextSample() { return _next; }
+	float GetEnvelopeRate() { return _odr / _setup.decimation; }
+private:
+	// Direct form I, coefficients in Q28, values in Q8 of an LSB.
+	struct Biquad {
+		int32_t b[3];
+		int32_t a[2];
+		int32_t x[2];
+		int32_t y[2];
+	};
+	static void _Design(Biquad *biquad, float b0, float b1, float b2, float a0, float a1, float a2);
+	static int32_t _Filter(Biquad *biquad, int32_t x);
+	static uint32_t _Sqrt(uint64_t v);
+	void _Restart();
+	int32_t _Detect(int32_t y);
+//	Returns true if v completed a window.
+	bool _Sample(int16_t v);
+	void _Spectrum();
+	Setup _setup;
+	float _odr;
+	Fault _fault[FAULTS_MAX];
+	uint8_t _faults;
+	Biquad _bandPass[2];
+	Biquad _lowPass[2];
+	int32_t _hilbert[(HILBERT_TAPS + 1) / 4 + 1];	// Q15, odd taps only, index k for tap 2k-1
+	int32_t _delay[HILBERT_TAPS];			// band-pass output ring
+	uint8_t _delayPos;
+	int16_t _window[FFT_SIZE];				// Hann, Q15
+	int32_t _cos[FFT_SIZE / 2];				// twiddles, Q30
+	int32_t _sin[FFT_SIZE / 2];
+	float _windowPower;						// sum of the squared window
+	int32_t _re[FFT_SIZE];					// envelope of the window in progress, then the FFT
+	int32_t _im[FFT_SIZE];
+	uint16_t _fill;
+	uint8_t _phase;							// input samples since the last kept one
+	uint32_t _settle;						// input samples left before the filters are settled
+	uint32_t _settleSamples;
+	uint32_t _next;
+	uint32_t _windowFirst;
+	bool _ready;
+	Result _result;
+};
+
+#endif /* ADXL345_ENVELOPE_HPP_ */
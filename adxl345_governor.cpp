@@ -0,0 +1,92 @@
+/*
+adxl345_governor.cpp - ADXL345 activity driven rate and power mode governor
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_governor.hpp"
+#include "adxl345_stream.hpp"
+
+bool ADXL345_Governor::Evaluate(uint8_t intSource, const int16_t data[][3], uint8_t samples) {
+	// AC energy of the block: sum of the per-axis variances.
+	// Gap marker frames of ADXL345_StreamMonitor carry no sample and are skipped.
+	float sum[3] = {0.0f, 0.0f, 0.0f};
+	float sumSq[3] = {0.0f, 0.0f, 0.0f};
+	uint8_t frames = 0;
+	for (uint8_t i=0; i<samples; i++) {
+		uint32_t lost;
+		if (ADXL345_StreamMonitor::IsGapFrame(data[i], &lost)) { continue; }
+		for (uint8_t j=0; j<3; j++) {
+			const float v = data[i][j];
+			sum[j] += v;
+			sumSq[j] += v * v;
+		}
+		frames++;
+	}
+	if (frames) {
+		_lastEnergy = 0.0f;
+		for (uint8_t j=0; j<3; j++) {
+			const float mean = sum[j] / frames;
+			_lastEnergy += sumSq[j] / frames - mean * mean;
+		}
+	}
+	return _Decide(intSource, frames);
+}
+
+bool ADXL345_Governor::Evaluate(uint8_t intSource, const ADXL345_SampleBlock &block) {
+	// Same energy, one column after the other.
+	if (block.samples) {
+		_lastEnergy = 0.0f;
+		for (uint8_t j=0; j<3; j++) {
+			const int16_t *column = block.axis[j];
+			float sum = 0.0f;
+			float sumSq = 0.0f;
+			for (uint16_t i=0; i<block.samples; i++) {
+				const float v = column[i];
+				sum += v;
+				sumSq += v * v;
+			}
+			const float mean = sum / block.samples;
+			_lastEnergy += sumSq / block.samples - mean * mean;
+		}
+	}
+	return _Decide(intSource, block.samples);
+}
+
+bool ADXL345_Governor::_Decide(uint8_t intSource, bool samples) {
+	if ((intSource >> ADXL345_Defs::BIT_INT_ACTIVITY) & 1) {
+		_target = PROFILE_ACTIVE;
+		_quietBlocks = 0;
+	}
+	else if ((intSource >> ADXL345_Defs::BIT_INT_INACTIVITY) & 1) {
+		_target = PROFILE_IDLE;
+	}
+	else if (samples) {
+		if (_lastEnergy > _upRms2) {
+			_target = PROFILE_ACTIVE;
+			_quietBlocks = 0;
+		}
+		else if (_lastEnergy < _downRms2) {
+			if (_quietBlocks < _holdBlocks) { _quietBlocks++; }
+			if (_quietBlocks >= _holdBlocks) { _target = PROFILE_IDLE; }
+		}
+		else {
+			// Between the thresholds the current profile is kept.
+			_quietBlocks = 0;
+		}
+	}
+	return _target != _current;
+}
@@ -0,0 +1,181 @@
+/*
+adxl345_governor.hpp - ADXL345 activity driven rate and power mode governor
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_GOVERNOR_HPP_
+#define ADXL345_GOVERNOR_HPP_
+
+#include "adxl345_core.hpp"
+#include "adxl345_stream.hpp"
+
+// Switches between an active and an idle rate/power profile.
+// Evaluate() is fed with the INT_SOURCE value and every drained sample block, either
+// interleaved frames, whose gap marker frames are skipped, or an ADXL345_SampleBlock.
+// The activity interrupt or a block RMS above the upper threshold selects the active profile.
+// The inactivity interrupt or holdBlocks consecutive blocks below the lower threshold
+// select the idle profile. Apply() then performs the switch.
+class ADXL345_Governor {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		PROFILE_IDLE	=	0x0,
+		PROFILE_ACTIVE	=	0x1,
+	};
+
+	struct Profile {
+		uint8_t rate;			// VAL_BW_x
+		bool lowPower;
+		uint8_t fifoSamples;	// FIFO watermark, 0 to 31
+	};
+
+//	Thresholds are the AC RMS of a block over all axes in LSB, upRms should be above downRms.
+	ADXL345_Governor(const Profile &idle, const Profile &active, float upRms, float downRms, uint16_t holdBlocks)
+	:	_upRms2 (upRms * upRms),
+		_downRms2 (downRms * downRms),
+		_holdBlocks (holdBlocks),
+		_quietBlocks (0),
+		_current (PROFILE_IDLE),
+		_target (PROFILE_IDLE),
+		_lastEnergy (0.0f),
+		_switches (0)
+	{
+		_profiles[PROFILE_IDLE] = idle;
+		_profiles[PROFILE_ACTIVE] = active;
+	}
+
+//	Returns true if the profile should be switched by calling Apply().
+	bool Evaluate(uint8_t intSource, const int16_t data[][3], uint8_t samples);
+	bool Evaluate(uint8_t intSource, const ADXL345_SampleBlock &block);
+
+//	Drains the samples that were taken with the old profile into flushed,
+//	then changes BW_RATE and the FIFO watermark. The FIFO is passed through bypass mode
+//	so no block mixes samples of both rates, which drops the samples that arrived while
+//	flushed was read. Their number is read from FIFO_STATUS right before the switch and
+//	returned in dropped; one more sample goes uncounted if it arrives between that read
+//	and the bypass write. At 3200 Hz and 400 kHz I2C a full flush takes about 7 ms, so
+//	about 20 samples are dropped. maxFlushed should be at least ADXL345_Defs::FIFO_MAX.
+	template <class Derived>
+	StatusType Apply(ADXL345_Core<Derived> *dev, int16_t flushed[][3], uint8_t maxFlushed, uint8_t *flushedSamples, uint8_t *dropped = nullptr);
+//	Same with the flush drained and accounted by monitor as in ADXL345_StreamMonitor::Drain(),
+//	then monitor continues at the new rate with the dropped samples as the gap of its next block.
+	template <class Derived>
+	StatusType Apply(ADXL345_Core<Derived> *dev, ADXL345_StreamMonitor *monitor, int16_t flushed[][3], uint8_t maxFlushed, uint32_t now, ADXL345_StreamMonitor::Block *block);
+//	Writes a profile unconditionally, e.g. during setup.
+	template <class Derived>
+	StatusType Force(ADXL345_Core<Derived> *dev, uint8_t profile);
+
+	uint8_t GetProfile() { return _current; }
+	const Profile &GetProfileSettings(uint8_t profile) { return _profiles[profile & 1]; }
+	float GetLastRms() { return sqrtf(_lastEnergy); }
+	uint32_t GetSwitches() { return _switches; }
+//	Estimated supply current of the active profile in uA.
+	uint8_t GetSupplyCurrent() {
+		return ADXL345_Defs::SupplyCurrent(_profiles[_current].rate, _profiles[_current].lowPower);
+	}
+private:
+	template <class Derived>
+	StatusType _Switch(ADXL345_Core<Derived> *dev, uint8_t fifoCtl, uint8_t *dropped);
+//	Updates the target profile from the interrupt source and, if samples were seen, _lastEnergy.
+	bool _Decide(uint8_t intSource, bool samples);
+	template <class Derived>
+	StatusType _Write(ADXL345_Core<Derived> *dev, uint8_t fifoCtl, uint8_t profile);
+	Profile _profiles[2];
+	float _upRms2;
+	float _downRms2;
+	uint16_t _holdBlocks;
+	uint16_t _quietBlocks;
+	uint8_t _current;
+	uint8_t _target;
+	float _lastEnergy;		// squared RMS of the last block
+	uint32_t _switches;
+};
+
+template <class Derived>
+ADXL345_Governor::StatusType ADXL345_Governor::_Write(ADXL345_Core<Derived> *dev, uint8_t fifoCtl, uint8_t profile) {
+	typedef ADXL345_Defs D;
+	const Profile &p = _profiles[profile];
+	StatusType status;
+	// Bypass empties the FIFO, so the next block starts with the new rate.
+	const uint8_t bypass = (fifoCtl & ~D::FIELD_FIFO_CTL_MODE::mask) | D::FIELD_FIFO_CTL_MODE::Encode(D::VAL_FIFO_MODE_BYPASS);
+	status = dev->SetFifoCtl(bypass);
+	if (status) { return status; }
+	status = dev->SetBwRate(D::FIELD_BW_RATE_RATE::Encode(p.rate) | D::FIELD_BW_RATE_LOW_POWER::Encode(p.lowPower));
+	if (status) { return status; }
+	status = dev->SetFifoCtl((fifoCtl & ~D::FIELD_FIFO_CTL_SAMPLES::mask) | D::FIELD_FIFO_CTL_SAMPLES::Encode(p.fifoSamples));
+	if (status) { return status; }
+	_current = profile;
+	_target = profile;
+	_quietBlocks = 0;
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_Governor::StatusType ADXL345_Governor::_Switch(ADXL345_Core<Derived> *dev, uint8_t fifoCtl, uint8_t *dropped) {
+	StatusType status;
+	// Entries left now are discarded by the bypass write that follows right away.
+	status = dev->GetFifoEntries(dropped);
+	if (status) { return status; }
+	status = _Write(dev, fifoCtl, _target);
+	if (!status) { _switches++; }
+	return status;
+}
+
+template <class Derived>
+ADXL345_Governor::StatusType ADXL345_Governor::Apply(ADXL345_Core<Derived> *dev, int16_t flushed[][3], uint8_t maxFlushed, uint8_t *flushedSamples, uint8_t *dropped) {
+	StatusType status;
+	uint8_t fifoCtl;
+	uint8_t left = 0;
+	*flushedSamples = 0;
+	if (dropped) { *dropped = 0; }
+	if (_target == _current) { return StatusType(0); }
+	status = dev->GetFifoCtl(&fifoCtl);
+	if (status) { return status; }
+	status = dev->GetFifoDataRaw(flushed, maxFlushed, flushedSamples);
+	if (status) { return status; }
+	status = _Switch(dev, fifoCtl, &left);
+	if (dropped) { *dropped = left; }
+	return status;
+}
+
+template <class Derived>
+ADXL345_Governor::StatusType ADXL345_Governor::Apply(ADXL345_Core<Derived> *dev, ADXL345_StreamMonitor *monitor, int16_t flushed[][3], uint8_t maxFlushed, uint32_t now, ADXL345_StreamMonitor::Block *block) {
+	StatusType status;
+	uint8_t fifoCtl;
+	uint8_t left = 0;
+	block->samples = block->frames = 0;
+	if (_target == _current) { return StatusType(0); }
+	status = dev->GetFifoCtl(&fifoCtl);
+	if (status) { return status; }
+	status = monitor->Drain(dev, flushed, maxFlushed, now, block);
+	if (status) { return status; }
+	status = _Switch(dev, fifoCtl, &left);
+	if (status) { return status; }
+	monitor->ChangeRate(_profiles[_current].rate, left);
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_Governor::StatusType ADXL345_Governor::Force(ADXL345_Core<Derived> *dev, uint8_t profile) {
+	StatusType status;
+	uint8_t fifoCtl;
+	status = dev->GetFifoCtl(&fifoCtl);
+	if (status) { return status; }
+	return _Write(dev, fifoCtl, profile & 1);
+}
+
+#endif /* ADXL345_GOVERNOR_HPP_ */
@@ -0,0 +1,114 @@
+/*
+adxl345_latency.cpp - ADXL345 sample age and drain latency instrumentation
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_latency.hpp"
+
+void ADXL345_Histogram::Reset() {
+	for (uint16_t i=0; i<BUCKETS; i++) {
+		_counts[i] = 0;
+	}
+	_count = 0;
+	_max = 0;
+}
+
+uint8_t ADXL345_Histogram::_Bucket(uint32_t us) {
+	if (us < (2U << SUB_BITS)) { return uint8_t(us); }
+	uint8_t e = 0;
+	for (uint32_t v=us; v>1; v>>=1) { e++; }
+	return uint8_t(((e - SUB_BITS + 1) << SUB_BITS) + ((us >> (e - SUB_BITS)) & ((1U << SUB_BITS) - 1)));
+}
+
+uint32_t ADXL345_Histogram::_Lower(uint8_t bucket) {
+	if (bucket < (2U << SUB_BITS)) { return bucket; }
+	const uint8_t e = (bucket >> SUB_BITS) + SUB_BITS - 1;
+	const uint32_t sub = bucket & ((1U << SUB_BITS) - 1);
+	return ((1UL << SUB_BITS) + sub) << (e - SUB_BITS);
+}
+
+void ADXL345_Histogram::Add(uint32_t us) {
+	_counts[_Bucket(us)]++;
+	_count++;
+	if (us > _max) { _max = us; }
+}
+
+uint32_t ADXL345_Histogram::GetPercentile(float p) {
+	if (!_count) { return 0; }
+	uint32_t target = uint32_t(p * _count);
+	if (target < 1) { target = 1; }
+	uint32_t seen = 0;
+	for (uint16_t i=0; i<BUCKETS; i++) {
+		seen += _counts[i];
+		if (seen < target) { continue; }
+		const uint32_t lower = _Lower(uint8_t(i));
+		const uint32_t width = i < (2U << SUB_BITS) ? 1 : 1UL << ((i >> SUB_BITS) - 1);
+		const uint32_t middle = lower + width / 2;
+		return middle < _max ? middle : _max;
+	}
+	return _max;
+}
+
+void ADXL345_LatencyMonitor::Reset() {
+	{
+		ADXL345_CriticalSection cs;
+		_pending = false;
+	}
+	_age.Reset();
+	_interruptToDrain.Reset();
+	_drainToConsume.Reset();
+}
+
+void ADXL345_LatencyMonitor::Drained(const ADXL345_StreamMonitor::Block &block, Tag *tag) {
+	bool pending;
+	uint32_t interrupt;
+	tag->drain = block.timestamp;
+	tag->interrupt = block.timestamp;
+	{
+		ADXL345_CriticalSection cs;
+		pending = _pending;
+		interrupt = _interrupt;
+		// An interrupt newer than the drain would wrap the latency to about 2^32 us.
+		if (pending && int32_t(block.timestamp - interrupt) >= 0) {
+			_pending = false;
+		}
+		else {
+			pending = false;
+		}
+	}
+	if (pending) {
+		tag->interrupt = interrupt;
+		_interruptToDrain.Add(tag->drain - tag->interrupt);
+	}
+	tag->acquired = ADXL345_StreamMonitor::FirstSampleTime(block.timestamp, block.samples, _periodNs);
+	tag->periodNs = _periodNs;
+	tag->samples = block.samples;
+}
+
+void ADXL345_LatencyMonitor::Consumed(const Tag &tag, uint32_t now) {
+	_drainToConsume.Add(now - tag.drain);
+	for (uint8_t i=0; i<tag.samples; i++) {
+		_age.Add(now - AcquiredAt(tag, i));
+	}
+}
+
+void ADXL345_LatencyMonitor::_Stats(ADXL345_Histogram *h, Stats *stats) {
+	stats->count = h->GetCount();
+	stats->p50 = h->GetPercentile(0.50f);
+	stats->p99 = h->GetPercentile(0.99f);
+	stats->max = h->GetMax();
+}
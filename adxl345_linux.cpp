@@ -0,0 +1,142 @@
+/*
+adxl345_linux.cpp - ADXL345 transports for Linux i2c-dev and spidev
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include "adxl345_linux.hpp"
+
+int ADXL345_LinuxSys::Ioctl(int fd, unsigned long request, void *arg) {
+	return ioctl(fd, request, arg);
+}
+
+ADXL345_LinuxSys *ADXL345_LinuxSys::GetDefault() {
+	static ADXL345_LinuxSys sys;
+	return &sys;
+}
+
+/************************** I2C ***************************/
+
+ADXL345_LinuxI2CBus::StatusType ADXL345_LinuxI2CBus::_Transfer(struct i2c_msg msgs[], uint32_t n) {
+	struct i2c_rdwr_ioctl_data rdwr;
+	rdwr.msgs = msgs;
+	rdwr.nmsgs = n;
+	_ioctls++;
+	if (_sys->Ioctl(_fd, I2C_RDWR, &rdwr) < 0) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	return StatusType(0);
+}
+
+ADXL345_LinuxI2CBus::StatusType ADXL345_LinuxI2CBus::WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+	uint8_t dataWithReg[ADXL345_Defs::BUFFER_MAX+1];
+	dataWithReg[0] = reg;
+	for (uint8_t i=0; i<n; i++) {
+		dataWithReg[i+1] = data[i];
+	}
+	struct i2c_msg msg;
+	msg.addr = _devAddr;
+	msg.flags = 0;
+	msg.len = n + 1;
+	msg.buf = dataWithReg;
+	return _Transfer(&msg, 1);
+}
+
+ADXL345_LinuxI2CBus::StatusType ADXL345_LinuxI2CBus::ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+	StatusType status;
+	struct i2c_msg msgs[2*BATCH_MAX];
+	for (uint8_t done=0; done<count; ) {
+		uint8_t batch = count - done;
+		if (batch > BATCH_MAX) { batch = BATCH_MAX; }
+		// Every read addresses reg again, the address pointer auto-increments.
+		for (uint8_t i=0; i<batch; i++) {
+			msgs[2*i].addr = _devAddr;
+			msgs[2*i].flags = 0;
+			msgs[2*i].len = 1;
+			msgs[2*i].buf = &reg;
+			msgs[2*i+1].addr = _devAddr;
+			msgs[2*i+1].flags = I2C_M_RD;
+			msgs[2*i+1].len = n;
+			msgs[2*i+1].buf = data + (done+i)*n;
+		}
+		status = _Transfer(msgs, 2*batch);
+		if (status) { return status; }
+		done += batch;
+	}
+	return StatusType(0);
+}
+
+/************************** SPI ***************************/
+
+ADXL345_LinuxSPIBus::StatusType ADXL345_LinuxSPIBus::_Ioctl(unsigned long request, void *arg) {
+	_ioctls++;
+	if (_sys->Ioctl(_fd, request, arg) < 0) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	return StatusType(0);
+}
+
+ADXL345_LinuxSPIBus::StatusType ADXL345_LinuxSPIBus::Setup(uint32_t speedHz) {
+	StatusType status;
+	uint8_t mode = SPI_MODE_3;
+	uint8_t bits = 8;
+	status = _Ioctl(SPI_IOC_WR_MODE, &mode);
+	if (status) { return status; }
+	status = _Ioctl(SPI_IOC_WR_BITS_PER_WORD, &bits);
+	if (status) { return status; }
+	return _Ioctl(SPI_IOC_WR_MAX_SPEED_HZ, &speedHz);
+}
+
+ADXL345_LinuxSPIBus::StatusType ADXL345_LinuxSPIBus::WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+	uint8_t dataWithReg[ADXL345_Defs::BUFFER_MAX+1];
+	dataWithReg[0] = reg;
+	for (uint8_t i=0; i<n; i++) {
+		dataWithReg[i+1] = data[i];
+	}
+	const bool read	=	false;
+	const bool mb	=	n > 1;	// multibyte
+	dataWithReg[0] |= (read << 7) | (mb << 6);
+	struct spi_ioc_transfer xfer;
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.tx_buf = uintptr_t(dataWithReg);
+	xfer.len = n + 1;
+	return _Ioctl(SPI_IOC_MESSAGE(1), &xfer);
+}
+
+ADXL345_LinuxSPIBus::StatusType ADXL345_LinuxSPIBus::ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+	StatusType status;
+	struct spi_ioc_transfer xfers[2*BATCH_MAX];
+	const bool read	=	true;
+	const bool mb	=	n > 1;	// multibyte
+	reg |= (read << 7) | (mb << 6);
+	for (uint8_t done=0; done<count; ) {
+		uint8_t batch = count - done;
+		if (batch > BATCH_MAX) { batch = BATCH_MAX; }
+		memset(xfers, 0, 2*batch*sizeof(xfers[0]));
+		// Command byte and data of one read share CS, which is released between the reads.
+		// The kernel keeps CS high for at least 10us, longer than the 5us the FIFO needs to pop.
+		for (uint8_t i=0; i<batch; i++) {
+			xfers[2*i].tx_buf = uintptr_t(&reg);
+			xfers[2*i].len = 1;
+			xfers[2*i+1].rx_buf = uintptr_t(data + (done+i)*n);
+			xfers[2*i+1].len = n;
+			xfers[2*i+1].cs_change = i+1 < batch;
+		}
+		// SPI_IOC_MESSAGE() with a count only known at run time
+		status = _Ioctl(_IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(2*batch)), xfers);
+		if (status) { return status; }
+		done += batch;
+	}
+	return StatusType(0);
+}
@@ -0,0 +1,242 @@
+/*
+adxl345_linux.hpp - ADXL345 transports for Linux i2c-dev and spidev
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Build on Linux with -Itools/host -DADXL345_NO_HAL.
+
+#ifndef ADXL345_LINUX_HPP_
+#define ADXL345_LINUX_HPP_
+
+#include <errno.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/spi/spidev.h>
+#include "adxl345.hpp"
+
+// System calls used by the Linux transports.
+// GetDefault() calls ioctl(2), tests pass an ADXL345_LinuxEmulatedSys instead.
+class ADXL345_LinuxSys {
+public:
+	virtual ~ADXL345_LinuxSys() {}
+	virtual int Ioctl(int fd, unsigned long request, void *arg);
+	static ADXL345_LinuxSys *GetDefault();
+};
+
+// Transport policy for an open /dev/i2c-N.
+// A register read is one I2C_RDWR ioctl, the register write and the data read
+// are joined by a repeated start. ReadFromRepeated() queues BATCH_MAX reads per ioctl.
+class ADXL345_LinuxI2CBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		/***************** DEVICE PROPERTIES ******************/
+		DEVICE_I2C_ADDR_SDO_LOW		=	0x53,	// 7-bit I2C address with SDO pulled low
+		DEVICE_I2C_ADDR_SDO_HIGH	=	0x1D,	// 7-bit I2C address with SDO pulled high
+
+		BATCH_MAX					=	I2C_RDWR_IOCTL_MAX_MSGS / 2,
+	};
+	ADXL345_LinuxI2CBus(int fd, uint8_t sdoState = ADXL345_Defs::PIN_STATE_LOW, ADXL345_LinuxSys *sys = ADXL345_LinuxSys::GetDefault())
+	:	_fd (fd),
+		_devAddr (sdoState == ADXL345_Defs::PIN_STATE_LOW ? DEVICE_I2C_ADDR_SDO_LOW : DEVICE_I2C_ADDR_SDO_HIGH),
+		_sys (sys),
+		_ioctls (0)
+	{}
+	StatusType WriteTo(uint8_t reg, uint8_t val) { return WriteTo(reg, &val, 1); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n);
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) { return ReadFrom(reg, val, 1); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) { return ReadFromRepeated(reg, data, n, 1); }
+	StatusType ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count);
+	uint32_t GetIoctls() { return _ioctls; }
+private:
+	StatusType _Transfer(struct i2c_msg msgs[], uint32_t n);
+	int _fd;
+	uint8_t _devAddr;
+	ADXL345_LinuxSys *_sys;
+	uint32_t _ioctls;
+};
+
+// Transport policy for an open /dev/spidevB.C.
+// Every register access is one SPI_IOC_MESSAGE, ReadFromRepeated() puts a whole FIFO
+// drain into one message and toggles CS between the entries so the FIFO pops.
+class ADXL345_LinuxSPIBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		BATCH_MAX		=	ADXL345_Defs::FIFO_MAX,
+		SPEED_MAX_HZ	=	5000000,
+	};
+	ADXL345_LinuxSPIBus(int fd, ADXL345_LinuxSys *sys = ADXL345_LinuxSys::GetDefault())
+	:	_fd (fd),
+		_sys (sys),
+		_ioctls (0)
+	{}
+//	Sets SPI mode 3, 8 bit words and the clock, call once after opening the device.
+	StatusType Setup(uint32_t speedHz = SPEED_MAX_HZ);
+	StatusType WriteTo(uint8_t reg, uint8_t val) { return WriteTo(reg, &val, 1); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n);
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) { return ReadFrom(reg, val, 1); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) { return ReadFromRepeated(reg, data, n, 1); }
+	StatusType ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count);
+	uint32_t GetIoctls() { return _ioctls; }
+private:
+	StatusType _Ioctl(unsigned long request, void *arg);
+	int _fd;
+	ADXL345_LinuxSys *_sys;
+	uint32_t _ioctls;
+};
+
+// Batched FIFO drains for ADXL345T<ADXL345_LinuxI2CBus> and ADXL345T<ADXL345_LinuxSPIBus>.
+inline ADXL345_Defs::StatusType ADXL345_ReadFromRepeated(ADXL345_LinuxI2CBus &bus, uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+	return bus.ReadFromRepeated(reg, data, n, count);
+}
+
+inline ADXL345_Defs::StatusType ADXL345_ReadFromRepeated(ADXL345_LinuxSPIBus &bus, uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+	return bus.ReadFromRepeated(reg, data, n, count);
+}
+
+
+// Virtual adapters around the Linux transport policies.
+class ADXL345_LinuxI2C : public ADXL345 {
+public:
+	ADXL345_LinuxI2C(int fd, uint8_t sdoState = PIN_STATE_LOW, ADXL345_LinuxSys *sys = ADXL345_LinuxSys::GetDefault())
+	:	ADXL345(),
+		_bus (fd, sdoState, sys)
+	{}
+	ADXL345_LinuxI2CBus *GetBus() { return &_bus; }
+private:
+	virtual StatusType _WriteTo(uint8_t reg, uint8_t val)						{ return _bus.WriteTo(reg, val); }
+	virtual StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _bus.WriteTo(reg, data, n); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t *val)						{ return _bus.ReadFrom(reg, val); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)		{ return _bus.ReadFrom(reg, data, n); }
+	virtual StatusType _ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+		return _bus.ReadFromRepeated(reg, data, n, count);
+	}
+	ADXL345_LinuxI2CBus _bus;
+};
+
+class ADXL345_LinuxSPI : public ADXL345 {
+public:
+	ADXL345_LinuxSPI(int fd, ADXL345_LinuxSys *sys = ADXL345_LinuxSys::GetDefault())
+	:	ADXL345(),
+		_bus (fd, sys)
+	{}
+	ADXL345_LinuxSPIBus *GetBus() { return &_bus; }
+private:
+	virtual StatusType _WriteTo(uint8_t reg, uint8_t val)						{ return _bus.WriteTo(reg, val); }
+	virtual StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _bus.WriteTo(reg, data, n); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t *val)						{ return _bus.ReadFrom(reg, val); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)		{ return _bus.ReadFrom(reg, data, n); }
+	virtual StatusType _ReadFromRepeated(uint8_t reg, uint8_t data[], uint8_t n, uint8_t count) {
+		return _bus.ReadFromRepeated(reg, data, n, count);
+	}
+	ADXL345_LinuxSPIBus _bus;
+};
+
+
+// Serves the I2C_RDWR and SPI_IOC_MESSAGE ioctls of the Linux transports from a
+// transport policy, e.g. ADXL345_ReplayBus, so they can run without hardware.
+// Failed transfers return -1 with errno set to EIO.
+template <class Bus>
+class ADXL345_LinuxEmulatedSys : public ADXL345_LinuxSys {
+public:
+	explicit ADXL345_LinuxEmulatedSys(Bus *bus)
+	:	_bus (bus)
+	{}
+	virtual int Ioctl(int fd, unsigned long request, void *arg);
+private:
+	int _I2C(struct i2c_rdwr_ioctl_data *rdwr);
+	int _SPI(struct spi_ioc_transfer *xfers, uint32_t n);
+	Bus *_bus;
+};
+
+template <class Bus>
+int ADXL345_LinuxEmulatedSys<Bus>::Ioctl(int fd, unsigned long request, void *arg) {
+	(void)fd;
+	if (request == I2C_RDWR) {
+		return _I2C(static_cast<struct i2c_rdwr_ioctl_data*>(arg));
+	}
+	if (_IOC_TYPE(request) == SPI_IOC_MAGIC && _IOC_NR(request) == 0 && _IOC_DIR(request) == _IOC_WRITE) {
+		return _SPI(static_cast<struct spi_ioc_transfer*>(arg), _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer));
+	}
+	// Mode and speed settings
+	if (_IOC_TYPE(request) == SPI_IOC_MAGIC) { return 0; }
+	errno = ENOTTY;
+	return -1;
+}
+
+template <class Bus>
+int ADXL345_LinuxEmulatedSys<Bus>::_I2C(struct i2c_rdwr_ioctl_data *rdwr) {
+	for (uint32_t i=0; i<rdwr->nmsgs; i++) {
+		const struct i2c_msg *msg = &rdwr->msgs[i];
+		const struct i2c_msg *next = i+1 < rdwr->nmsgs ? &rdwr->msgs[i+1] : nullptr;
+		ADXL345_Defs::StatusType status;
+		if (msg->flags & I2C_M_RD || msg->len < 1) { errno = EIO; return -1; }
+		if (msg->len == 1 && next && next->flags & I2C_M_RD) {
+			status = _bus->ReadFrom(msg->buf[0], next->buf, uint8_t(next->len));
+			i++;
+		}
+		else {
+			status = _bus->WriteTo(msg->buf[0], msg->buf + 1, uint8_t(msg->len - 1));
+		}
+		if (status) { errno = EIO; return -1; }
+	}
+	return int(rdwr->nmsgs);
+}
+
+template <class Bus>
+int ADXL345_LinuxEmulatedSys<Bus>::_SPI(struct spi_ioc_transfer *xfers, uint32_t n) {
+	int bytes = 0;
+	// Transfers between CS toggles form one register access.
+	uint8_t access[1+ADXL345_Defs::FIFO_MAX*ADXL345_Defs::BUFFER_MAX];
+	uint32_t length = 0;
+	for (uint32_t i=0; i<n; i++) {
+		const struct spi_ioc_transfer *xfer = &xfers[i];
+		const uint8_t *tx = reinterpret_cast<const uint8_t*>(uintptr_t(xfer->tx_buf));
+		uint8_t *rx = reinterpret_cast<uint8_t*>(uintptr_t(xfer->rx_buf));
+		bytes += xfer->len;
+		if (length + xfer->len > sizeof(access)) { errno = EIO; return -1; }
+		// The command byte leads the access, rx of the data bytes is filled once it is complete.
+		for (uint32_t j=0; j<xfer->len; j++) {
+			access[length+j] = tx ? tx[j] : 0x00;
+		}
+		const uint32_t start = length;
+		length += xfer->len;
+		if (!xfer->cs_change && i+1 < n) {
+			if (rx) { errno = EIO; return -1; }	// reads have to end the access
+			continue;
+		}
+		const uint8_t reg = access[0] & 0x3F;
+		const bool read = access[0] & 0x80;
+		ADXL345_Defs::StatusType status;
+		if (read) {
+			uint8_t data[ADXL345_Defs::FIFO_MAX*ADXL345_Defs::BUFFER_MAX];
+			status = _bus->ReadFrom(reg, data, uint8_t(length - 1));
+			for (uint32_t j=start; j<length; j++) {
+				if (rx && j > 0) { rx[j-start] = data[j-1]; }
+			}
+		}
+		else {
+			status = _bus->WriteTo(reg, access + 1, uint8_t(length - 1));
+		}
+		if (status) { errno = EIO; return -1; }
+		length = 0;
+	}
+	return bytes;
+}
+
+#endif /* ADXL345_LINUX_HPP_ */
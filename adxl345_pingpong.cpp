@@ -0,0 +1,194 @@
+/*
+adxl345_pingpong.cpp - Continuous ADXL345 FIFO streaming into two alternating buffers
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_pingpong.hpp"
+
+using namespace std;
+
+ADXL345_PingPong::ADXL345_PingPong(ADXL345_AsyncTransport *transport, int16_t ping[][3], int16_t pong[][3], uint16_t samples)
+:	_transport (transport),
+	_samples (samples),
+	_dataFormat (0),
+	_watermark (0),
+	_running (false),
+	_busy (false),
+	_pending (false),
+	_step (STEP_BEGIN),
+	_phase (PHASE_STARTING),
+	_status (0),
+	_consume (0),
+	_stats ()
+{
+	_slots[0].data = ping;
+	_slots[1].data = pong;
+	_slots[0].state = STATE_FREE;
+	_slots[1].state = STATE_FREE;
+}
+
+void ADXL345_PingPong::Watermark() {
+	if (!_running) { return; }
+	_pending = true;
+	if (_busy.exchange(true)) { return; }
+	_pending = false;
+	_step = STEP_BEGIN;
+	_Drive(0);
+}
+
+void ADXL345_PingPong::_Complete(void *context, StatusType status) {
+	ADXL345_PingPong *p = static_cast<ADXL345_PingPong*>(context);
+	p->_status = status;
+	if (p->_phase.exchange(PHASE_DONE) == PHASE_SUSPENDED) {
+		p->_Drive(status);
+	}
+}
+
+void ADXL345_PingPong::_Resume() {
+	Slot *slot = &_slots[_fill];
+	if (slot->state.load() != STATE_FREE) { return; }
+	// The consumer may release before a single sample had to be discarded.
+	slot->flags = _discarded ? _pendingFlags | FLAG_DROPPED : _pendingFlags;
+	slot->firstSample = _nextSample;
+	slot->dropped = _discarded;
+	slot->state = STATE_FILLING;
+	_pendingFlags = 0;
+	_position = 0;
+	_discarding = false;
+}
+
+void ADXL345_PingPong::_Stored() {
+	_stats.reads++;
+	_nextSample++;
+	if (_discarding) {
+		_discarded++;
+		_stats.dropped++;
+		return;
+	}
+	if (++_position < _samples) { return; }
+	_slots[_fill].state = STATE_READY;
+	_stats.buffers++;
+	_fill ^= 1;
+	Slot *next = &_slots[_fill];
+	if (next->state.load() == STATE_FREE) {
+		next->flags = _pendingFlags;
+		next->firstSample = _nextSample;
+		next->dropped = 0;
+		next->state = STATE_FILLING;
+		_pendingFlags = 0;
+		_position = 0;
+	}
+	else {
+		// The consumer still holds it, read on into _scratch so the FIFO keeps draining.
+		_discarding = true;
+		_discarded = 0;
+	}
+}
+
+void ADXL345_PingPong::_Drive(StatusType status) {
+	for (;;) {
+		uint8_t reg = ADXL345_Defs::REG_DATAX0;
+		uint8_t *data = &_reg;
+		uint8_t n = 1;
+		if (status) {
+			_stats.errors++;
+			_step = STEP_BEGIN;
+			_busy = false;
+			return;
+		}
+		switch (_step) {
+		case STEP_BEGIN:
+			_stats.drains++;
+			_step = STEP_INT_SOURCE;
+			reg = ADXL345_Defs::REG_INT_SOURCE;
+			break;
+		case STEP_INT_SOURCE:
+			if ((_reg >> ADXL345_Defs::BIT_INT_OVERRUN) & 1) {
+				_stats.overruns++;
+				if (_discarding) { _pendingFlags |= FLAG_OVERRUN; }
+				else { _slots[_fill].flags |= FLAG_OVERRUN; }
+			}
+			_step = STEP_FIFO_STATUS;
+			reg = ADXL345_Defs::REG_FIFO_STATUS;
+			break;
+		case STEP_FIFO_STATUS:
+			_entries = ADXL345_Defs::FIELD_FIFO_STATUS_ENTRIES::Decode(_reg);
+			if (_entries > _stats.maxEntries) { _stats.maxEntries = _entries; }
+			if (_entries < _watermark || !_running) {
+				// The watermark line is low now, its next rising edge calls Watermark().
+				_step = STEP_BEGIN;
+				_busy = false;
+				if (!_pending || !_running || _busy.exchange(true)) { return; }
+				_pending = false;
+				continue;
+			}
+			_step = STEP_ENTRY;
+			break;
+		case STEP_ENTRY:
+			_Stored();
+			if (!--_entries) {
+				// Check the level again, entries arrived during the pass.
+				_step = STEP_INT_SOURCE;
+				reg = ADXL345_Defs::REG_INT_SOURCE;
+			}
+			break;
+		}
+		if (_step == STEP_ENTRY) {
+			if (_discarding) { _Resume(); }
+			data = _discarding ? reinterpret_cast<uint8_t*>(_scratch) : reinterpret_cast<uint8_t*>(_slots[_fill].data[_position]);
+			n = 6;
+		}
+		_phase = PHASE_STARTING;
+		status = _transport->StartRead(reg, data, n, &_Complete, this);
+		if (status) { continue; }
+		// A transfer that completed inline is handled by this loop instead of recursing.
+		if (_phase.exchange(PHASE_SUSPENDED) != PHASE_DONE) { return; }
+		status = _status;
+	}
+}
+
+bool ADXL345_PingPong::Acquire(Buffer *buffer) {
+	Slot *slot = &_slots[_consume];
+	uint8_t expected = STATE_READY;
+	if (!slot->state.compare_exchange_strong(expected, STATE_HELD)) { return false; }
+	// The entries hold the DATAX0..DATAZ1 bytes as read, converted in place here.
+	for (uint16_t i=0; i<_samples; i++) {
+		const uint8_t *raw = reinterpret_cast<const uint8_t*>(slot->data[i]);
+		uint8_t bytes[6];
+		for (uint8_t j=0; j<6; j++) {
+			bytes[j] = raw[j];
+		}
+		ADXL345_Defs::RawFromBuffer(_dataFormat, bytes, slot->data[i]);
+	}
+	buffer->data = slot->data;
+	buffer->samples = _samples;
+	buffer->flags = slot->flags;
+	buffer->firstSample = slot->firstSample;
+	buffer->dropped = slot->dropped;
+	return true;
+}
+
+void ADXL345_PingPong::Release() {
+	Slot *slot = &_slots[_consume];
+	if (slot->state.load() != STATE_HELD) { return; }
+	slot->state = STATE_FREE;
+	_consume ^= 1;
+}
+
+void ADXL345_PingPong::GetStats(Stats *stats) {
+	*stats = _stats;
+}
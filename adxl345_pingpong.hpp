@@ -0,0 +1,203 @@
+/*
+adxl345_pingpong.hpp - Continuous ADXL345 FIFO streaming into two alternating buffers
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_PINGPONG_HPP_
+#define ADXL345_PINGPONG_HPP_
+
+#include "adxl345_async.hpp"
+
+// Streams the FIFO into two caller-supplied buffers without ever stopping, up to 3200 Hz.
+// The FIFO runs in stream mode with the watermark interrupt. Watermark(), called from the
+// interrupt pin handler, starts a drain that runs entirely in the completion callbacks of
+// an ADXL345_AsyncTransport, e.g. ADXL345_I2C_DMA or ADXL345_SPI_DMA:
+//	INT_SOURCE (overrun bit), FIFO_STATUS (entries), one 6 byte DATAX0 read per entry,
+// repeated until FIFO_STATUS reports fewer entries than the watermark, so the interrupt
+// line is low again and its next edge is not missed. Entries are read straight into the
+// buffer being filled; a buffer is handed over when it holds exactly samples samples,
+// and filling continues in the other one.
+// The consumer takes completed buffers in order with Acquire() and gives them back with
+// Release(). If it still holds the other buffer when one completes, the following samples
+// are read and discarded until it is released; the next buffer then carries FLAG_DROPPED
+// and the number of discarded samples. Samples lost in the sensor because the drain fell
+// behind set FLAG_OVERRUN. A buffer without flags continues the previous one gap-free.
+// Whether a bus keeps up with a rate can be checked beforehand with ADXL345_WatermarkTuner.
+// On cores with a data cache the buffers have to be in non-cacheable memory.
+class ADXL345_PingPong {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		FLAG_OVERRUN	=	0x01,		// the sensor FIFO overran while this buffer was filled
+		FLAG_DROPPED	=	0x02,		// samples were discarded right before this buffer
+	};
+
+	// A completed buffer.
+	struct Buffer {
+		int16_t (*data)[3];		// converted samples
+		uint16_t samples;		// always the buffer size given to the constructor
+		uint8_t flags;			// FLAG_x
+		uint32_t firstSample;	// stream index of data[0], discarded samples count too
+		uint32_t dropped;		// samples discarded right before data[0]
+	};
+
+	struct Stats {
+		uint32_t drains;		// interrupt handlings
+		uint32_t reads;			// FIFO entries read
+		uint32_t buffers;		// buffers completed
+		uint32_t overruns;		// drains that found the overrun bit set
+		uint32_t dropped;		// samples discarded for lack of a free buffer
+		uint32_t errors;		// failed transfers
+		uint8_t maxEntries;		// highest FIFO level seen at a drain
+	};
+
+//	ping and pong hold samples samples each.
+	ADXL345_PingPong(ADXL345_AsyncTransport *transport, int16_t ping[][3], int16_t pong[][3], uint16_t samples);
+
+//	Configures dev for streaming at rate with the watermark on the INT1 or INT2 pin and starts
+//	measuring, with sleep and auto sleep off. The FIFO is cleared first, so the stream starts
+//	with sample 0. dev is used with blocking IO here and must not be accessed while streaming.
+	template <class Derived>
+	StatusType Start(ADXL345_Core<Derived> *dev, uint8_t rate, uint8_t watermark, uint8_t pin = ADXL345_Defs::PIN_INT1);
+//	Waits for a running drain, then puts the FIFO in bypass mode and disables its interrupts.
+	template <class Derived>
+	StatusType Stop(ADXL345_Core<Derived> *dev);
+
+//	Call from the interrupt handler of the watermark pin. After failed transfers, the
+//	drain stops until the next call; calling it from the main loop as well recovers.
+	void Watermark();
+
+//	Returns false if the next buffer is not complete yet. Otherwise the buffer stays
+//	with the consumer until Release().
+	bool Acquire(Buffer *buffer);
+	void Release();
+
+	bool IsRunning() { return _running; }
+	void GetStats(Stats *stats);
+private:
+	enum {
+		STATE_FREE		=	0x0,
+		STATE_FILLING	=	0x1,
+		STATE_READY		=	0x2,
+		STATE_HELD		=	0x3,
+
+		STEP_BEGIN			=	0x0,
+		STEP_INT_SOURCE		=	0x1,
+		STEP_FIFO_STATUS	=	0x2,
+		STEP_ENTRY			=	0x3,
+
+		// Same handshake as ADXL345_Async::Transfer, for transports completing inline
+		PHASE_STARTING	=	0x0,
+		PHASE_SUSPENDED	=	0x1,
+		PHASE_DONE		=	0x2,
+	};
+	struct Slot {
+		int16_t (*data)[3];
+		std::atomic<uint8_t> state;
+		uint8_t flags;
+		uint32_t firstSample;
+		uint32_t dropped;
+	};
+	static void _Complete(void *context, StatusType status);
+//	Runs the drain from the completion of the current step until a transfer is in flight or it ends.
+	void _Drive(StatusType status);
+	void _Stored();
+	void _Resume();
+	ADXL345_AsyncTransport *_transport;
+	Slot _slots[2];
+	uint16_t _samples;
+	uint8_t _dataFormat;
+	uint8_t _watermark;
+	volatile bool _running;
+	std::atomic<bool> _busy;		// a drain is in progress
+	std::atomic<bool> _pending;		// Watermark() was called during a drain
+	// Drain state, only touched by the drain
+	uint8_t _step;
+	std::atomic<uint8_t> _phase;
+	StatusType _status;
+	uint8_t _reg;					// INT_SOURCE or FIFO_STATUS value read
+	uint8_t _entries;				// entries left in this pass
+	uint8_t _fill;					// slot being filled
+	uint16_t _position;				// next sample in it
+	bool _discarding;				// no free slot, samples go to _scratch
+	uint8_t _pendingFlags;			// flags for the next slot that starts filling
+	uint32_t _discarded;
+	uint32_t _nextSample;
+	int16_t _scratch[3];
+	uint8_t _consume;				// slot the consumer takes next
+	Stats _stats;
+};
+
+template <class Derived>
+ADXL345_PingPong::StatusType ADXL345_PingPong::Start(ADXL345_Core<Derived> *dev, uint8_t rate, uint8_t watermark, uint8_t pin) {
+	const uint8_t intMask = (1 << ADXL345_Defs::BIT_INT_WATERMARK) | (1 << ADXL345_Defs::BIT_INT_OVERRUN);
+	StatusType status;
+	uint8_t intMap;
+	if (_running) { return StatusType(HAL_BUSY); }
+	if (!watermark || watermark > ADXL345_Defs::FIELD_FIFO_CTL_SAMPLES::max) { return StatusType(HAL_ERROR); }
+	status = dev->RefreshDataFormat();
+	if (status) { return status; }
+	dev->GetDataFormat(&_dataFormat);
+	// Bypass clears the FIFO, so no samples of an earlier configuration are streamed.
+	status = dev->SetFifoCtl(ADXL345_Defs::FIELD_FIFO_CTL_MODE::Encode(ADXL345_Defs::VAL_FIFO_MODE_BYPASS));
+	if (status) { return status; }
+	status = dev->SetBwRate(ADXL345_Defs::FIELD_BW_RATE_RATE::Encode(rate));
+	if (status) { return status; }
+	status = dev->GetIntMap(&intMap);
+	if (status) { return status; }
+	intMap = pin == ADXL345_Defs::PIN_INT2 ? (intMap | intMask) : (intMap & ~intMask);
+	status = dev->SetIntMap(intMap);
+	if (status) { return status; }
+	status = dev->SetIntEnable(intMask);
+	if (status) { return status; }
+	_watermark = watermark;
+	_slots[0].state = STATE_FILLING;
+	_slots[0].flags = 0;
+	_slots[0].firstSample = 0;
+	_slots[0].dropped = 0;
+	_slots[1].state = STATE_FREE;
+	_fill = 0;
+	_position = 0;
+	_discarding = false;
+	_pendingFlags = 0;
+	_discarded = 0;
+	_nextSample = 0;
+	_consume = 0;
+	_pending = false;
+	_busy = false;
+	_stats = Stats();
+	status = dev->SetFifoCtl(ADXL345_Defs::FIELD_FIFO_CTL_MODE::Encode(ADXL345_Defs::VAL_FIFO_MODE_STREAM) | ADXL345_Defs::FIELD_FIFO_CTL_SAMPLES::Encode(watermark));
+	if (status) { return status; }
+	status = dev->SetPowerCtl(1 << ADXL345_Defs::BIT_POWER_CTL_MEASURE);
+	if (status) { return status; }
+	_running = true;
+	// An edge that came before _running was set would be lost otherwise.
+	Watermark();
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_PingPong::StatusType ADXL345_PingPong::Stop(ADXL345_Core<Derived> *dev) {
+	StatusType status;
+	_running = false;
+	while (_busy) {}
+	status = dev->SetIntEnable(0);
+	if (status) { return status; }
+	return dev->SetFifoCtl(ADXL345_Defs::FIELD_FIFO_CTL_MODE::Encode(ADXL345_Defs::VAL_FIFO_MODE_BYPASS));
+}
+
+#endif /* ADXL345_PINGPONG_HPP_ */
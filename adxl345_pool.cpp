@@ -0,0 +1,132 @@
+/*
+adxl345_pool.cpp - Reference counted pool of ADXL345 sample blocks
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_pool.hpp"
+#include <atomic>
+#include <stdint.h>
+
+using namespace std;
+
+struct PoolEntry {
+	ADXL345_SampleBlock block;		// first, keeps its alignment
+	atomic<uint8_t> refs;
+	atomic<uint8_t> next;			// index + 1 of the next free entry, 0 ends the list
+};
+
+// Zero initialized, so all of it is valid before any constructor runs.
+static PoolEntry blockPool[ADXL345_BlockPool::BLOCKS];
+// Bits 0-7: index + 1 of the first free entry, 0 if the list is empty.
+// Bits 8-31: version, incremented by every update.
+static atomic<uint32_t> blockFreeHead;
+static atomic<uint8_t> blockFresh;		// entries never handed out start here
+static atomic<uint8_t> blockInUse;
+static atomic<uint8_t> blockPeakInUse;
+static atomic<uint32_t> blockAcquired;
+static atomic<uint32_t> blockExhausted;
+
+static PoolEntry *EntryOf(const ADXL345_SampleBlock *block) {
+	const uintptr_t offset = reinterpret_cast<uintptr_t>(block) - reinterpret_cast<uintptr_t>(blockPool);
+	return &blockPool[offset / sizeof(PoolEntry)];
+}
+
+static PoolEntry *Pop() {
+	uint32_t head = blockFreeHead.load(memory_order_acquire);
+	while (head & 0xFF) {
+		PoolEntry *entry = &blockPool[(head & 0xFF) - 1];
+		// If entry was taken meanwhile, next may be stale, but then the version differs.
+		const uint32_t update = ((head + 0x100) & ~uint32_t(0xFF)) | entry->next.load(memory_order_relaxed);
+		if (blockFreeHead.compare_exchange_weak(head, update, memory_order_acquire, memory_order_acquire)) {
+			return entry;
+		}
+	}
+	// The free list is empty, take an entry that was never used.
+	uint8_t fresh = blockFresh.load(memory_order_relaxed);
+	while (fresh < ADXL345_BlockPool::BLOCKS) {
+		if (blockFresh.compare_exchange_weak(fresh, uint8_t(fresh + 1), memory_order_relaxed)) {
+			return &blockPool[fresh];
+		}
+	}
+	return nullptr;
+}
+
+static void Push(PoolEntry *entry) {
+	const uint32_t index = uint32_t(entry - blockPool) + 1;
+	uint32_t head = blockFreeHead.load(memory_order_relaxed);
+	uint32_t update;
+	do {
+		entry->next.store(uint8_t(head & 0xFF), memory_order_relaxed);
+		update = ((head + 0x100) & ~uint32_t(0xFF)) | index;
+	} while (!blockFreeHead.compare_exchange_weak(head, update, memory_order_release, memory_order_relaxed));
+}
+
+ADXL345_SampleBlock *ADXL345_BlockPool::Acquire() {
+	PoolEntry *entry = Pop();
+	if (!entry) {
+		blockExhausted.fetch_add(1, memory_order_relaxed);
+		return nullptr;
+	}
+	entry->refs.store(1, memory_order_relaxed);
+	entry->block.Clear();
+	blockAcquired.fetch_add(1, memory_order_relaxed);
+	const uint8_t inUse = blockInUse.fetch_add(1, memory_order_relaxed) + 1;
+	uint8_t peak = blockPeakInUse.load(memory_order_relaxed);
+	while (inUse > peak && !blockPeakInUse.compare_exchange_weak(peak, inUse, memory_order_relaxed)) {}
+	return &entry->block;
+}
+
+const ADXL345_SampleBlock *ADXL345_BlockPool::AddRef(const ADXL345_SampleBlock *block) {
+	if (!block) { return nullptr; }
+	atomic<uint8_t> &refs = EntryOf(block)->refs;
+	uint8_t n = refs.load(memory_order_relaxed);
+	do {
+		// A wrapped count would free the block while it is still in use.
+		if (n == UINT8_MAX) { return nullptr; }
+	} while (!refs.compare_exchange_weak(n, uint8_t(n + 1), memory_order_relaxed));
+	return block;
+}
+
+void ADXL345_BlockPool::Release(const ADXL345_SampleBlock *block) {
+	if (!block) { return; }
+	PoolEntry *entry = EntryOf(block);
+	// The last consumer must see all writes of the others before the block is reused.
+	if (entry->refs.fetch_sub(1, memory_order_acq_rel) != 1) { return; }
+	blockInUse.fetch_sub(1, memory_order_relaxed);
+	Push(entry);
+}
+
+uint8_t ADXL345_BlockPool::GetRefs(const ADXL345_SampleBlock *block) {
+	return EntryOf(block)->refs.load(memory_order_relaxed);
+}
+
+uint8_t ADXL345_BlockPool::GetInUse() {
+	return blockInUse.load(memory_order_relaxed);
+}
+
+void ADXL345_BlockPool::GetStats(Stats *stats) {
+	stats->acquired = blockAcquired.load(memory_order_relaxed);
+	stats->exhausted = blockExhausted.load(memory_order_relaxed);
+	stats->inUse = blockInUse.load(memory_order_relaxed);
+	stats->peakInUse = blockPeakInUse.load(memory_order_relaxed);
+}
+
+void ADXL345_BlockPool::ResetStats() {
+	blockAcquired.store(0, memory_order_relaxed);
+	blockExhausted.store(0, memory_order_relaxed);
+	blockPeakInUse.store(blockInUse.load(memory_order_relaxed), memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+/*
+adxl345_pool.hpp - Reference counted pool of ADXL345 sample blocks
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_POOL_HPP_
+#define ADXL345_POOL_HPP_
+
+#include "adxl345_block.hpp"
+
+// Number of statically allocated blocks, at most 255.
+#ifndef ADXL345_BLOCK_POOL_BLOCKS
+#define ADXL345_BLOCK_POOL_BLOCKS	8
+#endif
+
+// Fixed pool of ADXL345_SampleBlock, so a drained block can be handed to several
+// consumers (logging, FFT, detection, uplink) without copies or heap use.
+// Acquire() returns a block with one reference for the producer to fill. Each further
+// consumer takes a reference with AddRef() and treats the block as read-only; the
+// block returns to the pool when Release() drops the last one.
+// All methods are lock-free and may be called from interrupt handlers, e.g. the FIFO
+// watermark ISR, and from several threads on Linux. The free list is a stack of block
+// indices with a version tag, so a block taken and returned between the read and the
+// update of the list head is noticed. On Cortex-M0 and M0+, which have no exclusive
+// access instructions, the compare-and-swap and fetch-and-add are calls to the
+// __atomic helpers of adxl345_atomic.cpp, which mask interrupts; link that file there.
+// Blocks that were never used are handed out from a counter, so the pool needs no
+// initialization and is ready before constructors run.
+class ADXL345_BlockPool {
+public:
+	enum {
+		BLOCKS		=	ADXL345_BLOCK_POOL_BLOCKS,
+	};
+	static_assert(BLOCKS >= 1 && BLOCKS <= 255, "ADXL345_BLOCK_POOL_BLOCKS must be 1 to 255");
+
+	struct Stats {
+		uint32_t acquired;		// successful Acquire() calls
+		uint32_t exhausted;		// Acquire() calls that found no free block
+		uint8_t inUse;			// blocks with references now
+		uint8_t peakInUse;		// highest inUse since the last ResetStats()
+	};
+
+//	Returns an empty block holding one reference, or nullptr if all blocks are in use.
+	static ADXL345_SampleBlock *Acquire();
+//	Adds a reference for another consumer and returns block. Returns nullptr without
+//	adding one if block already holds 255 references.
+	static const ADXL345_SampleBlock *AddRef(const ADXL345_SampleBlock *block);
+//	Drops a reference, the last one returns the block to the pool.
+	static void Release(const ADXL345_SampleBlock *block);
+	static uint8_t GetRefs(const ADXL345_SampleBlock *block);
+
+	static uint8_t GetFree() { return uint8_t(BLOCKS - GetInUse()); }
+	static uint8_t GetInUse();
+	static void GetStats(Stats *stats);
+//	Clears the counters and restarts peakInUse at the present use.
+	static void ResetStats();
+};
+
+#endif /* ADXL345_POOL_HPP_ */
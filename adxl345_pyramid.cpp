@@ -0,0 +1,217 @@
+/*
+adxl345_pyramid.cpp - Multi-resolution history of ADXL345 samples
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_pyramid.hpp"
+#include "adxl345_stream.hpp"
+#include <math.h>
+
+ADXL345_Pyramid::StatusType ADXL345_Pyramid::Init(void *memory, uint8_t levels, uint32_t depth, uint8_t rate) {
+	if (!levels || levels > ADXL345_PyramidHeader::LEVELS_MAX || !depth) {
+		return ADXL345_Defs::STATUS_NO_MEMORY;
+	}
+	_header = static_cast<ADXL345_PyramidHeader*>(memory);
+	_nodes = reinterpret_cast<ADXL345_PyramidNode*>(_header + 1);
+	_header->magic = ADXL345_PyramidHeader::MAGIC;
+	_header->version = ADXL345_PyramidHeader::VERSION;
+	_header->levels = levels;
+	_header->rate = rate;
+	_header->depth = depth;
+	_header->reserved = 0;
+	_header->count = 0;
+	for (uint8_t i=0; i<ADXL345_PyramidHeader::LEVELS_MAX; i++) {
+		_Clear(&_header->partial[i]);
+	}
+	// Stale slots are told apart by their index, start with one that matches no block yet.
+	for (uint32_t i=0; i<uint32_t(levels) * depth; i++) {
+		_Clear(&_nodes[i]);
+		_nodes[i].index = UINT32_MAX;
+	}
+	return StatusType(0);
+}
+
+ADXL345_Pyramid::StatusType ADXL345_Pyramid::Attach(void *memory) {
+	ADXL345_PyramidHeader *header = static_cast<ADXL345_PyramidHeader*>(memory);
+	if (header->magic != ADXL345_PyramidHeader::MAGIC || header->version != ADXL345_PyramidHeader::VERSION) {
+		return ADXL345_Defs::STATUS_INVALID_ID;
+	}
+	_header = header;
+	_nodes = reinterpret_cast<ADXL345_PyramidNode*>(_header + 1);
+	return StatusType(0);
+}
+
+void ADXL345_Pyramid::_Clear(ADXL345_PyramidNode *node) {
+	node->count = 0;
+	for (uint8_t i=0; i<3; i++) {
+		node->min[i] = INT16_MAX;
+		node->max[i] = INT16_MIN;
+		node->sum[i] = 0;
+		node->sumSq[i] = 0;
+	}
+}
+
+void ADXL345_Pyramid::_Merge(ADXL345_PyramidNode *into, const ADXL345_PyramidNode &node) {
+	into->count += node.count;
+	for (uint8_t i=0; i<3; i++) {
+		if (node.min[i] < into->min[i]) { into->min[i] = node.min[i]; }
+		if (node.max[i] > into->max[i]) { into->max[i] = node.max[i]; }
+		into->sum[i] += node.sum[i];
+		into->sumSq[i] += node.sumSq[i];
+	}
+}
+
+void ADXL345_Pyramid::_Store(uint8_t level, uint64_t block, const ADXL345_PyramidNode &node) {
+	ADXL345_PyramidNode *slot = _Node(level, block);
+	*slot = node;
+	slot->index = uint32_t(block);
+}
+
+bool ADXL345_Pyramid::_Available(uint8_t level, uint64_t block) {
+	const uint64_t completed = _header->count >> level;
+	return block < completed && block + _header->depth >= completed && _Node(level, block)->index == uint32_t(block);
+}
+
+void ADXL345_Pyramid::AppendSample(const int16_t sample[3]) {
+	ADXL345_PyramidNode node;
+	node.count = 1;
+	for (uint8_t i=0; i<3; i++) {
+		node.min[i] = sample[i];
+		node.max[i] = sample[i];
+		node.sum[i] = sample[i];
+		node.sumSq[i] = uint64_t(int32_t(sample[i]) * sample[i]);
+	}
+	uint64_t block = _header->count;
+	// Completing a block completes its parent if it was the second child.
+	for (uint8_t level=0; ; level++) {
+		_Store(level, block, node);
+		if (level + 1 >= _header->levels) { break; }
+		ADXL345_PyramidNode *parent = &_header->partial[level+1];
+		_Merge(parent, node);
+		if (!(block & 1)) { break; }
+		node = *parent;
+		_Clear(parent);
+		block >>= 1;
+	}
+	_header->count++;
+}
+
+void ADXL345_Pyramid::AppendGap(uint64_t lost) {
+	const uint64_t n0 = _header->count;
+	const uint64_t n1 = n0 + lost;
+	if (!lost) { return; }
+	ADXL345_PyramidNode empty;
+	_Clear(&empty);
+	// first is the oldest block completed on the level below, the only one that can hold data.
+	ADXL345_PyramidNode first = empty;
+	for (uint8_t level=0; level<_header->levels; level++) {
+		const uint64_t c0 = n0 >> level;
+		const uint64_t c1 = n1 >> level;
+		if (level > 0 && (n1 >> (level-1)) == (n0 >> (level-1))) { break; }
+		ADXL345_PyramidNode *partial = &_header->partial[level];
+		if (c1 == c0) {
+			// Only the children below completed, the open block continues.
+			_Merge(partial, first);
+			break;
+		}
+		ADXL345_PyramidNode node = *partial;
+		if (level > 0) { _Merge(&node, first); }
+		_Store(level, c0, node);
+		// Older empty blocks would be overwritten in the ring anyway.
+		uint64_t i = c1 - c0 > _header->depth ? c1 - _header->depth : c0 + 1;
+		for (; i<c1; i++) {
+			_Store(level, i, empty);
+		}
+		first = node;
+		_Clear(partial);
+	}
+	_header->count = n1;
+}
+
+void ADXL345_Pyramid::Append(const int16_t data[][3], uint32_t frames) {
+	for (uint32_t i=0; i<frames; i++) {
+		uint32_t lost;
+		if (ADXL345_StreamMonitor::IsGapFrame(data[i], &lost)) {
+			AppendGap(lost);
+		}
+		else {
+			AppendSample(data[i]);
+		}
+	}
+}
+
+void ADXL345_Pyramid::Append(const ADXL345_SampleBlock &block) {
+	AppendGap(block.gap);
+	for (uint16_t i=0; i<block.samples; i++) {
+		const int16_t sample[3] = { block.axis[0][i], block.axis[1][i], block.axis[2][i] };
+		AppendSample(sample);
+	}
+}
+
+bool ADXL345_Pyramid::Query(uint64_t first, uint64_t end, Summary *summary) {
+	const uint8_t levels = _header->levels;
+	const uint64_t count = _header->count;
+	if (end > count) { end = count; }
+	if (first >= end) { return false; }
+	// Start on the finest level whose ring still reaches back to first,
+	// aligned to its blocks. Every later block is then available on the same
+	// or a finer level, or on a coarser one that starts at the same sample.
+	uint8_t level = levels - 1;
+	uint64_t oldest = 0;
+	for (uint8_t j=0; j<levels; j++) {
+		const uint64_t completed = count >> j;
+		oldest = completed > _header->depth ? (completed - _header->depth) << j : 0;
+		if (first >= oldest) {
+			level = j;
+			break;
+		}
+	}
+	uint64_t pos = first < oldest ? oldest : first & ~((uint64_t(1) << level) - 1);
+
+	ADXL345_PyramidNode total;
+	_Clear(&total);
+	summary->first = pos;
+	while (pos < end) {
+		// Largest aligned block at pos that fits the range
+		uint8_t k = 0;
+		while (k + 1 < levels && !(pos & (uint64_t(1) << k)) && pos + (uint64_t(2) << k) <= end) {
+			k++;
+		}
+		while (!_Available(k, pos >> k) && k + 1 < levels && !(pos & (uint64_t(1) << k))) {
+			k++;
+		}
+		if (!_Available(k, pos >> k)) { break; }
+		_Merge(&total, *_Node(k, pos >> k));
+		pos += uint64_t(1) << k;
+	}
+	summary->end = pos;
+	summary->count = total.count;
+	for (uint8_t i=0; i<3; i++) {
+		summary->min[i] = total.min[i];
+		summary->max[i] = total.max[i];
+		summary->mean[i] = total.count ? float(double(total.sum[i]) / total.count) : 0.0f;
+		summary->rms[i] = total.count ? float(sqrt(double(total.sumSq[i]) / total.count)) : 0.0f;
+	}
+	return pos > summary->first;
+}
+
+bool ADXL345_Pyramid::QueryTime(double from, double to, Summary *summary) {
+	const double odr = GetOdr();
+	if (from < 0) { from = 0; }
+	if (to <= from) { return false; }
+	return Query(uint64_t(from * odr), uint64_t(ceil(to * odr)), summary);
+}
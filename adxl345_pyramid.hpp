@@ -0,0 +1,116 @@
+/*
+adxl345_pyramid.hpp - Multi-resolution history of ADXL345 samples
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_PYRAMID_HPP_
+#define ADXL345_PYRAMID_HPP_
+
+#include "adxl345_core.hpp"
+
+// Summary of a block of 2^level samples, per axis in raw LSB.
+struct ADXL345_PyramidNode {
+	uint32_t index;			// block index on its level, truncated to 32 bit
+	uint32_t count;			// samples in the block, lost samples are not counted
+	int16_t min[3];
+	int16_t max[3];
+	int64_t sum[3];
+	uint64_t sumSq[3];
+};
+
+// Fixed-size state in front of the nodes.
+struct ADXL345_PyramidHeader {
+	enum {
+		MAGIC			=	0x52505841,	// "AXPR"
+		VERSION			=	0x1,
+		LEVELS_MAX		=	32,
+	};
+	uint32_t magic;
+	uint16_t version;
+	uint8_t levels;
+	uint8_t rate;						// VAL_BW_x of the samples
+	uint32_t depth;						// nodes kept per level
+	uint32_t reserved;
+	uint64_t count;						// samples appended, lost ones included
+	ADXL345_PyramidNode partial[LEVELS_MAX];	// completed children of the open block of each level
+};
+
+// Downsampling pyramid of a sample stream.
+// Level j keeps min/max/sum/sum of squares of the last depth blocks of 2^j samples
+// in a ring, so recent history is available at full resolution and old history
+// at coarser levels only. Appending is amortized O(1) per sample, a range query
+// merges at most two nodes per level, O(log n).
+// All state lives in one caller-supplied block of GetSize() bytes, writing it to
+// a file or mapping it from one persists the pyramid, Attach() picks it up again.
+// The image uses the byte order of the host.
+class ADXL345_Pyramid {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+
+	struct Summary {
+		uint64_t first;			// first sample covered, may be before the requested one
+		uint64_t end;			// one past the last sample covered
+		uint32_t count;			// samples with data
+		int16_t min[3];
+		int16_t max[3];
+		float mean[3];
+		float rms[3];
+	};
+
+	ADXL345_Pyramid()
+	:	_header (nullptr),
+		_nodes (nullptr)
+	{}
+
+	static constexpr uint32_t GetSize(uint8_t levels, uint32_t depth) {
+		return sizeof(ADXL345_PyramidHeader) + uint32_t(levels) * depth * sizeof(ADXL345_PyramidNode);
+	}
+//	Starts an empty pyramid in memory, rate is the VAL_BW_x of the samples.
+	StatusType Init(void *memory, uint8_t levels, uint32_t depth, uint8_t rate);
+//	Continues a pyramid that was stored earlier.
+	StatusType Attach(void *memory);
+
+//	Appends drained frames, gap marker frames of ADXL345_StreamMonitor are accounted as lost samples.
+	void Append(const int16_t data[][3], uint32_t frames);
+//	Appends a block, its gap is accounted as lost samples first.
+	void Append(const ADXL345_SampleBlock &block);
+	void AppendSample(const int16_t sample[3]);
+//	Advances the timeline by lost samples without data.
+	void AppendGap(uint64_t lost);
+
+	uint64_t GetCount() { return _header->count; }
+	float GetOdr() { return ADXL345_Defs::OdrFromRate(_header->rate); }
+
+//	Summarizes samples first to end-1. Parts that are no longer available at the needed
+//	resolution are widened to the enclosing coarser block, see Summary::first and end.
+//	Returns false if nothing of the range is available.
+	bool Query(uint64_t first, uint64_t end, Summary *summary);
+//	Same with times in seconds since the first sample, scaled with the output data rate.
+	bool QueryTime(double from, double to, Summary *summary);
+private:
+	ADXL345_PyramidNode *_Node(uint8_t level, uint64_t block) {
+		return &_nodes[uint32_t(level) * _header->depth + uint32_t(block % _header->depth)];
+	}
+	bool _Available(uint8_t level, uint64_t block);
+	void _Store(uint8_t level, uint64_t block, const ADXL345_PyramidNode &node);
+	static void _Clear(ADXL345_PyramidNode *node);
+	static void _Merge(ADXL345_PyramidNode *into, const ADXL345_PyramidNode &node);
+	ADXL345_PyramidHeader *_header;
+	ADXL345_PyramidNode *_nodes;
+};
+
+#endif /* ADXL345_PYRAMID_HPP_ */
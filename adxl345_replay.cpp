@@ -0,0 +1,117 @@
+/*
+adxl345_replay.cpp - ADXL345 bus recording and deterministic replay
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_replay.hpp"
+
+void ADXL345_ReplayBus::Rewind() {
+	for (uint8_t i=0; i<CURSOR_COUNT; i++) {
+		_cursors[i] = 0;
+	}
+	for (uint8_t i=0; i<REGISTER_COUNT; i++) {
+		_writeCursor[i] = 0;
+		_regs[i] = 0x00;
+	}
+	// Reset values
+	_regs[ADXL345_Defs::REG_DEVID] = ADXL345_Defs::VAL_DEVICE_ID;
+	_regs[ADXL345_Defs::REG_BW_RATE] = ADXL345_Defs::VAL_BW_50_Hz;
+	_time = 0;
+	_mismatches = 0;
+}
+
+int8_t ADXL345_ReplayBus::_CursorOf(uint8_t reg) {
+	if (reg >= ADXL345_Defs::REG_DATAX0 && reg <= ADXL345_Defs::REG_DATAZ1) { return CURSOR_DATA; }
+	switch (reg) {
+	case ADXL345_Defs::REG_FIFO_STATUS:		return CURSOR_FIFO_STATUS;
+	case ADXL345_Defs::REG_INT_SOURCE:		return CURSOR_INT_SOURCE;
+	case ADXL345_Defs::REG_ACT_TAP_STATUS:	return CURSOR_ACT_TAP;
+	default:								return -1;
+	}
+}
+
+bool ADXL345_ReplayBus::_Find(uint32_t *cursor, uint8_t reg, bool write) {
+	for (uint32_t i=*cursor; i<_count; i++) {
+		const ADXL345_BusRecord &r = _records[i];
+		if (r.reg == reg && bool(r.flags & ADXL345_BusRecord::FLAG_WRITE) == write) {
+			*cursor = i;
+			return true;
+		}
+	}
+	*cursor = _count;
+	return false;
+}
+
+ADXL345_ReplayBus::StatusType ADXL345_ReplayBus::WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+	bool mismatch = false;
+	if (reg >= REGISTER_COUNT) { return ADXL345_Defs::STATUS_REPLAY_MISMATCH; }
+	uint32_t *cursor = &_writeCursor[reg];
+	if (_Find(cursor, reg, true)) {
+		const ADXL345_BusRecord &r = _records[*cursor];
+		mismatch = r.n != n;
+		for (uint8_t i=0; i<n && !mismatch; i++) {
+			mismatch = r.data[i] != data[i];
+		}
+		(*cursor)++;
+	}
+	else {
+		// A write that was never recorded.
+		mismatch = true;
+	}
+	for (uint8_t i=0; i<n && reg+i < REGISTER_COUNT; i++) {
+		_regs[reg+i] = data[i];
+	}
+	if (mismatch) {
+		_mismatches++;
+		if (_strict) { return ADXL345_Defs::STATUS_REPLAY_MISMATCH; }
+	}
+	return StatusType(0);
+}
+
+ADXL345_ReplayBus::StatusType ADXL345_ReplayBus::ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) {
+	const int8_t c = _CursorOf(reg);
+	if (c < 0) {
+		for (uint8_t i=0; i<n; i++) {
+			data[i] = reg+i < REGISTER_COUNT ? _regs[reg+i] : 0x00;
+		}
+		return StatusType(0);
+	}
+	uint32_t *cursor = &_cursors[c];
+	// A data read has to start at the same register and may read fewer bytes.
+	while (_Find(cursor, reg, false) && _records[*cursor].n < n) {
+		(*cursor)++;
+	}
+	if (*cursor >= _count) { return ADXL345_Defs::STATUS_REPLAY_END; }
+	const ADXL345_BusRecord &r = _records[*cursor];
+	(*cursor)++;
+	for (uint8_t i=0; i<n; i++) {
+		data[i] = r.data[i];
+	}
+	if (r.timestamp > _time) { _time = r.timestamp; }
+	return r.status;
+}
+
+bool ADXL345_ReplayBus::AtEnd() {
+	for (uint8_t i=0; i<CURSOR_COUNT; i++) {
+		uint32_t cursor = _cursors[i];
+		for (; cursor<_count; cursor++) {
+			const ADXL345_BusRecord &r = _records[cursor];
+			if (!(r.flags & ADXL345_BusRecord::FLAG_WRITE) && _CursorOf(r.reg) == int8_t(i)) { return false; }
+		}
+	}
+	return true;
+}
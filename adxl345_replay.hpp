@@ -0,0 +1,150 @@
+/*
+adxl345_replay.hpp - ADXL345 bus recording and deterministic replay
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_REPLAY_HPP_
+#define ADXL345_REPLAY_HPP_
+
+#include "adxl345.hpp"
+
+// One register transfer of a recording.
+// A capture file is a plain array of these records, little-endian, 16 bytes each.
+struct ADXL345_BusRecord {
+	enum {
+		FLAG_WRITE	=	0x01,
+	};
+	uint32_t timestamp;		// us since the start of the recording
+	uint8_t reg;
+	uint8_t flags;			// FLAG_x
+	uint8_t n;				// number of bytes in data
+	uint8_t status;			// StatusType of the transfer
+	uint8_t data[ADXL345_Defs::BUFFER_MAX];
+	uint8_t reserved[2];
+};
+
+// Transport policy that records every transfer of Bus into a caller-supplied array.
+// Clock returns the current time in us. Recording stops when the array is full.
+template <class Bus>
+class ADXL345_RecordingBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	typedef uint32_t (*Clock)();
+	ADXL345_RecordingBus(const Bus &bus, ADXL345_BusRecord records[], uint32_t capacity, Clock clock)
+	:	_bus (bus),
+		_records (records),
+		_capacity (capacity),
+		_count (0),
+		_clock (clock),
+		_start (clock())
+	{}
+	StatusType WriteTo(uint8_t reg, uint8_t val)						{ return _Record(reg, true, &val, 1, _bus.WriteTo(reg, val)); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _Record(reg, true, data, n, _bus.WriteTo(reg, data, n)); }
+	StatusType ReadFrom(uint8_t reg, uint8_t *val)						{ return _Record(reg, false, val, 1, _bus.ReadFrom(reg, val)); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)			{ return _Record(reg, false, data, n, _bus.ReadFrom(reg, data, n)); }
+	uint32_t GetCount() { return _count; }
+	Bus *GetBus() { return &_bus; }
+private:
+	StatusType _Record(uint8_t reg, bool write, const uint8_t data[], uint8_t n, StatusType status) {
+		if (_count < _capacity) {
+			ADXL345_BusRecord *r = &_records[_count++];
+			r->timestamp = _clock() - _start;
+			r->reg = reg;
+			r->flags = write ? ADXL345_BusRecord::FLAG_WRITE : 0;
+			r->n = n;
+			r->status = status;
+			for (uint8_t i=0; i<ADXL345_Defs::BUFFER_MAX; i++) {
+				r->data[i] = i < n ? data[i] : 0;
+			}
+			r->reserved[0] = 0;
+			r->reserved[1] = 0;
+		}
+		return status;
+	}
+	Bus _bus;
+	ADXL345_BusRecord *_records;
+	uint32_t _capacity;
+	uint32_t _count;
+	Clock _clock;
+	uint32_t _start;
+};
+
+// Transport policy replaying a recording.
+// Reads of the data path (DATAxx, FIFO_STATUS, INT_SOURCE, ACT_TAP_STATUS) return
+// the recorded values in recorded order, each register group with its own cursor,
+// so a driver that accesses the bus differently still sees the same data.
+// Every served record advances a virtual clock to its timestamp: use GetTime()
+// instead of a hardware timer to see the original timing, faster than real time.
+// Configuration registers are kept in a register file starting at reset values.
+// Writes are compared against the next recorded write to the same register,
+// differences are counted and, in strict mode, returned as STATUS_REPLAY_MISMATCH.
+class ADXL345_ReplayBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	ADXL345_ReplayBus(const ADXL345_BusRecord records[], uint32_t count, bool strict = false)
+	:	_records (records),
+		_count (count),
+		_strict (strict)
+	{ Rewind(); }
+	StatusType WriteTo(uint8_t reg, uint8_t val) { return WriteTo(reg, &val, 1); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n);
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) { return ReadFrom(reg, val, 1); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n);
+
+	void Rewind();
+	uint32_t GetTime() { return _time; }
+	uint32_t GetMismatches() { return _mismatches; }
+//	True once all data path records were served.
+	bool AtEnd();
+private:
+	enum {
+		CURSOR_DATA			=	0x0,
+		CURSOR_FIFO_STATUS	=	0x1,
+		CURSOR_INT_SOURCE	=	0x2,
+		CURSOR_ACT_TAP		=	0x3,
+		CURSOR_COUNT		=	0x4,
+		REGISTER_COUNT		=	0x3A,
+	};
+	static int8_t _CursorOf(uint8_t reg);
+	bool _Find(uint32_t *cursor, uint8_t reg, bool write);
+	const ADXL345_BusRecord *_records;
+	uint32_t _count;
+	bool _strict;
+	uint32_t _cursors[CURSOR_COUNT];
+	uint32_t _writeCursor[REGISTER_COUNT];
+	uint8_t _regs[REGISTER_COUNT];
+	uint32_t _time;
+	uint32_t _mismatches;
+};
+
+// Virtual adapter, e.g. to run existing code written against ADXL345 on a recording.
+class ADXL345_Replay : public ADXL345 {
+public:
+	ADXL345_Replay(const ADXL345_BusRecord records[], uint32_t count, bool strict = false)
+	:	ADXL345(),
+		_bus (records, count, strict)
+	{}
+	ADXL345_ReplayBus *GetBus() { return &_bus; }
+private:
+	virtual StatusType _WriteTo(uint8_t reg, uint8_t val)						{ return _bus.WriteTo(reg, val); }
+	virtual StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _bus.WriteTo(reg, data, n); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t *val)						{ return _bus.ReadFrom(reg, val); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)		{ return _bus.ReadFrom(reg, data, n); }
+	ADXL345_ReplayBus _bus;
+};
+
+#endif /* ADXL345_REPLAY_HPP_ */
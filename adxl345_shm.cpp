@@ -0,0 +1,296 @@
+/*
+adxl345_shm.cpp - ADXL345 frame distribution through POSIX shared memory
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "adxl345_shm.hpp"
+
+static_assert(sizeof(ADXL345_ShmFrame) == 16, "frame layout");
+static_assert(sizeof(ADXL345_ShmHeader) == 64, "header layout");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the ring needs address-free atomics");
+
+// Shared (not FUTEX_PRIVATE) futexes, the waiters live in other processes.
+static long Futex(const std::atomic<uint32_t> *word, int op, uint32_t val, const struct timespec *timeout) {
+	return syscall(SYS_futex, reinterpret_cast<const uint32_t*>(word), op, val, timeout, nullptr, 0);
+}
+
+/************************ PUBLISHER ***********************/
+
+static bool ValidCapacity(uint32_t capacity) {
+	return capacity >= ADXL345_Defs::FIFO_MAX + 1 && !(capacity & (capacity - 1));
+}
+
+ADXL345_ShmPublisher::StatusType ADXL345_ShmPublisher::Create(const char *name, uint32_t capacity, uint8_t sensors) {
+	StatusType status;
+	struct stat st;
+	Close();
+	if (!ValidCapacity(capacity) || capacity > (UINT32_MAX - sizeof(ADXL345_ShmHeader)) / sizeof(ADXL345_ShmFrame)
+		|| sensors > ADXL345_ShmHeader::SENSORS_MAX) {
+		return ADXL345_Defs::STATUS_NO_MEMORY;
+	}
+	const uint32_t size = GetSize(capacity);
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	if (fstat(fd, &st) == 0 && st.st_size && uint64_t(st.st_size) != size) {
+		// Shrinking a ring that consumers map would make their reads fault.
+		close(fd);
+		shm_unlink(name);
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0) { return ADXL345_Defs::STATUS_IO_ERROR; }
+		st.st_size = 0;
+	}
+	void *memory = MAP_FAILED;
+	if (uint64_t(st.st_size) == size || ftruncate(fd, size) == 0) {
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (memory == MAP_FAILED) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	status = Init(memory, capacity, sensors);
+	if (status) {
+		munmap(memory, size);
+		return status;
+	}
+	_mapped = size;
+	return StatusType(0);
+}
+
+ADXL345_ShmPublisher::StatusType ADXL345_ShmPublisher::Init(void *memory, uint32_t capacity, uint8_t sensors) {
+	if (!ValidCapacity(capacity) || sensors > ADXL345_ShmHeader::SENSORS_MAX) {
+		return ADXL345_Defs::STATUS_NO_MEMORY;
+	}
+	_header = static_cast<ADXL345_ShmHeader*>(memory);
+	_frames = reinterpret_cast<ADXL345_ShmFrame*>(_header + 1);
+	// The memory may hold a ring consumers are attaching to, invalidate it first.
+	_header->magic = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	_header->version = ADXL345_ShmHeader::VERSION;
+	_header->frameSize = sizeof(ADXL345_ShmFrame);
+	_header->capacity = capacity;
+	_header->sensors = sensors;
+	for (uint8_t i=0; i<ADXL345_ShmHeader::SENSORS_MAX; i++) {
+		_header->rates[i] = ADXL345_Defs::VAL_BW_50_Hz;
+	}
+	_header->head.store(0, std::memory_order_relaxed);
+	_header->reserve.store(0, std::memory_order_relaxed);
+	_header->waiters.store(0, std::memory_order_relaxed);
+	// Consumers check the magic last.
+	std::atomic_thread_fence(std::memory_order_release);
+	_header->magic = ADXL345_ShmHeader::MAGIC;
+	return StatusType(0);
+}
+
+void ADXL345_ShmPublisher::Close() {
+	if (_mapped) {
+		munmap(_header, _mapped);
+	}
+	_header = nullptr;
+	_frames = nullptr;
+	_mapped = 0;
+}
+
+ADXL345_ShmPublisher::StatusType ADXL345_ShmPublisher::SetRate(uint8_t sensor, uint8_t rate) {
+	if (sensor >= _header->sensors) { return StatusType(HAL_ERROR); }
+	_header->rates[sensor] = rate;
+	return StatusType(0);
+}
+
+uint32_t ADXL345_ShmPublisher::_Reserve(uint32_t frames) {
+	const uint32_t head = _header->head.load(std::memory_order_relaxed);
+	// Announce the slots about to be overwritten before touching them (seqlock).
+	_header->reserve.store(head + frames, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return head;
+}
+
+void ADXL345_ShmPublisher::_Commit(uint32_t head) {
+	_header->head.store(head, std::memory_order_seq_cst);
+	if (_header->waiters.load(std::memory_order_seq_cst)) {
+		Futex(&_header->head, FUTEX_WAKE, INT_MAX, nullptr);
+	}
+}
+
+ADXL345_ShmPublisher::StatusType ADXL345_ShmPublisher::Publish(uint8_t sensor, const ADXL345_StreamMonitor::Block &block, const int16_t data[][3]) {
+	if (sensor >= _header->sensors || block.frames > ADXL345_Defs::FIFO_MAX + 1) { return StatusType(HAL_ERROR); }
+	const uint32_t head = _Reserve(block.frames);
+	const uint32_t mask = _header->capacity - 1;
+	// A gap marker frame gets the index of the last lost sample.
+	uint32_t sample = block.frames > block.samples ? block.firstSample - 1 : block.firstSample;
+	for (uint8_t i=0; i<block.frames; i++) {
+		ADXL345_ShmFrame *f = &_frames[(head + i) & mask];
+		f->timestamp = block.timestamp;
+		f->sample = sample++;
+		f->sensor = sensor;
+		f->flags = block.flags;
+		f->data[0] = data[i][0];
+		f->data[1] = data[i][1];
+		f->data[2] = data[i][2];
+	}
+	_Commit(head + block.frames);
+	return StatusType(0);
+}
+
+ADXL345_ShmPublisher::StatusType ADXL345_ShmPublisher::Publish(uint8_t sensor, const ADXL345_SampleBlock &block) {
+	const uint32_t frames = block.samples + (block.gap ? 1 : 0);
+	if (sensor >= _header->sensors || frames > _header->capacity) { return StatusType(HAL_ERROR); }
+	const uint32_t head = _Reserve(frames);
+	const uint32_t mask = _header->capacity - 1;
+	uint32_t at = head;
+	if (block.gap) {
+		ADXL345_ShmFrame *f = &_frames[at++ & mask];
+		f->timestamp = block.timestamp;
+		f->sample = block.firstSample - 1;
+		f->sensor = sensor;
+		f->flags = block.flags;
+		ADXL345_StreamMonitor::MakeGapFrame(block.gap, f->data);
+	}
+	for (uint16_t i=0; i<block.samples; i++) {
+		ADXL345_ShmFrame *f = &_frames[at++ & mask];
+		f->timestamp = block.timestamp;
+		f->sample = block.firstSample + i;
+		f->sensor = sensor;
+		f->flags = block.flags;
+		f->data[0] = block.axis[ADXL345_SampleBlock::AXIS_X][i];
+		f->data[1] = block.axis[ADXL345_SampleBlock::AXIS_Y][i];
+		f->data[2] = block.axis[ADXL345_SampleBlock::AXIS_Z][i];
+	}
+	_Commit(at);
+	return StatusType(0);
+}
+
+/************************ CONSUMER ************************/
+
+ADXL345_ShmConsumer::StatusType ADXL345_ShmConsumer::Open(const char *name) {
+	StatusType status;
+	struct stat st;
+	Close();
+	const int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	void *memory = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && uint64_t(st.st_size) >= sizeof(ADXL345_ShmHeader)) {
+		memory = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (memory == MAP_FAILED) { return ADXL345_Defs::STATUS_IO_ERROR; }
+	// A truncated or foreign object must not make the frame reads leave the mapping.
+	const uint32_t capacity = static_cast<const ADXL345_ShmHeader*>(memory)->capacity;
+	status = uint64_t(st.st_size) >= sizeof(ADXL345_ShmHeader) + uint64_t(capacity) * sizeof(ADXL345_ShmFrame)
+		? Attach(memory) : StatusType(ADXL345_Defs::STATUS_INVALID_ID);
+	if (status) {
+		munmap(memory, st.st_size);
+		return status;
+	}
+	_mapped = st.st_size;
+	return StatusType(0);
+}
+
+ADXL345_ShmConsumer::StatusType ADXL345_ShmConsumer::Attach(const void *memory) {
+	const ADXL345_ShmHeader *header = static_cast<const ADXL345_ShmHeader*>(memory);
+	if (header->magic != ADXL345_ShmHeader::MAGIC) { return ADXL345_Defs::STATUS_INVALID_ID; }
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (header->version != ADXL345_ShmHeader::VERSION || header->frameSize != sizeof(ADXL345_ShmFrame)
+		|| !ValidCapacity(header->capacity) || header->sensors > ADXL345_ShmHeader::SENSORS_MAX) {
+		return ADXL345_Defs::STATUS_INVALID_ID;
+	}
+	_header = header;
+	_frames = reinterpret_cast<const ADXL345_ShmFrame*>(header + 1);
+	_cursor = header->head.load(std::memory_order_acquire);
+	_acquired = 0;
+	_lost = 0;
+	return StatusType(0);
+}
+
+void ADXL345_ShmConsumer::Close() {
+	if (_mapped) {
+		munmap(const_cast<ADXL345_ShmHeader*>(_header), _mapped);
+	}
+	_header = nullptr;
+	_frames = nullptr;
+	_mapped = 0;
+}
+
+void ADXL345_ShmConsumer::Rewind() {
+	const uint32_t head = _header->head.load(std::memory_order_acquire);
+	_cursor = head < _header->capacity ? 0 : head - _header->capacity;
+	_acquired = 0;
+}
+
+ADXL345_ShmConsumer::StatusType ADXL345_ShmConsumer::GetRate(uint8_t sensor, uint8_t *rate) {
+	// The header is shared, so SENSORS_MAX is checked again in case it changed since Attach().
+	if (sensor >= _header->sensors || sensor >= ADXL345_ShmHeader::SENSORS_MAX) { return StatusType(HAL_ERROR); }
+	*rate = _header->rates[sensor];
+	return StatusType(0);
+}
+
+uint32_t ADXL345_ShmConsumer::Wait(int32_t timeoutMs) {
+	// The waiters count lives in the shared header.
+	std::atomic<uint32_t> *waiters = const_cast<std::atomic<uint32_t>*>(&_header->waiters);
+	uint32_t head = _header->head.load(std::memory_order_acquire);
+	if (head == _cursor && timeoutMs) {
+		struct timespec timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+		waiters->fetch_add(1, std::memory_order_seq_cst);
+		// Returns at once if head moved past _cursor since it was loaded.
+		Futex(&_header->head, FUTEX_WAIT, _cursor, timeoutMs < 0 ? nullptr : &timeout);
+		waiters->fetch_sub(1, std::memory_order_relaxed);
+		head = _header->head.load(std::memory_order_acquire);
+	}
+	return head - _cursor;
+}
+
+uint32_t ADXL345_ShmConsumer::Acquire(Span spans[2]) {
+	const uint32_t head = _header->head.load(std::memory_order_acquire);
+	const uint32_t capacity = _header->capacity;
+	uint32_t available = head - _cursor;
+	if (available > capacity) {
+		_lost += available - capacity;
+		_cursor = head - capacity;
+		available = capacity;
+	}
+	const uint32_t start = _cursor & (capacity - 1);
+	const uint32_t first = available < capacity - start ? available : capacity - start;
+	spans[0].frames = &_frames[start];
+	spans[0].count = first;
+	spans[1].frames = _frames;
+	spans[1].count = available - first;
+	_acquired = available;
+	return available;
+}
+
+bool ADXL345_ShmConsumer::Release() {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint32_t reserve = _header->reserve.load(std::memory_order_relaxed);
+	const uint32_t capacity = _header->capacity;
+	bool intact = true;
+	// Slots of sequences below reserve - capacity may have been rewritten.
+	if (reserve - _cursor > capacity) {
+		const uint32_t overwritten = reserve - capacity - _cursor;
+		_lost += overwritten < _acquired ? overwritten : _acquired;
+		intact = false;
+	}
+	_cursor += _acquired;
+	_acquired = 0;
+	return intact;
+}
@@ -0,0 +1,152 @@
+/*
+adxl345_shm.hpp - ADXL345 frame distribution through POSIX shared memory
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Linux only, see tools/adxl345_shmd.cpp for the publishing daemon.
+
+#ifndef ADXL345_SHM_HPP_
+#define ADXL345_SHM_HPP_
+
+#include <atomic>
+#include "adxl345_stream.hpp"
+
+// One published sample, 16 bytes.
+struct ADXL345_ShmFrame {
+	uint32_t timestamp;		// drain time of the block in us
+	uint32_t sample;		// stream index of the sample, see ADXL345_StreamMonitor::Block
+	uint8_t sensor;
+	uint8_t flags;			// ADXL345_StreamMonitor::FLAG_x of the block
+	int16_t data[3];		// raw sample or gap marker frame
+};
+
+// Start of the shared memory object, followed by the frame ring.
+// head counts published frames and wraps at 2^32, the frame with sequence s
+// is stored at s % capacity. It doubles as the futex word for wakeups.
+struct ADXL345_ShmHeader {
+	enum {
+		MAGIC			=	0x48535841,	// "AXSH"
+		VERSION			=	0x1,
+		SENSORS_MAX		=	8,
+	};
+	uint32_t magic;
+	uint16_t version;
+	uint16_t frameSize;
+	uint32_t capacity;					// frames, a power of two
+	uint8_t sensors;
+	uint8_t rates[SENSORS_MAX];			// VAL_BW_x of each sensor
+	uint8_t reserved[3];
+	std::atomic<uint32_t> head;			// sequence of the next frame
+	std::atomic<uint32_t> reserve;		// head plus the frames being written
+	std::atomic<uint32_t> waiters;		// consumers sleeping on head
+	uint8_t padding[28];
+};
+
+// Writes frames into the ring, a single publisher per ring.
+// Frames are never blocked by slow consumers, those detect the overwrite instead.
+class ADXL345_ShmPublisher {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	ADXL345_ShmPublisher()
+	:	_header (nullptr),
+		_frames (nullptr),
+		_mapped (0)
+	{}
+	~ADXL345_ShmPublisher() { Close(); }
+
+//	Bytes needed for a ring of capacity frames.
+	static uint32_t GetSize(uint32_t capacity) { return sizeof(ADXL345_ShmHeader) + capacity*sizeof(ADXL345_ShmFrame); }
+//	Creates or replaces the shared memory object name, e.g. "/adxl345".
+//	capacity has to be a power of two of at least ADXL345_Defs::FIFO_MAX + 1 frames,
+//	so one drain never overwrites itself. An existing object of the same size is
+//	reused, its magic is cleared first. One of another size is unlinked and created
+//	anew rather than resized, consumers that still map it keep valid memory.
+	StatusType Create(const char *name, uint32_t capacity, uint8_t sensors);
+//	Lays the ring out in caller-supplied memory of GetSize(capacity) bytes instead.
+	StatusType Init(void *memory, uint32_t capacity, uint8_t sensors);
+	void Close();
+
+//	Returns HAL_ERROR if sensor is not below the sensors given to Create().
+	StatusType SetRate(uint8_t sensor, uint8_t rate);
+//	Publishes the frames of one drained block and wakes the waiting consumers.
+//	Returns HAL_ERROR for an unknown sensor or a block of more than FIFO_MAX + 1 frames.
+	StatusType Publish(uint8_t sensor, const ADXL345_StreamMonitor::Block &block, const int16_t data[][3]);
+//	Same for the samples of a column block. A gap is published as a gap marker frame
+//	first, like Drain() inserts it. Returns HAL_ERROR for an unknown sensor or a block
+//	whose frames do not fit into the ring.
+	StatusType Publish(uint8_t sensor, const ADXL345_SampleBlock &block);
+	uint32_t GetHead() { return _header->head.load(std::memory_order_relaxed); }
+private:
+	ADXL345_ShmHeader *_header;
+	ADXL345_ShmFrame *_frames;
+	uint32_t _mapped;		// bytes mapped by Create(), 0 for Init()
+//	Announces frames about to be written and returns the sequence of the first one.
+	uint32_t _Reserve(uint32_t frames);
+//	Publishes the frames up to head and wakes the waiting consumers.
+	void _Commit(uint32_t head);
+};
+
+// Reads frames from the ring without copying them.
+// Acquire() hands out spans pointing into the shared ring, Release() tells
+// whether the publisher overwrote them meanwhile, in that case they have to be discarded.
+class ADXL345_ShmConsumer {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	struct Span {
+		const ADXL345_ShmFrame *frames;
+		uint32_t count;
+	};
+	ADXL345_ShmConsumer()
+	:	_header (nullptr),
+		_frames (nullptr),
+		_mapped (0)
+	{}
+	~ADXL345_ShmConsumer() { Close(); }
+
+//	Maps the shared memory object name and starts at the newest frame.
+//	Returns STATUS_INVALID_ID if the object is smaller than its header says.
+//	Only the waiters count in the header is ever written.
+	StatusType Open(const char *name);
+	StatusType Attach(const void *memory);
+	void Close();
+
+//	Moves back to the oldest frame still in the ring.
+	void Rewind();
+
+	uint8_t GetSensors() { return _header->sensors; }
+//	Returns HAL_ERROR if sensor is not below GetSensors() and SENSORS_MAX.
+	StatusType GetRate(uint8_t sensor, uint8_t *rate);
+//	Sleeps until frames are available or timeoutMs passed, a negative timeout waits forever.
+//	Returns the number of available frames.
+	uint32_t Wait(int32_t timeoutMs);
+//	Fills up to two spans (the ring may wrap) with all unread frames, returns their number.
+//	If the consumer fell more than capacity frames behind, the oldest are skipped and counted as lost.
+	uint32_t Acquire(Span spans[2]);
+//	Ends the use of the acquired frames. Returns false if any of them were overwritten
+//	while in use, they are counted as lost then.
+	bool Release();
+	uint32_t GetLost() { return _lost; }
+private:
+	const ADXL345_ShmHeader *_header;
+	const ADXL345_ShmFrame *_frames;
+	uint32_t _mapped;
+	uint32_t _cursor;		// sequence of the next unread frame
+	uint32_t _acquired;		// frames handed out by Acquire()
+	uint32_t _lost;
+};
+
+#endif /* ADXL345_SHM_HPP_ */
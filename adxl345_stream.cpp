@@ -0,0 +1,94 @@
+/*
+adxl345_stream.cpp - ADXL345 stream integrity tracking
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_stream.hpp"
+#include <math.h>
+
+void ADXL345_StreamMonitor::Reset() {
+	_started = false;
+	_lastDrain = 0;
+	_nextSample = 0;
+	_pendingGap = 0;
+	_stats.drains = 0;
+	_stats.samples = 0;
+	_stats.overruns = 0;
+	_stats.fullDrains = 0;
+	_stats.gaps = 0;
+	_stats.lostSamples = 0;
+}
+
+void ADXL345_StreamMonitor::Account(uint8_t intSource, uint8_t samples, uint32_t now, Block *block) {
+	uint8_t flags = 0;
+	uint32_t gap = 0;
+	if ((intSource >> ADXL345_Defs::BIT_INT_OVERRUN) & 1) {
+		flags |= FLAG_OVERRUN;
+		_stats.overruns++;
+	}
+	if (samples >= FIFO_DEPTH) {
+		flags |= FLAG_FIFO_FULL;
+		_stats.fullDrains++;
+	}
+	// The overrun bit proves a loss of at least one sample. A full FIFO alone lost
+	// nothing unless the elapsed time says so, one sample of difference is clock jitter.
+	if (flags & FLAG_OVERRUN) { gap = 1; }
+	if (flags && _started) {
+		const uint32_t elapsed = now - _lastDrain; // wraps correctly
+		const long excess = lrintf(float(elapsed) * _odr / 1e6f) - long(samples);
+		if (excess > long(gap) && (gap || excess > 1)) {
+			gap = uint32_t(excess);
+		}
+	}
+	gap += _pendingGap;
+	_pendingGap = 0;
+	if (gap) {
+		flags |= FLAG_GAP;
+		_stats.gaps++;
+		_stats.lostSamples += gap;
+	}
+	block->firstSample = _nextSample + gap;
+	block->timestamp = now;
+	block->gap = gap;
+	block->samples = samples;
+	block->frames = samples;
+	block->flags = flags;
+	block->intSource = intSource;
+	_nextSample += gap + samples;
+	_lastDrain = now;
+	_started = true;
+	_stats.drains++;
+	_stats.samples += samples;
+}
+
+void ADXL345_StreamMonitor::ChangeRate(uint8_t rate, uint32_t lost) {
+	SetRate(rate);
+	_pendingGap += lost;
+	_started = false;
+}
+
+void ADXL345_StreamMonitor::MakeGapFrame(uint32_t lostSamples, int16_t frame[3]) {
+	frame[0] = GAP_MARKER;
+	frame[1] = int16_t(lostSamples & 0xFFFF);
+	frame[2] = int16_t(lostSamples >> 16);
+}
+
+bool ADXL345_StreamMonitor::IsGapFrame(const int16_t frame[3], uint32_t *lostSamples) {
+	if (frame[0] != GAP_MARKER) { return false; }
+	*lostSamples = uint32_t(uint16_t(frame[1])) | (uint32_t(uint16_t(frame[2])) << 16);
+	return true;
+}
@@ -0,0 +1,164 @@
+/*
+adxl345_stream.hpp - ADXL345 stream integrity tracking
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_STREAM_HPP_
+#define ADXL345_STREAM_HPP_
+
+#include "adxl345_core.hpp"
+
+// Detects lost samples while streaming FIFO contents.
+// At every drain the INT_SOURCE overrun bit and the FIFO fill level are checked.
+// Samples are counted as lost if the overrun bit is set, or if the FIFO was full and
+// the time elapsed since the previous drain, at the output data rate, accounts for
+// more samples than were drained. The estimate also sizes the gap of an overrun.
+// Lost samples are reported per block and inserted into the frame stream
+// as a gap marker frame, so they survive in any recording of the frames.
+class ADXL345_StreamMonitor {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		FIFO_DEPTH		=	32,
+		FLAG_OVERRUN	=	0x01,		// INT_SOURCE overrun bit was set at drain time
+		FLAG_FIFO_FULL	=	0x02,		// the FIFO was full when drained, informational
+		FLAG_GAP		=	0x04,		// samples were lost before this block
+		GAP_MARKER		=	INT16_MIN,	// X value of a gap marker frame, conversions move real samples to INT16_MIN + 1
+	};
+
+	// Metadata of one drained block.
+	struct Block {
+		uint32_t firstSample;	// stream index of the first sample, lost samples count too
+		uint32_t timestamp;		// drain time in us, FirstSampleTime() estimates when the samples were acquired
+		uint32_t gap;			// estimated samples lost right before this block
+		uint8_t samples;		// number of samples drained
+		uint8_t frames;			// samples plus the gap marker frame, if any
+		uint8_t flags;			// FLAG_x
+		uint8_t intSource;		// INT_SOURCE value read at drain time
+	};
+
+	// Cumulative loss metrics since the last Reset().
+	struct Stats {
+		uint32_t drains;
+		uint32_t samples;
+		uint32_t overruns;		// drains with the overrun bit set
+		uint32_t fullDrains;	// drains that found the FIFO full
+		uint32_t gaps;			// drains with lost samples
+		uint32_t lostSamples;	// estimated
+	};
+
+	ADXL345_StreamMonitor(uint8_t rate = ADXL345_Defs::VAL_BW_50_Hz)
+	{ SetRate(rate); Reset(); }
+
+//	VAL_BW_x expected as argument, it must match the BW_RATE register.
+	void SetRate(uint8_t rate) {
+		_rate = ADXL345_Defs::FIELD_BW_RATE_RATE::Decode(rate);
+		_odr = ADXL345_Defs::OdrFromRate(rate);
+	}
+//	Continues the timeline at another rate after the FIFO was cleared, as done by
+//	ADXL345_Governor::Apply(). lost samples are reported as the gap of the next block,
+//	whose time based loss check is skipped because its interval spans both rates.
+	void ChangeRate(uint8_t rate, uint32_t lost);
+//	Restarts the stream timeline and clears the statistics.
+	void Reset();
+	void GetStats(Stats *stats) { *stats = _stats; }
+
+//	Accounts a drain of samples entries that was done at time now (us),
+//	intSource was read right before the drain.
+	void Account(uint8_t intSource, uint8_t samples, uint32_t now, Block *block);
+
+//	Reads INT_SOURCE and drains the FIFO of dev into data.
+//	If samples were lost, data[0] receives a gap marker frame followed by the samples.
+//	maxFrames should be at least ADXL345_Defs::FIFO_MAX + 1 to detect a full FIFO.
+	template <class Derived>
+	StatusType Drain(ADXL345_Core<Derived> *dev, int16_t data[][3], uint8_t maxFrames, uint32_t now, Block *block);
+
+//	Same into the columns of block, which is emptied first. Lost samples are reported
+//	in block->gap instead of a gap marker frame.
+	template <class Derived>
+	StatusType DrainBlock(ADXL345_Core<Derived> *dev, ADXL345_SampleBlock *block, uint32_t now);
+
+//	Estimated acquisition time of the oldest of samples FIFO entries drained at time drain.
+//	The newest entry was converted between zero and one period before the drain and is
+//	charged the expected half period, older entries one period earlier each.
+	static uint32_t FirstSampleTime(uint32_t drain, uint16_t samples, uint32_t periodNs) {
+		if (!samples) { return drain; }
+		return drain - uint32_t((uint64_t(periodNs) * (2 * uint32_t(samples) - 1)) / 2000);
+	}
+
+	static void MakeGapFrame(uint32_t lostSamples, int16_t frame[3]);
+//	Returns true if frame is a gap marker and extracts the lost sample count.
+	static bool IsGapFrame(const int16_t frame[3], uint32_t *lostSamples);
+private:
+	uint8_t _rate;
+	float _odr;
+	bool _started;
+	uint32_t _lastDrain;
+	uint32_t _nextSample;
+	uint32_t _pendingGap;	// lost samples announced by ChangeRate()
+	Stats _stats;
+};
+
+template <class Derived>
+ADXL345_StreamMonitor::StatusType ADXL345_StreamMonitor::Drain(ADXL345_Core<Derived> *dev, int16_t data[][3], uint8_t maxFrames, uint32_t now, Block *block) {
+	StatusType status;
+	uint8_t intSource;
+	uint8_t samples;
+	if (maxFrames < 2) { return ADXL345_Defs::STATUS_NO_MEMORY; }
+	status = dev->GetIntSource(&intSource);
+	if (status) { return status; }
+	// Slot 0 is kept free for the gap marker.
+	status = dev->GetFifoDataRaw(data + 1, maxFrames - 1, &samples);
+	if (status) { return status; }
+	Account(intSource, samples, now, block);
+	if (block->gap) {
+		MakeGapFrame(block->gap, data[0]);
+		block->frames = samples + 1;
+	}
+	else {
+		for (uint8_t i=0; i<samples; i++) {
+			data[i][0] = data[i+1][0];
+			data[i][1] = data[i+1][1];
+			data[i][2] = data[i+1][2];
+		}
+		block->frames = samples;
+	}
+	return StatusType(0);
+}
+
+template <class Derived>
+ADXL345_StreamMonitor::StatusType ADXL345_StreamMonitor::DrainBlock(ADXL345_Core<Derived> *dev, ADXL345_SampleBlock *block, uint32_t now) {
+	StatusType status;
+	uint8_t intSource;
+	uint8_t samples;
+	Block drained;
+	status = dev->GetIntSource(&intSource);
+	if (status) { return status; }
+	block->samples = 0;
+	status = dev->GetFifoDataBlock(block, &samples);
+	if (status) { return status; }
+	Account(intSource, samples, now, &drained);
+	block->firstSample = drained.firstSample;
+	block->timestamp = FirstSampleTime(now, samples, uint32_t(1e9f / _odr));
+	block->gap = drained.gap;
+	block->rate = _rate;
+	block->flags = drained.flags;
+	block->intSource = intSource;
+	return StatusType(0);
+}
+
+#endif /* ADXL345_STREAM_HPP_ */
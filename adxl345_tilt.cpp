@@ -0,0 +1,147 @@
+/*
+adxl345_tilt.cpp - Fixed-point ADXL345 tilt and orientation kernels
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_tilt.hpp"
+#include "adxl345_stream.hpp"
+
+// Vectors are handled with SCALE_BITS fractional bits, a length below 2^16
+// stays below 2^31 after the CORDIC gain of 1.647.
+static const uint8_t SCALE_BITS = 14;
+static const int32_t DEG_180 = 180L << 16;
+
+// atan(2^-i) in degrees with 16 fractional bits
+static const int32_t atanTable[ADXL345_Tilt::ITERATIONS] = {
+	2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335,
+	14668, 7334, 3667, 1833, 917, 458, 229, 115,
+};
+
+// Rotates (x, y) onto the positive x axis. Returns the angle of the vector in degrees
+// with 16 fractional bits, magnitude receives its length in the scale of the input.
+static int32_t Vectoring(int32_t x, int32_t y, int32_t *magnitude) {
+	int32_t angle = 0;
+	if (!x && !y) {
+		*magnitude = 0;
+		return 0;
+	}
+	if (x < 0) {
+		angle = y >= 0 ? DEG_180 : -DEG_180;
+		x = -x;
+		y = -y;
+	}
+	for (uint8_t i=0; i<ADXL345_Tilt::ITERATIONS; i++) {
+		const int32_t dx = y >> i;
+		const int32_t dy = x >> i;
+		if (y > 0) {
+			x += dx;
+			y -= dy;
+			angle += atanTable[i];
+		}
+		else {
+			x -= dx;
+			y += dy;
+			angle -= atanTable[i];
+		}
+	}
+	// 1/gain with 30 fractional bits
+	*magnitude = int32_t((uint64_t(uint32_t(x)) * 652032874ULL) >> 30);
+	return angle;
+}
+
+static int16_t ToAngleUnits(int32_t angle) {
+	return int16_t((int64_t(angle) * ADXL345_Tilt::ANGLE_SCALE + (angle >= 0 ? 32768 : -32768)) / 65536);
+}
+
+int16_t ADXL345_Tilt::Atan2(int32_t y, int32_t x, uint32_t *magnitude) {
+	int32_t m;
+	const int32_t angle = Vectoring(int32_t(uint32_t(x) << SCALE_BITS), int32_t(uint32_t(y) << SCALE_BITS), &m);
+	if (magnitude) { *magnitude = (uint32_t(m) + (1UL << (SCALE_BITS - 1))) >> SCALE_BITS; }
+	return ToAngleUnits(angle);
+}
+
+void ADXL345_Tilt::Compute(const int32_t vector[3], uint8_t shift, Angles *angles, int16_t unit[3]) {
+	const uint8_t up = SCALE_BITS - shift;
+	const int32_t x = int32_t(uint32_t(vector[0]) << up);
+	const int32_t y = int32_t(uint32_t(vector[1]) << up);
+	const int32_t z = int32_t(uint32_t(vector[2]) << up);
+	int32_t yz;
+	int32_t length;
+	if (!x && !y && !z) {
+		if (angles) { angles->pitch = angles->roll = 0; }
+		if (unit) { unit[0] = unit[1] = unit[2] = 0; }
+		return;
+	}
+	const int32_t roll = Vectoring(z, y, &yz);
+	const int32_t pitch = Vectoring(yz, -x, &length);
+	if (angles) {
+		angles->pitch = ToAngleUnits(pitch);
+		angles->roll = ToAngleUnits(roll);
+	}
+	if (!unit) { return; }
+	// One division per vector, with the length reduced to 16 significant bits
+	// UNIT * v / |v| = v * (2^(31+k) / (|v| * 2^SCALE_BITS)) / 2^(3+k).
+	uint8_t k = 0;
+	while ((uint32_t(length) >> k) >= 0x10000UL) { k++; }
+	const uint32_t reduced = uint32_t(length) >> k;
+	if (!reduced) {
+		unit[0] = unit[1] = unit[2] = 0;
+		return;
+	}
+	const uint32_t recip = 0x80000000UL / reduced;
+	const uint8_t down = 3 + k + shift;
+	unit[0] = int16_t((int64_t(vector[0]) * recip) >> down);
+	unit[1] = int16_t((int64_t(vector[1]) * recip) >> down);
+	unit[2] = int16_t((int64_t(vector[2]) * recip) >> down);
+}
+
+void ADXL345_Tilt::Compute(const int16_t data[][3], uint16_t samples, Angles angles[], int16_t unit[][3]) {
+	for (uint16_t i=0; i<samples; i++) {
+		const int32_t v[3] = { data[i][0], data[i][1], data[i][2] };
+		Compute(v, 0, angles ? &angles[i] : nullptr, unit ? unit[i] : nullptr);
+	}
+}
+
+void ADXL345_TiltFilter::Update(const int16_t data[][3], uint16_t samples, ADXL345_Tilt::Angles angles[]) {
+	for (uint16_t i=0; i<samples; i++) {
+		uint32_t lost;
+		if (ADXL345_StreamMonitor::IsGapFrame(data[i], &lost)) {
+			if (angles) { GetAngles(&angles[i]); }
+			continue;
+		}
+		for (uint8_t j=0; j<3; j++) {
+			const int32_t v = int32_t(data[i][j]) * (1 << FRACTION_BITS);
+			_g[j] = _started ? _g[j] + ((v - _g[j] + _round) >> _shift) : v;
+		}
+		_started = true;
+		if (angles) { GetAngles(&angles[i]); }
+	}
+}
+
+void ADXL345_TiltFilter::Update(const ADXL345_SampleBlock &block) {
+	if (!block.samples) { return; }
+	for (uint8_t j=0; j<3; j++) {
+		const int16_t *column = block.axis[j];
+		int32_t g = _started ? _g[j] : int32_t(column[0]) * (1 << FRACTION_BITS);
+		for (uint16_t i=0; i<block.samples; i++) {
+			const int32_t v = int32_t(column[i]) * (1 << FRACTION_BITS);
+			g += (v - g + _round) >> _shift;
+		}
+		_g[j] = g;
+	}
+	_started = true;
+}
@@ -0,0 +1,91 @@
+/*
+adxl345_tilt.hpp - Fixed-point ADXL345 tilt and orientation kernels
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_TILT_HPP_
+#define ADXL345_TILT_HPP_
+
+#include "adxl345_core.hpp"
+
+// Pitch, roll and the gravity direction of raw samples without floating point,
+// for parts without FPU. Angles come from two CORDIC vectoring passes of ITERATIONS
+// shift-add steps, (z, y) gives the roll and the length of the y/z projection,
+// (|yz|, -x) gives the pitch and the length of the whole vector for normalization.
+// Only the ratios of the axes matter, so any range and resolution works.
+// Error bounds against double precision for vectors of 4 to 4096 LSB, measured with
+// tools/adxl345_tiltbench.cpp: angles within 0.01 degree including the rounding
+// of the output, unit vector components within 2 / UNIT.
+class ADXL345_Tilt {
+public:
+	enum {
+		ITERATIONS		=	16,
+		ANGLE_SCALE		=	100,		// angle units per degree
+		UNIT			=	16384,		// length of a normalized vector, Q14
+	};
+
+	struct Angles {
+		int16_t pitch;			// rotation around y, -9000 to 9000
+		int16_t roll;			// rotation around x, -18000 to 18000
+	};
+
+//	atan2(y, x) in angle units. The length of (x, y) must be below 65536,
+//	magnitude receives it rounded if not nullptr.
+	static int16_t Atan2(int32_t y, int32_t x, uint32_t *magnitude = nullptr);
+//	Angles and unit gravity vectors of samples raw samples, either output may be nullptr.
+//	A zero sample gives zero angles and a zero vector.
+	static void Compute(const int16_t data[][3], uint16_t samples, Angles angles[], int16_t unit[][3]);
+//	Same for one vector with shift fractional bits, at most 14, its length must be below 65536 LSB.
+	static void Compute(const int32_t vector[3], uint8_t shift, Angles *angles, int16_t unit[3]);
+};
+
+// Tilt of a stream, smoothed by a complementary first order low-pass on the gravity vector:
+// g = g * (1 - 2^-shift) + sample * 2^-shift, a time constant of 2^shift samples.
+// The state keeps SHIFT_MAX fractional bits and every increment is rounded, so g settles
+// within half an LSB of a constant input for every shift.
+// Gap marker frames of ADXL345_StreamMonitor are skipped.
+class ADXL345_TiltFilter {
+public:
+	enum {
+		SHIFT_MAX		=	14,
+		FRACTION_BITS	=	SHIFT_MAX,	// fractional bits of the filter state, a full scale sample stays below 2^30
+	};
+
+	ADXL345_TiltFilter(uint8_t shift = 4)
+	:	_shift (shift > SHIFT_MAX ? uint8_t(SHIFT_MAX) : shift),
+		_round (_shift ? int32_t(1) << (_shift - 1) : 0)
+	{ Reset(); }
+
+//	The next sample starts the filter.
+	void Reset() {
+		_started = false;
+		_g[0] = _g[1] = _g[2] = 0;
+	}
+//	Filters samples, angles receives the smoothed tilt after every sample if not nullptr.
+	void Update(const int16_t data[][3], uint16_t samples, ADXL345_Tilt::Angles angles[] = nullptr);
+//	Filters the samples of block one axis after the other.
+	void Update(const ADXL345_SampleBlock &block);
+	void GetAngles(ADXL345_Tilt::Angles *angles) { ADXL345_Tilt::Compute(_g, FRACTION_BITS, angles, nullptr); }
+	void GetGravity(int16_t unit[3]) { ADXL345_Tilt::Compute(_g, FRACTION_BITS, nullptr, unit); }
+private:
+	uint8_t _shift;
+	int32_t _round;		// half of 2^shift, rounds the increment to nearest
+	bool _started;
+	int32_t _g[3];		// raw LSB with FRACTION_BITS fractional bits
+};
+
+#endif /* ADXL345_TILT_HPP_ */
@@ -0,0 +1,70 @@
+/*
+adxl345_trace.cpp - ADXL345 bus transaction tracer
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_trace.hpp"
+
+static void PutU32(uint8_t *p, uint32_t v) {
+	p[0] = uint8_t(v);
+	p[1] = uint8_t(v >> 8);
+	p[2] = uint8_t(v >> 16);
+	p[3] = uint8_t(v >> 24);
+}
+
+void ADXL345_Tracer::Add(uint32_t start, uint8_t reg, bool write, const uint8_t data[], uint8_t n, uint8_t status) {
+	const uint32_t end = _clock();
+	if (!_enabled || !_capacity) { return; }
+	ADXL345_TraceEntry *e = &_entries[_head];
+	e->start = start;
+	e->end = end;
+	e->reg = reg;
+	e->info = (write ? ADXL345_TraceEntry::INFO_WRITE : 0) | (n & ADXL345_TraceEntry::INFO_N_MASK);
+	e->status = status;
+	for (uint8_t i=0; i<ADXL345_Defs::BUFFER_MAX; i++) {
+		e->data[i] = i < n ? data[i] : 0;
+	}
+	e->reserved[0] = 0;
+	e->reserved[1] = 0;
+	e->reserved[2] = 0;
+	_head = _head + 1 == _capacity ? 0 : _head + 1;
+	if (_count < _capacity) { _count++; }
+	else { _dropped++; }
+}
+
+void ADXL345_Tracer::Dump(Writer writer, void *context) {
+	uint8_t header[20] = { 'A', 'X', 'T', 'R', FORMAT_VERSION, sizeof(ADXL345_TraceEntry), 0, 0 };
+	PutU32(header + 8, _clockHz);
+	PutU32(header + 12, _count);
+	PutU32(header + 16, _dropped);
+	writer(context, header, sizeof(header));
+	uint32_t i = _count < _capacity ? 0 : _head;
+	for (uint32_t k=0; k<_count; k++) {
+		const ADXL345_TraceEntry *e = &_entries[i];
+		uint8_t raw[sizeof(ADXL345_TraceEntry)] = { 0 };
+		PutU32(raw, e->start);
+		PutU32(raw + 4, e->end);
+		raw[8] = e->reg;
+		raw[9] = e->info;
+		raw[10] = e->status;
+		for (uint8_t j=0; j<ADXL345_Defs::BUFFER_MAX; j++) {
+			raw[11+j] = e->data[j];
+		}
+		writer(context, raw, sizeof(raw));
+		i = i + 1 == _capacity ? 0 : i + 1;
+	}
+}
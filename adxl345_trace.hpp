@@ -0,0 +1,119 @@
+/*
+adxl345_trace.hpp - ADXL345 bus transaction tracer
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_TRACE_HPP_
+#define ADXL345_TRACE_HPP_
+
+#include "adxl345_core.hpp"
+
+// One traced transfer, 20 bytes.
+struct ADXL345_TraceEntry {
+	enum {
+		INFO_WRITE		=	0x80,	// set for writes
+		INFO_N_MASK		=	0x07,	// number of bytes transferred
+	};
+	uint32_t start;			// cycle counter at the start of the transfer
+	uint32_t end;			// cycle counter at the end of the transfer
+	uint8_t reg;
+	uint8_t info;			// INFO_x
+	uint8_t status;
+	uint8_t data[ADXL345_Defs::BUFFER_MAX];
+	uint8_t reserved[3];
+};
+
+// Ring of trace entries, the oldest ones are overwritten.
+// Dump() writes the ring oldest first in the format read by tools/adxl345_trace.cpp:
+//	"AXTR", uint8_t version, uint8_t entry size, uint16_t reserved,
+//	uint32_t cycles per second, uint32_t entry count, uint32_t dropped entries,
+//	followed by the entries, all little-endian.
+class ADXL345_Tracer {
+public:
+	typedef uint32_t (*Clock)();
+	typedef void (*Writer)(void *context, const uint8_t data[], uint32_t n);
+	enum {
+		FORMAT_VERSION	=	0x1,
+	};
+//	clock is a free running cycle counter, e.g. DWT->CYCCNT, running at clockHz.
+	ADXL345_Tracer(ADXL345_TraceEntry entries[], uint32_t capacity, Clock clock, uint32_t clockHz)
+	:	_entries (entries),
+		_capacity (capacity),
+		_clock (clock),
+		_clockHz (clockHz),
+		_enabled (true)
+	{ Clear(); }
+
+	void Enable(bool enabled) { _enabled = enabled; }
+	void Clear() { _head = 0; _count = 0; _dropped = 0; }
+	uint32_t GetCount() { return _count; }
+	uint32_t GetDropped() { return _dropped; }
+	uint32_t Now() { return _clock(); }
+	void Add(uint32_t start, uint8_t reg, bool write, const uint8_t data[], uint8_t n, uint8_t status);
+	void Dump(Writer writer, void *context);
+private:
+	ADXL345_TraceEntry *_entries;
+	uint32_t _capacity;
+	Clock _clock;
+	uint32_t _clockHz;
+	bool _enabled;
+	uint32_t _head;		// next entry to write
+	uint32_t _count;
+	uint32_t _dropped;
+};
+
+// Transport policy tracing every transfer of Bus into an ADXL345_Tracer.
+// Compiles to the plain Bus calls plus two clock reads.
+template <class Bus>
+class ADXL345_TraceBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	ADXL345_TraceBus(const Bus &bus, ADXL345_Tracer *tracer)
+	:	_bus (bus),
+		_tracer (tracer)
+	{}
+	StatusType WriteTo(uint8_t reg, uint8_t val) {
+		const uint32_t start = _tracer->Now();
+		const StatusType status = _bus.WriteTo(reg, val);
+		_tracer->Add(start, reg, true, &val, 1, status);
+		return status;
+	}
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+		const uint32_t start = _tracer->Now();
+		const StatusType status = _bus.WriteTo(reg, data, n);
+		_tracer->Add(start, reg, true, data, n, status);
+		return status;
+	}
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) {
+		const uint32_t start = _tracer->Now();
+		const StatusType status = _bus.ReadFrom(reg, val);
+		_tracer->Add(start, reg, false, val, 1, status);
+		return status;
+	}
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) {
+		const uint32_t start = _tracer->Now();
+		const StatusType status = _bus.ReadFrom(reg, data, n);
+		_tracer->Add(start, reg, false, data, n, status);
+		return status;
+	}
+	Bus *GetBus() { return &_bus; }
+private:
+	Bus _bus;
+	ADXL345_Tracer *_tracer;
+};
+
+#endif /* ADXL345_TRACE_HPP_ */
@@ -0,0 +1,131 @@
+/*
+adxl345_tuner.cpp - ADXL345 FIFO watermark tuning and bus feasibility check
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "adxl345_tuner.hpp"
+
+float ADXL345_WatermarkTuner::TransferUs(const Setup &setup, uint8_t n) {
+	uint32_t bits;
+	if (setup.bus == BUS_SPI) {
+		// Command byte, then the data bytes.
+		bits = 8 * (1 + uint32_t(n));
+	}
+	else {
+		// Start, address, register, repeated start, address, data bytes, stop; 9 bits per byte with ACK.
+		bits = 1 + 9 + 9 + 1 + 9 + 9 * uint32_t(n) + 1;
+	}
+	return bits * 1e6f / setup.clock + setup.transactionUs;
+}
+
+uint8_t ADXL345_WatermarkTuner::_Check(float periodUs, float fixedUs, float entryUs, float late, uint32_t targetUs, uint8_t w) {
+	const float entries = w + late;
+	const float drainUs = fixedUs + entries * entryUs;
+	if (entries * periodUs + drainUs > targetUs) { return REASON_LATENCY; }
+	// Entries keep arriving while the drain runs.
+	if (entries + drainUs / periodUs > int(ADXL345_StreamMonitor::FIFO_DEPTH) - int(HEADROOM)) { return REASON_HEADROOM; }
+	if (drainUs * 100 > entries * periodUs * float(LOAD_MAX)) { return REASON_BANDWIDTH; }
+	return REASON_NONE;
+}
+
+ADXL345_WatermarkTuner::StatusType ADXL345_WatermarkTuner::Evaluate(const Setup &setup, Plan *plan) {
+	Plan p = {0, REASON_NONE, 0.0f, 0, 0};
+	const uint8_t rate = ADXL345_Defs::FIELD_BW_RATE_RATE::Decode(setup.rate);
+	if (!setup.clock || setup.clock > (setup.bus == BUS_SPI ? uint32_t(SPI_CLOCK_MAX) : uint32_t(I2C_CLOCK_MAX))) {
+		p.reason = REASON_BUS_CLOCK;
+	}
+	else {
+		const float periodUs = 1e6f / ADXL345_Defs::OdrFromRate(rate);
+		const float fixedUs = 2 * TransferUs(setup, 1);
+		const float entryUs = TransferUs(setup, 6);
+		const float late = setup.responseUs / periodUs;
+		for (uint8_t w=WATERMARK_MAX; w>0; w--) {
+			if (_Check(periodUs, fixedUs, entryUs, late, setup.targetUs, w) == REASON_NONE) {
+				const float entries = w + late;
+				const float drainUs = fixedUs + entries * entryUs;
+				p.watermark = w;
+				p.load = drainUs / (entries * periodUs);
+				p.drainUs = uint32_t(drainUs + 0.5f);
+				p.latencyUs = uint32_t(entries * periodUs + drainUs + 0.5f);
+				break;
+			}
+		}
+		if (!p.watermark) {
+			// If the smallest watermark meets latency and headroom, the larger ones needed
+			// to amortize the register reads do not.
+			p.reason = _Check(periodUs, fixedUs, entryUs, late, setup.targetUs, 1);
+			if (p.reason == REASON_NONE) { p.reason = REASON_BANDWIDTH; }
+		}
+	}
+	if (plan) { *plan = p; }
+	return p.reason == REASON_NONE ? StatusType(0) : StatusType(ADXL345_Defs::STATUS_INFEASIBLE);
+}
+
+ADXL345_WatermarkTuner::StatusType ADXL345_WatermarkTuner::Configure(const Setup &setup, Plan *plan) {
+	Plan p;
+	StatusType status = Evaluate(setup, &p);
+	if (plan) { *plan = p; }
+	if (status) { return status; }
+	_setup = setup;
+	_periodUs = 1e6f / ADXL345_Defs::OdrFromRate(setup.rate);
+	_fixedUs = 2 * TransferUs(setup, 1);
+	_entryUs = TransferUs(setup, 6);
+	_late = setup.responseUs / _periodUs;
+	_watermark = p.watermark;
+	_clean = 0;
+	_overruns = 0;
+	return StatusType(0);
+}
+
+bool ADXL345_WatermarkTuner::Update(const ADXL345_StreamMonitor::Block &block, uint32_t drainUs) {
+	if (!_watermark) { return false; }
+	if (block.samples) {
+		// Exponential smoothing over 8 drains. The register reads are taken from the model,
+		// the rest of the drain time is spread over the entries.
+		float entryUs = (drainUs - _fixedUs) / block.samples;
+		if (entryUs < 0.0f) { entryUs = 0.0f; }
+		const float late = block.samples > _watermark ? float(block.samples - _watermark) : 0.0f;
+		_entryUs += (entryUs - _entryUs) / 8;
+		_late += (late - _late) / 8;
+	}
+	if (block.flags & (ADXL345_StreamMonitor::FLAG_OVERRUN | ADXL345_StreamMonitor::FLAG_GAP)) {
+		const uint8_t step = _watermark >= 8 ? _watermark / 4 : 1;
+		const uint8_t previous = _watermark;
+		_overruns++;
+		_clean = 0;
+		if (_watermark > step) { _watermark -= step; }
+		else { _watermark = 1; }
+		return _watermark != previous;
+	}
+	if (_Check(_periodUs, _fixedUs, _entryUs, _late, _setup.targetUs, _watermark) != REASON_NONE) {
+		// Step down at once, to the largest watermark that still fits.
+		uint8_t w = _watermark - 1;
+		while (w > 1 && _Check(_periodUs, _fixedUs, _entryUs, _late, _setup.targetUs, w) != REASON_NONE) { w--; }
+		_clean = 0;
+		if (w < 1) { return false; }
+		_watermark = w;
+		return true;
+	}
+	if (_watermark < WATERMARK_MAX && ++_clean >= CLEAN_DRAINS) {
+		_clean = 0;
+		if (_Check(_periodUs, _fixedUs, _entryUs, _late, _setup.targetUs, _watermark + 1) == REASON_NONE) {
+			_watermark++;
+			return true;
+		}
+	}
+	return false;
+}
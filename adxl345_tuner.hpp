@@ -0,0 +1,120 @@
+/*
+adxl345_tuner.hpp - ADXL345 FIFO watermark tuning and bus feasibility check
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADXL345_TUNER_HPP_
+#define ADXL345_TUNER_HPP_
+
+#include "adxl345_stream.hpp"
+
+// Chooses the FIFO watermark for an output data rate, a bus and a latency target.
+// A drain as done by ADXL345_StreamMonitor::Drain() costs two register reads
+// (INT_SOURCE and FIFO_STATUS) plus one 6 byte read per entry. With the watermark W
+// and the sample period T the tuner requires
+//	bus load		(2 register reads + W entry reads) / (W * T) <= LOAD_MAX %
+//	latency			W * T + response + drain time <= target, the age of the oldest sample
+//	FIFO headroom	entries at the end of the drain <= FIFO_DEPTH - HEADROOM
+// and picks the largest W that meets all three, which costs the fewest interrupts.
+// Configurations without such a W, or above the bus clocks of the datasheet, are rejected
+// with STATUS_INFEASIBLE. The datasheet's advice of SPI at 2 MHz or more for 1600 Hz and
+// 3200 Hz is about polling DATAxx, where a read can straddle an update; the FIFO holds
+// settled entries, so for drains the bus model decides.
+// At runtime Update() replaces the modelled costs with the measured drain time and the
+// entries found beyond the watermark, lowers the watermark on overruns or as soon as the
+// measurements no longer meet the requirements, and raises it again one step per
+// CLEAN_DRAINS drains without overrun while they do.
+class ADXL345_WatermarkTuner {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	enum {
+		BUS_I2C			=	0x0,
+		BUS_SPI			=	0x1,
+
+		REASON_NONE		=	0x0,
+		REASON_BUS_CLOCK	=	0x1,	// the clock is above the bus maximum of the ADXL345
+		REASON_RATE		=	0x2,	// no longer returned, FIFO drains at 1600 Hz and 3200 Hz are judged by the bus model
+		REASON_BANDWIDTH	=	0x3,	// the bus load exceeds LOAD_MAX even at the highest watermark
+		REASON_LATENCY	=	0x4,	// even a watermark of 1 misses the latency target
+		REASON_HEADROOM	=	0x5,	// the FIFO fills up during the interrupt response and the drain
+
+		LOAD_MAX		=	80,			// % of the bus time drains may take
+		HEADROOM		=	2,			// FIFO entries kept free at the end of a drain
+		WATERMARK_MAX	=	31,
+		CLEAN_DRAINS	=	64,			// drains without overrun before the watermark is raised
+	};
+	// Enum with possibly larger constants.
+	enum {
+		I2C_CLOCK_MAX	=	400000,
+		SPI_CLOCK_MAX	=	5000000,
+		SPI_CLOCK_FAST	=	2000000,	// datasheet minimum for polling DATAxx at the two highest rates
+	};
+
+	struct Setup {
+		uint8_t rate;				// VAL_BW_x
+		uint8_t bus;				// BUS_x
+		uint32_t clock;				// bus clock in Hz
+		uint16_t transactionUs;		// software overhead per bus transaction
+		uint16_t responseUs;		// worst time from the watermark interrupt to the start of the drain
+		uint32_t targetUs;			// maximum age of a sample when its drain is complete
+	};
+
+	struct Plan {
+		uint8_t watermark;			// value for SetFifoSamples()
+		uint8_t reason;				// REASON_x, why the setup was rejected
+		float load;					// fraction of the bus time spent draining
+		uint32_t drainUs;			// duration of one drain at the watermark
+		uint32_t latencyUs;			// age of the oldest sample when its drain is complete
+	};
+
+	ADXL345_WatermarkTuner()
+	:	_watermark (0)
+	{}
+
+//	Bus time of one read transaction of n data bytes, transactionUs included.
+	static float TransferUs(const Setup &setup, uint8_t n);
+//	Checks setup and plans the watermark. Returns STATUS_INFEASIBLE with plan->reason
+//	set if the bus cannot sustain it. plan may be nullptr.
+	static StatusType Evaluate(const Setup &setup, Plan *plan);
+
+//	Evaluates setup and makes it the one tuned at runtime.
+	StatusType Configure(const Setup &setup, Plan *plan = nullptr);
+//	Feeds a drained block and the time the drain took in us.
+//	Returns true if the watermark changed and should be written by Apply().
+	bool Update(const ADXL345_StreamMonitor::Block &block, uint32_t drainUs);
+	template <class Derived>
+	StatusType Apply(ADXL345_Core<Derived> *dev) { return dev->SetFifoSamples(_watermark); }
+
+	uint8_t GetWatermark() { return _watermark; }
+	uint32_t GetOverruns() { return _overruns; }
+//	Measured drain time per entry and entries found beyond the watermark, smoothed.
+	float GetEntryUs() { return _entryUs; }
+	float GetLateEntries() { return _late; }
+private:
+//	REASON_x of the first requirement watermark w fails, late entries are drained too.
+	static uint8_t _Check(float periodUs, float fixedUs, float entryUs, float late, uint32_t targetUs, uint8_t w);
+	Setup _setup;
+	float _periodUs;
+	float _fixedUs;				// register reads of a drain
+	float _entryUs;
+	float _late;
+	uint8_t _watermark;
+	uint16_t _clean;
+	uint32_t _overruns;
+};
+
+#endif /* ADXL345_TUNER_HPP_ */
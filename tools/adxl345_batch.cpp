@@ -0,0 +1,100 @@
+/*
+adxl345_batch.cpp - Summarizes many ADXL345 capture files in parallel
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host tool, build with
+//	g++ -std=c++11 -O2 -pthread -I. -Itools/host tools/adxl345_batch.cpp adxl345_analysis.cpp -o adxl345_batch
+// Usage: adxl345_batch [-j threads] dir|capture.bin...
+//	Directories are searched for *.bin captures, not recursively.
+
+#include "adxl345_analysis.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static void AddPath(const string &path, vector<string> *paths) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+		paths->push_back(path);
+		return;
+	}
+	DIR *dir = opendir(path.c_str());
+	if (!dir) { return; }
+	vector<string> found;
+	while (struct dirent *e = readdir(dir)) {
+		const size_t len = strlen(e->d_name);
+		if (len > 4 && !strcmp(e->d_name + len - 4, ".bin")) {
+			found.push_back(path + "/" + e->d_name);
+		}
+	}
+	closedir(dir);
+	sort(found.begin(), found.end());
+	paths->insert(paths->end(), found.begin(), found.end());
+}
+
+int main(int argc, char *argv[]) {
+	unsigned threads = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:")) != -1) {
+		switch (opt) {
+		case 'j': threads = strtoul(optarg, nullptr, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-j threads] dir|capture.bin...\n", argv[0]);
+			return 2;
+		}
+	}
+	vector<string> paths;
+	for (int i=optind; i<argc; i++) {
+		AddPath(argv[i], &paths);
+	}
+	if (paths.empty()) {
+		fprintf(stderr, "no captures\n");
+		return 2;
+	}
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<ADXL345_Analysis::Result> results;
+	ADXL345_Analysis::Run(paths, threads, &results);
+	const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	int failed = 0;
+	uint64_t samples = 0;
+	printf("%-32s %10s %8s %22s %22s %22s\n", "file", "samples", "seconds", "mean x/y/z [g]", "rms x/y/z [g]", "peak x/y/z [Hz]");
+	for (size_t i=0; i<results.size(); i++) {
+		const ADXL345_Analysis::Result &r = results[i];
+		if (!r.ok) {
+			printf("%-32s %s\n", r.path.c_str(), r.error.c_str());
+			failed++;
+			continue;
+		}
+		samples += r.samples;
+		printf("%-32s %10llu %8.2f %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f %7.1f %7.1f %7.1f\n",
+			r.path.c_str(), (unsigned long long)r.samples, r.seconds,
+			r.mean[0], r.mean[1], r.mean[2], r.rms[0], r.rms[1], r.rms[2],
+			r.peakHz[0], r.peakHz[1], r.peakHz[2]);
+	}
+	fprintf(stderr, "%zu files, %llu samples in %.3f s\n", results.size(), (unsigned long long)samples, elapsed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+/*
+adxl345_bench.cpp - Host micro-benchmarks of the ADXL345 driver hot paths
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host tool, build with
+//	g++ -std=c++11 -O2 -I. -Itools/host -DADXL345_NO_HAL tools/adxl345_bench.cpp adxl345.cpp adxl345_stream.cpp
+//		adxl345_governor.cpp adxl345_pyramid.cpp adxl345_detect.cpp adxl345_tilt.cpp adxl345_align.cpp -o adxl345_bench
+// Usage: adxl345_bench [-t ms] [-o results.json]
+//	Runs every case for about ms milliseconds (default 50) and writes JSON:
+//	conversion	ns per sample of the raw conversion, GetDataRaw() and GetData() for all
+//				16 range/resolution/justification combinations of DATA_FORMAT
+//	drain		ns per sample and bus cost of a full FIFO drain, template and virtual transport,
+//				interleaved and into an ADXL345_SampleBlock
+//	calls		bus transactions and bytes of public API calls, a byte is the register
+//				address or a data byte, bus addressing is not counted
+//	kernels		ns per sample of the processing classes
+// The bus is a register file in memory, so the times are the CPU cost of the driver
+// without the transfer time of a real bus.
+// Exits with 1 if the block drain reads more than FIFO_MAX entries for a corrupt FIFO_STATUS.
+
+#include "adxl345.hpp"
+#include "adxl345_align.hpp"
+#include "adxl345_detect.hpp"
+#include "adxl345_governor.hpp"
+#include "adxl345_pyramid.hpp"
+#include "adxl345_stream.hpp"
+#include "adxl345_tilt.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+struct BusCounters {
+	uint32_t transactions;
+	uint32_t bytes;
+};
+
+// Transport policy on a register file. The FIFO always holds fifoEntries samples
+// of a slowly changing signal, reading DATAX0 returns the next one.
+class BenchBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	explicit BenchBus(BusCounters *counters)
+	:	_counters (counters),
+		_sample (0),
+		_fifoEntries (ADXL345_Defs::FIFO_MAX)
+	{
+		for (int i=0; i<64; i++) { _regs[i] = 0; }
+		_regs[ADXL345_Defs::REG_DEVID] = ADXL345_Defs::VAL_DEVICE_ID;
+		_regs[ADXL345_Defs::REG_BW_RATE] = ADXL345_Defs::VAL_BW_50_Hz;
+	}
+	StatusType WriteTo(uint8_t reg, uint8_t val) { return WriteTo(reg, &val, 1); }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+		_Count(n);
+		for (uint8_t i=0; i<n; i++) { _regs[(reg + i) & 0x3F] = data[i]; }
+		return StatusType(0);
+	}
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) { return ReadFrom(reg, val, 1); }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) {
+		_Count(n);
+		if (reg == ADXL345_Defs::REG_DATAX0) { _NextSample(); }
+		if (reg == ADXL345_Defs::REG_FIFO_STATUS) { _regs[reg] = _fifoEntries; }
+		for (uint8_t i=0; i<n; i++) { data[i] = _regs[(reg + i) & 0x3F]; }
+		return StatusType(0);
+	}
+	void SetFifoEntries(uint8_t entries) { _fifoEntries = entries; }
+private:
+	void _Count(uint8_t n) {
+		_counters->transactions++;
+		_counters->bytes += 1 + n;
+	}
+	void _NextSample() {
+		_sample++;
+		const int16_t v[3] = { int16_t(_sample & 0x3FF), int16_t(-(_sample & 0x1FF)), int16_t(256 + (_sample & 0x7F)) };
+		for (int i=0; i<3; i++) {
+			_regs[ADXL345_Defs::REG_DATAX0 + 2*i] = uint8_t(v[i]);
+			_regs[ADXL345_Defs::REG_DATAX0 + 2*i + 1] = uint8_t(uint16_t(v[i]) >> 8);
+		}
+	}
+	BusCounters *_counters;
+	uint32_t _sample;
+	uint8_t _fifoEntries;
+	uint8_t _regs[64];
+};
+
+// The same bus behind the virtual interface
+class BenchDevice : public ADXL345 {
+public:
+	explicit BenchDevice(BusCounters *counters)
+	:	ADXL345(),
+		_bus (counters)
+	{}
+	BenchBus *GetBus() { return &_bus; }
+private:
+	virtual StatusType _WriteTo(uint8_t reg, uint8_t val)						{ return _bus.WriteTo(reg, val); }
+	virtual StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return _bus.WriteTo(reg, data, n); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t *val)						{ return _bus.ReadFrom(reg, val); }
+	virtual StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)		{ return _bus.ReadFrom(reg, data, n); }
+	BenchBus _bus;
+};
+
+typedef ADXL345T<BenchBus> BenchDeviceT;
+
+static double runMs = 50.0;
+static volatile int32_t sink;
+
+// Calls op until runMs passed, returns ns per unit, op processes units units per call.
+static double Measure(const function<void()> &op, double units) {
+	typedef chrono::steady_clock Clock;
+	uint64_t calls = 0;
+	uint64_t batch = 1;
+	const Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	while (elapsed < runMs * 1e6) {
+		for (uint64_t i=0; i<batch; i++) { op(); }
+		calls += batch;
+		batch *= 2;
+		elapsed = chrono::duration<double, nano>(Clock::now() - start).count();
+	}
+	return elapsed / (double(calls) * units);
+}
+
+struct Cost {
+	const char *call;
+	BusCounters bus;
+};
+
+template <class Device>
+static BusCounters Count(BusCounters *counters, Device *dev, const function<void(Device*)> &call) {
+	counters->transactions = 0;
+	counters->bytes = 0;
+	call(dev);
+	return *counters;
+}
+
+int main(int argc, char *argv[]) {
+	const char *output = nullptr;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:o:")) != -1) {
+		switch (opt) {
+		case 't': runMs = atof(optarg); break;
+		case 'o': output = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t ms] [-o results.json]\n", argv[0]);
+			return 2;
+		}
+	}
+	FILE *f = output ? fopen(output, "w") : stdout;
+	if (!f) {
+		fprintf(stderr, "cannot write %s\n", output);
+		return 1;
+	}
+
+	BusCounters counters = { 0, 0 };
+	BenchDeviceT dev((BenchBus(&counters)));
+	BenchDevice vdev(&counters);
+
+	fprintf(f, "{\n\t\"benchmark\": \"adxl345\",\n\t\"format\": 1,\n\t\"compiler\": \"%s\",\n\t\"run_ms\": %.0f,\n", __VERSION__, runMs);
+
+	// DATA_FORMAT combinations
+	fprintf(f, "\t\"conversion\": [\n");
+	for (uint8_t i=0; i<16; i++) {
+		const uint8_t range = i & 3;
+		const bool fullRes = (i >> 2) & 1;
+		const bool leftJustify = (i >> 3) & 1;
+		const uint8_t dataFormat = ADXL345_Defs::FIELD_DATA_FORMAT_RANGE::Encode(range)
+			| ADXL345_Defs::FIELD_DATA_FORMAT_FULL_RES::Encode(fullRes)
+			| ADXL345_Defs::FIELD_DATA_FORMAT_JUSTIFY_LEFT::Encode(leftJustify);
+		dev.SetDataFormat(dataFormat);
+		uint8_t buffer[6] = { 0x12, 0x34, 0x56, 0xF8, 0x9A, 0x01 };
+		const double kernel = Measure([&] {
+			int16_t raw[3];
+			ADXL345_Defs::RawFromBuffer(dataFormat, buffer, raw);
+			buffer[0]++;
+			sink += raw[0] + raw[1] + raw[2];
+		}, 1);
+		const double raw = Measure([&] {
+			int16_t data[3];
+			dev.GetDataRaw(data);
+			sink += data[0];
+		}, 1);
+		const double scaled = Measure([&] {
+			float data[3];
+			dev.GetData(data);
+			sink += int32_t(data[0]);
+		}, 1);
+		fprintf(f, "\t\t{ \"data_format\": \"0x%02X\", \"range\": %u, \"full_res\": %s, \"left_justify\": %s, "
+			"\"raw_kernel_ns\": %.2f, \"get_data_raw_ns\": %.2f, \"get_data_ns\": %.2f }%s\n",
+			dataFormat, range, fullRes ? "true" : "false", leftJustify ? "true" : "false",
+			kernel, raw, scaled, i < 15 ? "," : "");
+	}
+	fprintf(f, "\t],\n");
+	dev.SetDataFormat(ADXL345_Defs::FIELD_DATA_FORMAT_FULL_RES::Encode(true));
+	vdev.SetDataFormat(ADXL345_Defs::FIELD_DATA_FORMAT_FULL_RES::Encode(true));
+
+	// Full FIFO drains
+	fprintf(f, "\t\"drain\": [\n");
+	{
+		int16_t data[ADXL345_Defs::FIFO_MAX+1][3];
+		uint8_t entries;
+		const double fifo = ADXL345_Defs::FIFO_MAX;
+		BusCounters t = Count<BenchDeviceT>(&counters, &dev, [&](BenchDeviceT *d) { d->GetFifoDataRaw(data, ADXL345_Defs::FIFO_MAX, &entries); });
+		const double tNs = Measure([&] { dev.GetFifoDataRaw(data, ADXL345_Defs::FIFO_MAX, &entries); }, fifo);
+		BusCounters v = Count<BenchDevice>(&counters, &vdev, [&](BenchDevice *d) { d->GetFifoDataRaw(data, ADXL345_Defs::FIFO_MAX, &entries); });
+		const double vNs = Measure([&] { vdev.GetFifoDataRaw(data, ADXL345_Defs::FIFO_MAX, &entries); }, fifo);
+		ADXL345_StreamMonitor monitor(ADXL345_Defs::VAL_BW_1600_Hz);
+		ADXL345_StreamMonitor::Block block;
+		// A full FIFO is drained every 33 samples at 3200 Hz, so no samples are lost.
+		const uint32_t periodUs = 10312;
+		uint32_t now = 0;
+		BusCounters m = Count<BenchDeviceT>(&counters, &dev, [&](BenchDeviceT *d) { monitor.Drain(d, data, ADXL345_Defs::FIFO_MAX+1, now, &block); });
+		const double mNs = Measure([&] { monitor.Drain(&dev, data, ADXL345_Defs::FIFO_MAX+1, now += periodUs, &block); }, fifo);
+		fprintf(f, "\t\t{ \"api\": \"GetFifoDataRaw\", \"transport\": \"template\", \"entries\": %d, \"ns_per_sample\": %.2f, \"transactions\": %u, \"bytes\": %u },\n",
+			int(ADXL345_Defs::FIFO_MAX), tNs, t.transactions, t.bytes);
+		fprintf(f, "\t\t{ \"api\": \"GetFifoDataRaw\", \"transport\": \"virtual\", \"entries\": %d, \"ns_per_sample\": %.2f, \"transactions\": %u, \"bytes\": %u },\n",
+			int(ADXL345_Defs::FIFO_MAX), vNs, v.transactions, v.bytes);
+		ADXL345_SampleBlock columns;
+		BusCounters c = Count<BenchDeviceT>(&counters, &dev, [&](BenchDeviceT *d) { monitor.DrainBlock(d, &columns, now); });
+		const double cNs = Measure([&] { monitor.DrainBlock(&dev, &columns, now += periodUs); }, fifo);
+		fprintf(f, "\t\t{ \"api\": \"ADXL345_StreamMonitor::Drain\", \"transport\": \"template\", \"entries\": %d, \"ns_per_sample\": %.2f, \"transactions\": %u, \"bytes\": %u },\n",
+			int(ADXL345_Defs::FIFO_MAX), mNs, m.transactions, m.bytes);
+		fprintf(f, "\t\t{ \"api\": \"ADXL345_StreamMonitor::DrainBlock\", \"transport\": \"template\", \"entries\": %d, \"ns_per_sample\": %.2f, \"transactions\": %u, \"bytes\": %u }\n",
+			int(ADXL345_Defs::FIFO_MAX), cNs, c.transactions, c.bytes);
+	}
+	fprintf(f, "\t],\n");
+
+	// A corrupt FIFO_STATUS with all entry bits set must not drain more than the FIFO holds.
+	{
+		ADXL345_SampleBlock columns;
+		uint8_t entries;
+		columns.samples = 0;
+		dev.GetTransport()->SetFifoEntries(0xFF);
+		const BusCounters c = Count<BenchDeviceT>(&counters, &dev, [&](BenchDeviceT *d) { d->GetFifoDataBlock(&columns, &entries); });
+		dev.GetTransport()->SetFifoEntries(ADXL345_Defs::FIFO_MAX);
+		if (entries != ADXL345_Defs::FIFO_MAX || columns.samples != ADXL345_Defs::FIFO_MAX
+			|| c.bytes != 2u + (1u + 6u) * ADXL345_Defs::FIFO_MAX) {
+			fprintf(stderr, "GetFifoDataBlock drained %u entries, %u bytes, for a FIFO_STATUS of 0xFF\n", entries, c.bytes);
+			return 1;
+		}
+	}
+
+	// Bus cost of single calls
+	typedef ADXL345_Defs D;
+	typedef function<void(BenchDeviceT*)> Call;
+	const struct { const char *name; Call call; } calls[] = {
+		{ "CheckDeviceID",		[](BenchDeviceT *d) { d->CheckDeviceID(); } },
+		{ "SetMeasure",			[](BenchDeviceT *d) { d->SetMeasure(true); } },
+		{ "SetRate",			[](BenchDeviceT *d) { d->SetRate(D::VAL_BW_100_Hz); } },
+		{ "SetBwRate",			[](BenchDeviceT *d) { d->SetBwRate(D::VAL_BW_100_Hz); } },
+		{ "SetLowPower",		[](BenchDeviceT *d) { d->SetLowPower(true); } },
+		{ "SetDataFormat",		[](BenchDeviceT *d) { d->SetDataFormat(D::FIELD_DATA_FORMAT_FULL_RES::Encode(true)); } },
+		{ "SetRange",			[](BenchDeviceT *d) { d->SetRange(D::VAL_RANGE_4G); } },
+		{ "SetFifoCtl",			[](BenchDeviceT *d) { d->SetFifoCtl(0x9F); } },
+		{ "SetFifoMode",		[](BenchDeviceT *d) { d->SetFifoMode(D::VAL_FIFO_MODE_STREAM); } },
+		{ "SetFifoSamples",		[](BenchDeviceT *d) { d->SetFifoSamples(16); } },
+		{ "SetFields<FIFO_CTL_MODE,FIFO_CTL_SAMPLES>",
+								[](BenchDeviceT *d) { d->SetFields<D::FIELD_FIFO_CTL_MODE, D::FIELD_FIFO_CTL_SAMPLES>(D::VAL_FIFO_MODE_STREAM, 16); } },
+		{ "SetIntEnable",		[](BenchDeviceT *d) { d->SetIntEnable(0x80); } },
+		{ "GetIntSource",		[](BenchDeviceT *d) { uint8_t v; d->GetIntSource(&v); } },
+		{ "GetFifoEntries",		[](BenchDeviceT *d) { uint8_t v; d->GetFifoEntries(&v); } },
+		{ "GetDataRaw",			[](BenchDeviceT *d) { int16_t v[3]; d->GetDataRaw(v); } },
+		{ "GetData",			[](BenchDeviceT *d) { float v[3]; d->GetData(v); } },
+		{ "SetOffset",			[](BenchDeviceT *d) { const float v[3] = { 0.0f, 0.0f, 0.0f }; d->SetOffset(v); } },
+	};
+	const size_t callCount = sizeof(calls) / sizeof(calls[0]);
+	fprintf(f, "\t\"calls\": [\n");
+	for (size_t i=0; i<callCount; i++) {
+		const BusCounters c = Count<BenchDeviceT>(&counters, &dev, calls[i].call);
+		fprintf(f, "\t\t{ \"call\": \"%s\", \"transactions\": %u, \"bytes\": %u }%s\n",
+			calls[i].name, c.transactions, c.bytes, i + 1 < callCount ? "," : "");
+	}
+	fprintf(f, "\t],\n");
+
+	// Processing kernels on one block of 32 samples
+	const uint8_t blockSize = 32;
+	int16_t block[blockSize][3];
+	for (uint8_t i=0; i<blockSize; i++) {
+		block[i][0] = int16_t((i * 37) % 200 - 100);
+		block[i][1] = int16_t((i * 53) % 120 - 60);
+		block[i][2] = int16_t(256 + (i * 11) % 40);
+	}
+	fprintf(f, "\t\"kernels\": [\n");
+	{
+		ADXL345_Detector detector;
+		uint8_t id;
+		const ADXL345_Detector::Rule rules[3] = {
+			{ ADXL345_Detector::RULE_PEAK, ADXL345_Detector::AXIS_ALL, 3, 300.0f },
+			{ ADXL345_Detector::RULE_JERK, ADXL345_Detector::AXIS_ALL | ADXL345_Detector::AXIS_MAGNITUDE, 8, 400.0f },
+			{ ADXL345_Detector::RULE_RMS, ADXL345_Detector::AXIS_ALL, 64, 200.0f },
+		};
+		for (int i=0; i<3; i++) { detector.AddRule(rules[i], &id); }
+		ADXL345_Detector::Event events[8];
+		const double detect = Measure([&] { sink += detector.Process(block, blockSize, events, 8); }, blockSize);
+
+		static uint64_t memory[ADXL345_Pyramid::GetSize(20, 64) / 8];
+		ADXL345_Pyramid pyramid;
+		pyramid.Init(memory, 20, 64, ADXL345_Defs::VAL_BW_100_Hz);
+		const double pyr = Measure([&] { pyramid.Append(block, blockSize); }, blockSize);
+
+		ADXL345_Tilt::Angles angles[blockSize];
+		int16_t unit[blockSize][3];
+		const double tilt = Measure([&] { ADXL345_Tilt::Compute(block, blockSize, angles, unit); sink += angles[0].pitch; }, blockSize);
+		ADXL345_TiltFilter tiltFilter(4);
+		const double filter = Measure([&] { tiltFilter.Update(block, blockSize); }, blockSize);
+
+		const ADXL345_Governor::Profile idle = { ADXL345_Defs::VAL_BW_12_5_Hz, true, 8 };
+		const ADXL345_Governor::Profile active = { ADXL345_Defs::VAL_BW_400_Hz, false, 16 };
+		ADXL345_Governor governor(idle, active, 80.0f, 20.0f, 4);
+		const double gov = Measure([&] { sink += governor.Evaluate(0, block, blockSize); }, blockSize);
+
+		ADXL345_Aligner aligner(2, ADXL345_Defs::VAL_BW_50_Hz, ADXL345_Defs::OdrFromRate(ADXL345_Defs::VAL_BW_50_Hz));
+		ADXL345_StreamMonitor::Block b;
+		b.firstSample = 0;
+		b.samples = blockSize;
+		b.frames = blockSize;
+		b.gap = 0;
+		b.flags = 0;
+		b.intSource = 0;
+		int16_t aligned[2 * 64][3];
+		const double periodUs = 1e6 / ADXL345_Defs::OdrFromRate(ADXL345_Defs::VAL_BW_50_Hz);
+		const double align = Measure([&] {
+			b.timestamp = uint32_t((b.firstSample + blockSize) * periodUs);
+			aligner.Push(0, block, b);
+			aligner.Push(1, block, b);
+			b.firstSample += blockSize;
+			sink += aligner.Pull(aligned, 64);
+		}, blockSize * 2);
+
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_Detector::Process\", \"rules\": 3, \"ns_per_sample\": %.2f },\n", detect);
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_Pyramid::Append\", \"levels\": 20, \"ns_per_sample\": %.2f },\n", pyr);
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_Tilt::Compute\", \"ns_per_sample\": %.2f },\n", tilt);
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_TiltFilter::Update\", \"ns_per_sample\": %.2f },\n", filter);
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_Governor::Evaluate\", \"ns_per_sample\": %.2f },\n", gov);
+		fprintf(f, "\t\t{ \"name\": \"ADXL345_Aligner::Push+Pull\", \"devices\": 2, \"ns_per_sample\": %.2f }\n", align);
+	}
+	fprintf(f, "\t]\n}\n");
+	if (output) { fclose(f); }
+	return 0;
+}
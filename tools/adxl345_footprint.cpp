@@ -0,0 +1,159 @@
+/*
+adxl345_footprint.cpp - Probe of the ADXL345 register API for the footprint report
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Compiled, not linked, by tools/adxl345_footprint.sh once per feature selection.
+// Every method of the enabled groups is called once, so the object holds exactly
+// the code an application using all of them gets. The bus is a set of external
+// functions, which keeps the compiler from folding the calls away.
+
+#include "adxl345_core.hpp"
+
+extern "C" {
+ADXL345_Defs::StatusType adxl345_footprint_write(uint8_t reg, const uint8_t data[], uint8_t n);
+ADXL345_Defs::StatusType adxl345_footprint_read(uint8_t reg, uint8_t data[], uint8_t n);
+}
+
+class FootprintDevice : public ADXL345_Core<FootprintDevice> {
+private:
+	friend class ADXL345_Core<FootprintDevice>;
+	StatusType _WriteTo(uint8_t reg, uint8_t val)						{ return adxl345_footprint_write(reg, &val, 1); }
+	StatusType _WriteTo(uint8_t reg, const uint8_t data[], uint8_t n)	{ return adxl345_footprint_write(reg, data, n); }
+	StatusType _ReadFrom(uint8_t reg, uint8_t *val)						{ return adxl345_footprint_read(reg, val, 1); }
+	StatusType _ReadFrom(uint8_t reg, uint8_t data[], uint8_t n)		{ return adxl345_footprint_read(reg, data, n); }
+};
+
+// Arguments come from here, so no call is specialised on constants.
+extern volatile uint8_t adxl345_footprint_u8;
+
+void adxl345_footprint_core(FootprintDevice *dev) {
+	uint8_t u;
+	bool b;
+	int16_t raw[3];
+	const uint8_t v = adxl345_footprint_u8;
+	dev->CheckDeviceID();
+	dev->SetBwRate(v);			dev->GetBwRate(&u);
+	dev->SetLowPower(v);		dev->GetLowPower(&b);
+	dev->SetRate(v);			dev->GetRate(&u);
+	dev->SetPowerCtl(v);		dev->GetPowerCtl(&u);
+	dev->SetLink(v);			dev->GetLink(&b);
+	dev->SetAutoSleep(v);		dev->GetAutoSleep(&b);
+	dev->SetMeasure(v);			dev->GetMeasure(&b);
+	dev->SetSleep(v);			dev->GetSleep(&b);
+	dev->SetWakeup(v);			dev->GetWakeup(&u);
+	dev->SetIntEnable(v);		dev->GetIntEnable(&u);
+	dev->SetIntMap(v);			dev->GetIntMap(&u);
+	dev->GetIntSource(&u);
+	dev->SetDataFormat(v);		dev->RefreshDataFormat();
+	dev->SetSelfTest(v);		dev->GetSelfTest(&b);
+	dev->SetSPI3Wire(v);		dev->GetSPI3Wire(&b);
+	dev->SetIntActiveLow(v);	dev->GetIntActiveLow(&b);
+	dev->SetFullRes(v);			dev->GetFullRes(&b);
+	dev->SetLeftJustify(v);		dev->GetLeftJustify(&b);
+	dev->SetRange(v);			dev->GetRange(&u);
+	dev->GetDataRaw(raw);
+}
+
+#if ADXL345_FEATURE_TAP
+void adxl345_footprint_tap(FootprintDevice *dev) {
+	uint8_t u;
+	const uint8_t v = adxl345_footprint_u8;
+	dev->SetThreshTapRaw(v);	dev->GetThreshTapRaw(&u);
+	dev->SetTapDurRaw(v);		dev->GetTapDurRaw(&u);
+	dev->SetTapLatencyRaw(v);	dev->GetTapLatencyRaw(&u);
+	dev->SetTapWindowRaw(v);	dev->GetTapWindowRaw(&u);
+	dev->SetTapAxes(v);			dev->GetTapAxes(&u);
+	dev->GetActTapStatus(&u);
+#if ADXL345_FEATURE_FLOAT
+	float f;
+	dev->SetThreshTap(v);		dev->GetThreshTap(&f);
+	dev->SetTapDur(v);			dev->GetTapDur(&f);
+	dev->SetTapLatency(v);		dev->GetTapLatency(&f);
+	dev->SetTapWindow(v);		dev->GetTapWindow(&f);
+#endif
+}
+#endif
+
+#if ADXL345_FEATURE_ACTIVITY
+void adxl345_footprint_activity(FootprintDevice *dev) {
+	uint8_t u;
+	bool b;
+	const uint8_t v = adxl345_footprint_u8;
+	dev->SetThreshActRaw(v);	dev->GetThreshActRaw(&u);
+	dev->SetThreshInactRaw(v);	dev->GetThreshInactRaw(&u);
+	dev->SetTimeInact(v);		dev->GetTimeInact(&u);
+	dev->SetActInactCtl(v);		dev->GetActInactCtl(&u);
+	dev->GetActTapStatus(&u);
+	dev->GetAsleep(&b);
+#if ADXL345_FEATURE_FLOAT
+	float f;
+	dev->SetThreshAct(v);		dev->GetThreshAct(&f);
+	dev->SetThreshInact(v);		dev->GetThreshInact(&f);
+#endif
+}
+#endif
+
+#if ADXL345_FEATURE_FREEFALL
+void adxl345_footprint_freefall(FootprintDevice *dev) {
+	uint8_t u;
+	unsigned t;
+	const uint8_t v = adxl345_footprint_u8;
+	dev->SetThreshFFRaw(v);		dev->GetThreshFFRaw(&u);
+	dev->SetTimeFFRaw(v);		dev->GetTimeFFRaw(&u);
+	dev->SetTimeFF(v);			dev->GetTimeFF(&t);
+#if ADXL345_FEATURE_FLOAT
+	float f;
+	dev->SetThreshFF(v);		dev->GetThreshFF(&f);
+#endif
+}
+#endif
+
+#if ADXL345_FEATURE_OFFSET
+void adxl345_footprint_offset(FootprintDevice *dev) {
+	int8_t raw[3] = { int8_t(adxl345_footprint_u8), 0, 0 };
+	dev->SetOffsetRaw(raw);		dev->GetOffsetRaw(raw);
+#if ADXL345_FEATURE_FLOAT
+	float f[3] = { float(adxl345_footprint_u8), 0.0f, 0.0f };
+	dev->SetOffset(f);			dev->GetOffset(f);
+#endif
+}
+#endif
+
+#if ADXL345_FEATURE_FIFO
+void adxl345_footprint_fifo(FootprintDevice *dev, int16_t data[][3]) {
+	uint8_t u;
+	bool b;
+	const uint8_t v = adxl345_footprint_u8;
+	dev->GetFifoDataRaw(data, v, &u);
+	dev->SetFifoCtl(v);			dev->GetFifoCtl(&u);
+	dev->SetFifoMode(v);		dev->GetFifoMode(&u);
+	dev->SetFifoTriggerInt2(v);	dev->GetFifoTriggerInt2(&b);
+	dev->SetFifoSamples(v);		dev->GetFifoSamples(&u);
+	dev->GetFifoStatus(&u);
+	dev->GetFifoTrig(&b);
+	dev->GetFifoEntries(&u);
+}
+#endif
+
+#if ADXL345_FEATURE_FLOAT
+void adxl345_footprint_float(FootprintDevice *dev, float data[3]) {
+	dev->SetGain(data);
+	dev->GetGain(data);
+	dev->GetData(data);
+}
+#endif
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# adxl345_footprint.sh - Flash and RAM of the ADXL345 feature groups and modules
+#
+# Copyright (C) 2021  NANDLAB
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+# Usage, from the repository root: tools/adxl345_footprint.sh [target...]
+#	targets are m0plus (Cortex-M0+, soft float) and m4 (Cortex-M4F, hard float),
+#	both by default, or host for the native compiler.
+# CXX and SIZE select the tools, arm-none-eabi-g++ and arm-none-eabi-size by default.
+# Objects are compiled with -Os -ffunction-sections -fdata-sections and measured with
+# size, without linking, so nothing depends on LTO or on what the linker drops.
+#	flash	text + data bytes
+#	ram		data + bss bytes
+# Register groups are measured with tools/adxl345_footprint.cpp, which calls every method
+# of the enabled groups. "core" has all ADXL345_FEATURE_x at 0, "all" at 1, and each
+# group row is what setting that group to 0 saves against "all". The float rows of the
+# other groups are part of both their group and float.
+# Modules are measured as their own objects with all groups enabled. Their templates
+# that instantiate ADXL345_Core methods are not included, those are counted above.
+
+CXX=${CXX:-arm-none-eabi-g++}
+SIZE=${SIZE:-arm-none-eabi-size}
+CXXFLAGS="-std=gnu++20 -Os -Wall -Wextra -ffunction-sections -fdata-sections -fno-exceptions -fno-rtti -I. -Itools/host -DADXL345_NO_HAL"
+GROUPS="FLOAT TAP ACTIVITY FREEFALL OFFSET FIFO"
+MODULES="adxl345.cpp:virtual adxl345_async.cpp:async adxl345_pingpong.cpp:async
+	adxl345_stream.cpp:fifo adxl345_capture.cpp:fifo adxl345_governor.cpp:fifo adxl345_pool.cpp:fifo
+	adxl345_trace.cpp:instrumentation adxl345_replay.cpp:instrumentation adxl345_latency.cpp:instrumentation
+	adxl345_tuner.cpp:instrumentation adxl345_energy.cpp:instrumentation
+	adxl345_pyramid.cpp:dsp adxl345_detect.cpp:dsp adxl345_tilt.cpp:dsp adxl345_align.cpp:dsp adxl345_envelope.cpp:dsp
+	adxl345_anomaly.cpp:dsp"
+
+if [ ! -f adxl345_core.hpp ]; then
+	echo "run from the repository root" >&2
+	exit 1
+fi
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# Prints "flash ram" of the object compiled from $1 with the remaining flags, or "- -".
+# Compiler diagnostics go to stderr, a failed compile also makes the script fail.
+measure() {
+	src=$1
+	shift
+	if $CXX $CXXFLAGS $TARGET_FLAGS "$@" -c "$src" -o "$TMP/m.o" 2> "$TMP/err"; then
+		cat "$TMP/err" >&2
+		$SIZE "$TMP/m.o" | awk 'NR == 2 { print $1 + $2, $2 + $3 }'
+	else
+		echo "$src $*: compile failed" >&2
+		cat "$TMP/err" >&2
+		touch "$TMP/failed"
+		echo "- -"
+	fi
+}
+
+row() {
+	printf "  %-22s %-16s %8s %8s\n" "$1" "$2" "$3" "$4"
+}
+
+# Difference of two "flash ram" pairs.
+delta() {
+	echo "$1 $2" | awk '{ if ($1 == "-" || $3 == "-") print "- -"; else print $1 - $3, $2 - $4 }'
+}
+
+[ $# -eq 0 ] && set -- m0plus m4
+for target in "$@"; do
+	case $target in
+	m0plus)	TARGET_FLAGS="-mcpu=cortex-m0plus -mthumb -mfloat-abi=soft" ;;
+	m4)		TARGET_FLAGS="-mcpu=cortex-m4 -mthumb -mfloat-abi=hard -mfpu=fpv4-sp-d16" ;;
+	host)	TARGET_FLAGS="" ;;
+	*)		echo "unknown target $target" >&2; exit 1 ;;
+	esac
+	echo "$target ($CXX $TARGET_FLAGS)"
+	row "" "" "flash" "ram"
+	all=$(measure tools/adxl345_footprint.cpp)
+	row "core" "register API" $(measure tools/adxl345_footprint.cpp -DADXL345_FEATURE_DEFAULT=0)
+	for group in $GROUPS; do
+		without=$(measure tools/adxl345_footprint.cpp -DADXL345_FEATURE_$group=0)
+		row "$(echo $group | tr 'A-Z' 'a-z')" "register API" $(delta "$all" "$without")
+	done
+	row "all" "register API" $all
+	for module in $MODULES; do
+		row "${module%%:*}" "${module##*:}" $(measure "${module%%:*}")
+	done
+	echo
+done
+# measure runs in a subshell, so failures are passed on through a file.
+[ -f "$TMP/failed" ] && exit 1
+exit 0
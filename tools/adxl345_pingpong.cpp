@@ -0,0 +1,320 @@
+/*
+adxl345_pingpong.cpp - Host simulation of ADXL345_PingPong streaming over a timed bus
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host tool, build with
+//	g++ -std=c++20 -O2 -I. -Itools/host -DADXL345_NO_HAL tools/adxl345_pingpong.cpp adxl345.cpp
+//		adxl345_pingpong.cpp adxl345_tuner.cpp adxl345_stream.cpp -o adxl345_pingpong
+// Usage: adxl345_pingpong [-b i2c|spi] [-c clock] [-r rate] [-w watermark] [-n samples]
+//			[-o overhead] [-l latency] [-p processing] [-s seconds]
+//	Runs the real ADXL345_PingPong against a simulated sensor in simulated time:
+//	the FIFO fills at the output data rate of rate (VAL_BW_x, default 0xF = 3200 Hz),
+//	every transfer takes its I2C or SPI bit time at clock Hz (default I2C at 400 kHz)
+//	plus overhead us (default 5) of DMA setup and completion interrupt, the watermark
+//	interrupt is handled latency us (default 10) after its edge, and the consumer
+//	holds each buffer of samples samples (default 256) for processing us (default 20000).
+//	Every sample carries its index, the consumer checks that the stream is continuous.
+//	Prints the plan of ADXL345_WatermarkTuner and the result, exits with 1 on any gap.
+
+#include "adxl345.hpp"
+#include "adxl345_pingpong.hpp"
+#include "adxl345_tuner.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Sensor FIFO in stream mode on a ns timeline.
+// Sample k holds k in X and Y (low and high 10 bits, as 10 bit values) and 256 in Z.
+class SimSensor {
+public:
+	enum {
+		DEPTH	=	32,
+	};
+	SimSensor()
+	:	_now (0),
+		_periodNs (0),
+		_nextNs (0),
+		_count (0),
+		_head (0),
+		_produced (0),
+		_overrun (false),
+		_lost (0)
+	{
+		for (unsigned i=0; i<sizeof(_regs); i++) { _regs[i] = 0; }
+		_regs[ADXL345_Defs::REG_BW_RATE] = ADXL345_Defs::VAL_BW_50_Hz;
+	}
+	int64_t Now() { return _now; }
+	int64_t NextSample() { return _periodNs ? _nextNs : INT64_MAX; }
+	// Advances the time to t, converting samples on the way.
+	void AdvanceTo(int64_t t) {
+		while (_periodNs && _nextNs <= t) {
+			_now = _nextNs;
+			_Convert();
+			_nextNs += _periodNs;
+		}
+		_now = t;
+	}
+	uint8_t Entries() { return uint8_t(_count); }
+	bool WatermarkLine() {
+		const uint8_t w = ADXL345_Defs::FIELD_FIFO_CTL_SAMPLES::Decode(_regs[ADXL345_Defs::REG_FIFO_CTL]);
+		return _Mode() == ADXL345_Defs::VAL_FIFO_MODE_STREAM && _count >= w && w;
+	}
+	uint32_t GetLost() { return _lost; }
+
+	void Write(uint8_t reg, uint8_t val) {
+		_regs[reg] = val;
+		if (reg == ADXL345_Defs::REG_FIFO_CTL && _Mode() == ADXL345_Defs::VAL_FIFO_MODE_BYPASS) {
+			_count = 0;
+			_overrun = false;
+		}
+		if (reg == ADXL345_Defs::REG_POWER_CTL || reg == ADXL345_Defs::REG_BW_RATE) {
+			const bool measure = ADXL345_Defs::FIELD_POWER_CTL_MEASURE::Decode(_regs[ADXL345_Defs::REG_POWER_CTL]);
+			const int64_t period = int64_t(1e9 / ADXL345_Defs::OdrFromRate(_regs[ADXL345_Defs::REG_BW_RATE]) + 0.5);
+			if (measure && !_periodNs) { _nextNs = _now + period; }
+			_periodNs = measure ? period : 0;
+		}
+	}
+	void Read(uint8_t reg, uint8_t data[], uint8_t n) {
+		if (reg == ADXL345_Defs::REG_DATAX0) {
+			// One multi-byte read of DATAX0 pops one entry.
+			int16_t v[3] = { 0, 0, 0 };
+			if (_count) {
+				const uint32_t k = _fifo[_head];
+				v[0] = int16_t(k & 0x3FF) - 512;
+				v[1] = int16_t((k >> 10) & 0x3FF) - 512;
+				v[2] = 256;
+				_head = (_head + 1) % DEPTH;
+				_count--;
+			}
+			for (uint8_t i=0; i<n && i<6; i++) {
+				data[i] = uint8_t(uint16_t(v[i/2]) >> (8 * (i & 1)));
+			}
+			return;
+		}
+		for (uint8_t i=0; i<n; i++) {
+			const uint8_t r = reg + i;
+			if (r == ADXL345_Defs::REG_FIFO_STATUS) { data[i] = uint8_t(_count); }
+			else if (r == ADXL345_Defs::REG_INT_SOURCE) {
+				data[i] = (WatermarkLine() << ADXL345_Defs::BIT_INT_WATERMARK) | (_overrun << ADXL345_Defs::BIT_INT_OVERRUN);
+				_overrun = false;
+			}
+			else { data[i] = _regs[r]; }
+		}
+	}
+private:
+	uint8_t _Mode() { return ADXL345_Defs::FIELD_FIFO_CTL_MODE::Decode(_regs[ADXL345_Defs::REG_FIFO_CTL]); }
+	void _Convert() {
+		if (_Mode() == ADXL345_Defs::VAL_FIFO_MODE_BYPASS) { _count = 0; _produced++; return; }
+		if (_count == DEPTH) {
+			// Stream mode drops the oldest entry.
+			_head = (_head + 1) % DEPTH;
+			_count--;
+			_overrun = true;
+			_lost++;
+		}
+		_fifo[(_head + _count) % DEPTH] = _produced++;
+		_count++;
+	}
+	int64_t _now;
+	int64_t _periodNs;
+	int64_t _nextNs;
+	uint32_t _count;
+	uint32_t _head;
+	uint32_t _produced;
+	bool _overrun;
+	uint32_t _lost;
+	uint32_t _fifo[DEPTH];
+	uint8_t _regs[0x40];
+};
+
+static SimSensor sensor;
+
+// Blocking register access for Start() and Stop(), without bus time.
+class SimBus {
+public:
+	typedef ADXL345_Defs::StatusType StatusType;
+	StatusType WriteTo(uint8_t reg, uint8_t val) { sensor.Write(reg, val); return 0; }
+	StatusType WriteTo(uint8_t reg, const uint8_t data[], uint8_t n) {
+		for (uint8_t i=0; i<n; i++) { sensor.Write(reg + i, data[i]); }
+		return 0;
+	}
+	StatusType ReadFrom(uint8_t reg, uint8_t *val) { sensor.Read(reg, val, 1); return 0; }
+	StatusType ReadFrom(uint8_t reg, uint8_t data[], uint8_t n) { sensor.Read(reg, data, n); return 0; }
+};
+
+// Non-blocking transfers that complete after their bus time.
+class SimTransport : public ADXL345_AsyncTransport {
+public:
+	SimTransport(bool spi, uint32_t clock, uint32_t overheadNs)
+	:	_spi (spi),
+		_clock (clock),
+		_overheadNs (overheadNs),
+		_busy (false),
+		_busyNs (0)
+	{}
+	virtual StatusType StartRead(uint8_t reg, uint8_t data[], uint8_t n, Callback callback, void *context) {
+		return _Start(reg, data, n, false, callback, context);
+	}
+	virtual StatusType StartWrite(uint8_t reg, const uint8_t data[], uint8_t n, Callback callback, void *context) {
+		return _Start(reg, const_cast<uint8_t*>(data), n, true, callback, context);
+	}
+	int64_t Completion() { return _busy ? _done : INT64_MAX; }
+	// The data is sampled at the end of the transfer.
+	void Complete() {
+		_busy = false;
+		if (_write) {
+			for (uint8_t i=0; i<_n; i++) { sensor.Write(_reg + i, _data[i]); }
+		}
+		else {
+			sensor.Read(_reg, _data, _n);
+		}
+		_callback(_context, 0);
+	}
+	double GetBusyNs() { return _busyNs; }
+private:
+	StatusType _Start(uint8_t reg, uint8_t data[], uint8_t n, bool write, Callback callback, void *context) {
+		if (_busy) { return HAL_BUSY; }
+		const uint32_t bits = _spi ? 8 * (1 + n) : 30 + 9 * n;
+		const int64_t ns = int64_t(bits * 1e9 / _clock) + _overheadNs;
+		_busy = true;
+		_done = sensor.Now() + ns;
+		_busyNs += ns;
+		_reg = reg;
+		_data = data;
+		_n = n;
+		_write = write;
+		_callback = callback;
+		_context = context;
+		return 0;
+	}
+	bool _spi;
+	uint32_t _clock;
+	uint32_t _overheadNs;
+	bool _busy;
+	int64_t _done;
+	double _busyNs;
+	uint8_t _reg;
+	uint8_t *_data;
+	uint8_t _n;
+	bool _write;
+	Callback _callback;
+	void *_context;
+};
+
+int main(int argc, char *argv[]) {
+	bool spi = false;
+	uint32_t clock = 0;
+	uint8_t rate = 0xF;
+	uint8_t watermark = 0;
+	uint16_t samples = 256;
+	uint32_t overheadUs = 5;
+	uint32_t latencyUs = 10;
+	uint32_t processingUs = 20000;
+	double seconds = 10.0;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:c:r:w:n:o:l:p:s:")) != -1) {
+		switch (opt) {
+		case 'b': spi = optarg[0] == 's'; break;
+		case 'c': clock = strtoul(optarg, nullptr, 0); break;
+		case 'r': rate = uint8_t(strtoul(optarg, nullptr, 0)); break;
+		case 'w': watermark = uint8_t(strtoul(optarg, nullptr, 0)); break;
+		case 'n': samples = uint16_t(strtoul(optarg, nullptr, 0)); break;
+		case 'o': overheadUs = strtoul(optarg, nullptr, 0); break;
+		case 'l': latencyUs = strtoul(optarg, nullptr, 0); break;
+		case 'p': processingUs = strtoul(optarg, nullptr, 0); break;
+		case 's': seconds = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-b i2c|spi] [-c clock] [-r rate] [-w watermark] [-n samples] [-o overhead] [-l latency] [-p processing] [-s seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!clock) { clock = spi ? 5000000 : 400000; }
+	const float odr = ADXL345_Defs::OdrFromRate(rate);
+
+	ADXL345_WatermarkTuner::Setup setup = {
+		rate, uint8_t(spi ? ADXL345_WatermarkTuner::BUS_SPI : ADXL345_WatermarkTuner::BUS_I2C),
+		clock, uint16_t(overheadUs), uint16_t(latencyUs), uint32_t(1e6f * samples / odr)
+	};
+	ADXL345_WatermarkTuner::Plan plan;
+	const ADXL345_WatermarkTuner::StatusType feasible = ADXL345_WatermarkTuner::Evaluate(setup, &plan);
+	printf("%s at %u Hz, %.0f Hz: tuner %s, reason %u, watermark %u, load %.0f %%, drain %u us\n",
+			spi ? "SPI" : "I2C", clock, odr, feasible ? "rejects" : "accepts",
+			plan.reason, plan.watermark, plan.load * 100, plan.drainUs);
+	if (!watermark) { watermark = plan.watermark ? plan.watermark : 16; }
+
+	vector<int16_t> ping(3 * samples), pong(3 * samples);
+	SimTransport transport(spi, clock, overheadUs * 1000);
+	ADXL345_PingPong stream(&transport, reinterpret_cast<int16_t(*)[3]>(ping.data()), reinterpret_cast<int16_t(*)[3]>(pong.data()), samples);
+	ADXL345T<SimBus> dev((SimBus()));
+	if (stream.Start(&dev, rate, watermark)) {
+		fprintf(stderr, "start failed\n");
+		return 2;
+	}
+
+	const int64_t end = int64_t(seconds * 1e9);
+	const int64_t latencyNs = int64_t(latencyUs) * 1000;
+	bool line = sensor.WatermarkLine();
+	int64_t irqAt = INT64_MAX;
+	int64_t releaseAt = INT64_MAX;
+	uint32_t expected = 0;
+	uint32_t gaps = 0;
+	uint32_t flagged = 0;
+	uint32_t buffers = 0;
+	while (sensor.Now() < end) {
+		// Next event: a sample, a transfer completion, the interrupt handler or the consumer.
+		int64_t t = sensor.NextSample();
+		if (transport.Completion() < t) { t = transport.Completion(); }
+		if (irqAt < t) { t = irqAt; }
+		if (releaseAt < t) { t = releaseAt; }
+		sensor.AdvanceTo(t);
+		if (t == transport.Completion()) { transport.Complete(); }
+		if (t == irqAt) {
+			irqAt = INT64_MAX;
+			stream.Watermark();
+		}
+		if (t == releaseAt) {
+			releaseAt = INT64_MAX;
+			stream.Release();
+		}
+		const bool high = sensor.WatermarkLine();
+		if (high && !line && irqAt == INT64_MAX) { irqAt = t + latencyNs; }
+		line = high;
+		ADXL345_PingPong::Buffer buffer;
+		if (releaseAt == INT64_MAX && stream.Acquire(&buffer)) {
+			buffers++;
+			if (buffer.flags) { flagged++; }
+			for (uint16_t i=0; i<buffer.samples; i++) {
+				const uint32_t k = uint32_t(buffer.data[i][0] + 512) | (uint32_t(buffer.data[i][1] + 512) << 10);
+				if (k != (expected & 0xFFFFF)) { gaps++; }
+				expected = k + 1;
+			}
+			releaseAt = t + int64_t(processingUs) * 1000;
+		}
+	}
+
+	ADXL345_PingPong::Stats stats;
+	stream.GetStats(&stats);
+	printf("%.1f s, %u buffers of %u, watermark %u: %u gaps, %u flagged buffers, %u samples lost in the FIFO,"
+			" %u dropped, max FIFO level %u, bus busy %.0f %%, %u drains\n",
+			seconds, buffers, samples, watermark, gaps, flagged, sensor.GetLost(),
+			stats.dropped, stats.maxEntries, transport.GetBusyNs() / (seconds * 1e9) * 100, stats.drains);
+	return gaps || flagged || sensor.GetLost() ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/*
+adxl345_shmd.cpp - Publishes ADXL345 FIFO streams into shared memory
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Linux daemon, build with
+//	g++ -std=c++11 -O2 -I. -Itools/host -DADXL345_NO_HAL tools/adxl345_shmd.cpp
+//		adxl345.cpp adxl345_linux.cpp adxl345_replay.cpp adxl345_stream.cpp adxl345_shm.cpp -o adxl345_shmd
+// Usage: adxl345_shmd [-n /name] [-c frames] [-r rate] [-p period_ms] source...
+//	source is i2c:/dev/i2c-N[:high], spi:/dev/spidevB.C or replay:capture.bin, at most 8.
+//	-r takes the BW_RATE code (VAL_BW_x), live sensors are set to it and stream their FIFO.
+//	Replay sources run on the clock of the recording and as fast as possible,
+//	the daemon exits once all of them ended. Consumers use ADXL345_ShmConsumer.
+
+#include "adxl345_linux.hpp"
+#include "adxl345_replay.hpp"
+#include "adxl345_shm.hpp"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+struct Source {
+	ADXL345 *dev;
+	ADXL345_ReplayBus *replay;	// nullptr for live sensors
+	vector<ADXL345_BusRecord> records;
+	ADXL345_StreamMonitor monitor;
+	bool done;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void Stop(int) {
+	running = 0;
+}
+
+static uint32_t NowUs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint32_t(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+static bool LoadRecords(const char *path, vector<ADXL345_BusRecord> *records) {
+	FILE *f = fopen(path, "rb");
+	if (!f) { return false; }
+	ADXL345_BusRecord r;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		records->push_back(r);
+	}
+	fclose(f);
+	return true;
+}
+
+static bool OpenSource(const char *spec, Source *src) {
+	src->replay = nullptr;
+	src->done = false;
+	if (!strncmp(spec, "replay:", 7)) {
+		if (!LoadRecords(spec + 7, &src->records)) { return false; }
+		ADXL345_Replay *dev = new ADXL345_Replay(src->records.data(), src->records.size());
+		src->dev = dev;
+		src->replay = dev->GetBus();
+		return true;
+	}
+	const bool i2c = !strncmp(spec, "i2c:", 4);
+	if (!i2c && strncmp(spec, "spi:", 4)) { return false; }
+	char path[64];
+	snprintf(path, sizeof(path), "%s", spec + 4);
+	char *option = strchr(path, ':');
+	if (option) { *option++ = '\0'; }
+	const int fd = open(path, O_RDWR);
+	if (fd < 0) { return false; }
+	if (i2c) {
+		const bool high = option && !strcmp(option, "high");
+		src->dev = new ADXL345_LinuxI2C(fd, high ? ADXL345_Defs::PIN_STATE_HIGH : ADXL345_Defs::PIN_STATE_LOW);
+	}
+	else {
+		ADXL345_LinuxSPI *dev = new ADXL345_LinuxSPI(fd);
+		if (dev->GetBus()->Setup()) { return false; }
+		src->dev = dev;
+	}
+	return true;
+}
+
+static bool ConfigureLive(ADXL345 *dev, uint8_t rate) {
+	if (dev->CheckDeviceID()) { return false; }
+	if (dev->SetMeasure(false)) { return false; }
+	if (dev->SetRate(rate)) { return false; }
+	if (dev->SetFifoCtl(ADXL345_Defs::FIELD_FIFO_CTL_MODE::Encode(ADXL345_Defs::VAL_FIFO_MODE_STREAM))) { return false; }
+	return !dev->SetMeasure(true);
+}
+
+int main(int argc, char *argv[]) {
+	const char *name = "/adxl345";
+	uint32_t capacity = 1 << 16;
+	uint8_t rate = ADXL345_Defs::VAL_BW_50_Hz;
+	uint32_t periodMs = 10;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:c:r:p:")) != -1) {
+		switch (opt) {
+		case 'n': name = optarg; break;
+		case 'c': capacity = strtoul(optarg, nullptr, 0); break;
+		case 'r': rate = uint8_t(strtoul(optarg, nullptr, 0)); break;
+		case 'p': periodMs = strtoul(optarg, nullptr, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n /name] [-c frames] [-r rate] [-p period_ms] source...\n", argv[0]);
+			return 2;
+		}
+	}
+	const int sources = argc - optind;
+	if (sources < 1 || sources > ADXL345_ShmHeader::SENSORS_MAX) {
+		fprintf(stderr, "1 to %d sources expected\n", int(ADXL345_ShmHeader::SENSORS_MAX));
+		return 2;
+	}
+
+	vector<Source> src(sources);
+	bool live = false;
+	for (int i=0; i<sources; i++) {
+		if (!OpenSource(argv[optind+i], &src[i])) {
+			fprintf(stderr, "cannot open %s\n", argv[optind+i]);
+			return 1;
+		}
+		if (!src[i].replay) {
+			if (!ConfigureLive(src[i].dev, rate)) {
+				fprintf(stderr, "cannot configure %s\n", argv[optind+i]);
+				return 1;
+			}
+			live = true;
+		}
+		src[i].monitor.SetRate(rate);
+	}
+
+	ADXL345_ShmPublisher publisher;
+	if (publisher.Create(name, capacity, uint8_t(sources))) {
+		fprintf(stderr, "cannot create %s with %u frames\n", name, capacity);
+		return 1;
+	}
+	for (int i=0; i<sources; i++) {
+		publisher.SetRate(uint8_t(i), rate);
+	}
+
+	signal(SIGINT, Stop);
+	signal(SIGTERM, Stop);
+	int active = sources;
+	while (running && active) {
+		for (int i=0; i<sources; i++) {
+			Source &s = src[i];
+			if (s.done) { continue; }
+			int16_t data[ADXL345_Defs::FIFO_MAX+1][3];
+			ADXL345_StreamMonitor::Block block;
+			const uint32_t now = s.replay ? s.replay->GetTime() : NowUs();
+			const ADXL345_Defs::StatusType status = s.monitor.Drain(s.dev, data, ADXL345_Defs::FIFO_MAX+1, now, &block);
+			if (status == ADXL345_Defs::STATUS_REPLAY_END) {
+				s.done = true;
+				active--;
+				continue;
+			}
+			if (status) {
+				fprintf(stderr, "sensor %d: drain failed with status 0x%02x\n", i, status);
+				continue;
+			}
+			if (block.frames) {
+				publisher.Publish(uint8_t(i), block, data);
+			}
+		}
+		if (live) {
+			usleep(periodMs * 1000);
+		}
+	}
+
+	for (int i=0; i<sources; i++) {
+		ADXL345_StreamMonitor::Stats stats;
+		src[i].monitor.GetStats(&stats);
+		fprintf(stderr, "sensor %d: %u samples, %u gaps, %u lost\n", i, stats.samples, stats.gaps, stats.lostSamples);
+	}
+	fprintf(stderr, "%u frames published to %s\n", publisher.GetHead(), name);
+	// A finished replay keeps its frames for late consumers, a stopped daemon removes them.
+	if (!running) {
+		shm_unlink(name);
+	}
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+adxl345_tiltbench.cpp - Compares the fixed-point tilt kernels with libm
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host tool, build with
+//	g++ -std=c++11 -O2 -I. -Itools/host tools/adxl345_tiltbench.cpp adxl345_tilt.cpp adxl345_stream.cpp -o adxl345_tiltbench
+// Usage: adxl345_tiltbench [samples] [min_length]
+//	Feeds random orientations with lengths from min_length (default 64) to 4096 LSB through
+//	ADXL345_Tilt::Compute() and through atan2f/sqrtf, then prints the time per sample
+//	and the largest deviations. A host FPU runs the libm path in hardware, build the same
+//	comparison for the target to see the gain on parts where atan2f and sqrtf are emulated.
+//	Then steps ADXL345_TiltFilter from level to a 45 degree pitch and prints where it settles,
+//	the exit status is 1 if any shift ends more than 1 degree off.
+
+#include "adxl345_tilt.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static void Reference(const int16_t data[][3], uint32_t samples, float angles[][2], float unit[][3]) {
+	for (uint32_t i=0; i<samples; i++) {
+		const float x = data[i][0];
+		const float y = data[i][1];
+		const float z = data[i][2];
+		const float length = sqrtf(x * x + y * y + z * z);
+		angles[i][0] = atan2f(-x, sqrtf(y * y + z * z)) * 180.0f / float(M_PI);
+		angles[i][1] = atan2f(y, z) * 180.0f / float(M_PI);
+		unit[i][0] = x / length;
+		unit[i][1] = y / length;
+		unit[i][2] = z / length;
+	}
+}
+
+static double AngleError(double a, double b) {
+	double d = fabs(a - b);
+	return d > 180.0 ? 360.0 - d : d;
+}
+
+int main(int argc, char *argv[]) {
+	const uint32_t samples = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000000;
+	const double minLength = argc > 2 ? atof(argv[2]) : 64.0;
+	vector<int16_t> data(samples * 3);
+	srand(1);
+	for (uint32_t i=0; i<samples; i++) {
+		// Uniform direction, log-uniform length
+		double v[3];
+		double n;
+		do {
+			for (int j=0; j<3; j++) { v[j] = 2.0 * rand() / RAND_MAX - 1.0; }
+			n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		} while (n > 1.0 || n < 1e-3);
+		const double length = minLength * pow(4096.0 / minLength, double(rand()) / RAND_MAX);
+		for (int j=0; j<3; j++) { data[i*3+j] = int16_t(lrint(v[j] / n * length)); }
+	}
+	const int16_t (*in)[3] = reinterpret_cast<const int16_t (*)[3]>(data.data());
+	vector<float> refAngles(samples * 2);
+	vector<float> refUnit(samples * 3);
+	vector<ADXL345_Tilt::Angles> angles(samples);
+	vector<int16_t> unit(samples * 3);
+
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	Reference(in, samples, reinterpret_cast<float (*)[2]>(refAngles.data()), reinterpret_cast<float (*)[3]>(refUnit.data()));
+	chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+	for (uint32_t i=0; i<samples; i+=256) {
+		const uint16_t n = samples - i < 256 ? uint16_t(samples - i) : 256;
+		ADXL345_Tilt::Compute(in + i, n, &angles[i], reinterpret_cast<int16_t (*)[3]>(&unit[i*3]));
+	}
+	chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+	double maxPitch = 0;
+	double maxRoll = 0;
+	double maxUnit = 0;
+	for (uint32_t i=0; i<samples; i++) {
+		const double pitch = AngleError(double(angles[i].pitch) / double(ADXL345_Tilt::ANGLE_SCALE), refAngles[i*2]);
+		const double roll = AngleError(double(angles[i].roll) / double(ADXL345_Tilt::ANGLE_SCALE), refAngles[i*2+1]);
+		if (pitch > maxPitch) { maxPitch = pitch; }
+		// Roll is undefined close to the y/z origin.
+		if (abs(data[i*3+1]) + abs(data[i*3+2]) >= minLength / 2 && roll > maxRoll) { maxRoll = roll; }
+		for (int j=0; j<3; j++) {
+			const double e = fabs(double(unit[i*3+j]) / ADXL345_Tilt::UNIT - refUnit[i*3+j]) * ADXL345_Tilt::UNIT;
+			if (e > maxUnit) { maxUnit = e; }
+		}
+	}
+	const double libm = chrono::duration<double, nano>(t1 - t0).count() / samples;
+	const double fixed = chrono::duration<double, nano>(t2 - t1).count() / samples;
+	printf("samples          %u, length %.0f to 4096 LSB\n", samples, minLength);
+	printf("libm             %.1f ns/sample\n", libm);
+	printf("fixed point      %.1f ns/sample (%.2fx)\n", fixed, libm / fixed);
+	printf("max pitch error  %.4f deg\n", maxPitch);
+	printf("max roll error   %.4f deg\n", maxRoll);
+	printf("max unit error   %.2f / %d\n", maxUnit, int(ADXL345_Tilt::UNIT));
+
+	// Step responses to both sides, 16 time constants leave far less than the 1 degree allowed.
+	// Tilting forward raises x, so a filter rounding toward minus infinity would stop early.
+	const int16_t level[1][3] = { { 0, 0, 256 } };
+	const int16_t steps[2][1][3] = { { { 181, 0, 181 } }, { { -181, 0, 181 } } };
+	const uint8_t shifts[] = { 4, 8, 12, ADXL345_TiltFilter::SHIFT_MAX };
+	int failed = 0;
+	for (const int16_t (&step)[1][3] : steps) {
+		ADXL345_Tilt::Angles target;
+		ADXL345_Tilt::Compute(step, 1, &target, nullptr);
+		for (uint8_t shift : shifts) {
+			ADXL345_TiltFilter filter(shift);
+			filter.Update(level, 1);
+			for (uint32_t i=0; i<(uint32_t(16) << shift); i++) { filter.Update(step, 1); }
+			ADXL345_Tilt::Angles settled;
+			filter.GetAngles(&settled);
+			const double error = fabs(double(settled.pitch - target.pitch)) / double(ADXL345_Tilt::ANGLE_SCALE);
+			printf("filter shift %2u   settles at %.3f of %.3f deg\n", unsigned(shift),
+				double(settled.pitch) / double(ADXL345_Tilt::ANGLE_SCALE), double(target.pitch) / double(ADXL345_Tilt::ANGLE_SCALE));
+			if (error > 1.0) { failed = 1; }
+		}
+	}
+	return failed;
+}
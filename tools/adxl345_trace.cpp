@@ -0,0 +1,328 @@
+/*
+adxl345_trace.cpp - Offline analyzer for ADXL345_Tracer dumps
+
+Copyright (C) 2021  NANDLAB
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Host tool, build with
+//	g++ -std=c++11 -O2 -I. -Itools/host tools/adxl345_trace.cpp -o adxl345_trace
+// Usage: adxl345_trace [-v] trace.bin
+//	-v prints every transfer with decoded register and bit names.
+
+#include "adxl345_core.hpp"
+#include "adxl345_trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+struct BitName {
+	uint8_t bit;
+	const char *name;
+};
+
+struct RegInfo {
+	uint8_t reg;
+	const char *name;
+	bool volatileValue;		// may change without a write, re-reading is not redundant
+	const BitName *bits;	// nullptr for plain values
+};
+
+static const BitName actInactCtlBits[] = {
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_ACT_AC, "ACT_AC" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_ACT_X, "ACT_X" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_ACT_Y, "ACT_Y" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_ACT_Z, "ACT_Z" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_INACT_AC, "INACT_AC" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_INACT_X, "INACT_X" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_INACT_Y, "INACT_Y" },
+	{ ADXL345_Defs::BIT_ACT_INACT_CTL_INACT_Z, "INACT_Z" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName tapAxesBits[] = {
+	{ ADXL345_Defs::BIT_TAP_AXES_SUPPRESS, "SUPPRESS" },
+	{ ADXL345_Defs::BIT_TAP_AXES_TAP_X, "TAP_X" },
+	{ ADXL345_Defs::BIT_TAP_AXES_TAP_Y, "TAP_Y" },
+	{ ADXL345_Defs::BIT_TAP_AXES_TAP_Z, "TAP_Z" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName actTapStatusBits[] = {
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_ACT_X, "ACT_X" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_ACT_Y, "ACT_Y" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_ACT_Z, "ACT_Z" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_ASLEEP, "ASLEEP" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_TAP_X, "TAP_X" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_TAP_Y, "TAP_Y" },
+	{ ADXL345_Defs::BIT_ACT_TAP_STATUS_TAP_Z, "TAP_Z" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName bwRateBits[] = {
+	{ ADXL345_Defs::BIT_BW_RATE_LOW_POWER, "LOW_POWER" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName powerCtlBits[] = {
+	{ ADXL345_Defs::BIT_POWER_CTL_LINK, "LINK" },
+	{ ADXL345_Defs::BIT_POWER_CTL_AUTO_SLEEP, "AUTO_SLEEP" },
+	{ ADXL345_Defs::BIT_POWER_CTL_MEASURE, "MEASURE" },
+	{ ADXL345_Defs::BIT_POWER_CTL_SLEEP, "SLEEP" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName intBits[] = {
+	{ ADXL345_Defs::BIT_INT_DATA_READY, "DATA_READY" },
+	{ ADXL345_Defs::BIT_INT_SINGLE_TAP, "SINGLE_TAP" },
+	{ ADXL345_Defs::BIT_INT_DOUBLE_TAP, "DOUBLE_TAP" },
+	{ ADXL345_Defs::BIT_INT_ACTIVITY, "ACTIVITY" },
+	{ ADXL345_Defs::BIT_INT_INACTIVITY, "INACTIVITY" },
+	{ ADXL345_Defs::BIT_INT_FREE_FALL, "FREE_FALL" },
+	{ ADXL345_Defs::BIT_INT_WATERMARK, "WATERMARK" },
+	{ ADXL345_Defs::BIT_INT_OVERRUN, "OVERRUN" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName dataFormatBits[] = {
+	{ ADXL345_Defs::BIT_DATA_FORMAT_SELF_TEST, "SELF_TEST" },
+	{ ADXL345_Defs::BIT_DATA_FORMAT_SPI_3WIRE, "SPI_3WIRE" },
+	{ ADXL345_Defs::BIT_DATA_FORMAT_INT_INVERT, "INT_INVERT" },
+	{ ADXL345_Defs::BIT_DATA_FORMAT_FULL_RES, "FULL_RES" },
+	{ ADXL345_Defs::BIT_DATA_FORMAT_JUSTIFY_LEFT, "JUSTIFY_LEFT" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName fifoCtlBits[] = {
+	{ ADXL345_Defs::BIT_FIFO_CTL_TRIGGER_INT2, "TRIGGER_INT2" },
+	{ 0xFF, nullptr },
+};
+
+static const BitName fifoStatusBits[] = {
+	{ ADXL345_Defs::BIT_FIFO_STATUS_FIFO_TRIG, "FIFO_TRIG" },
+	{ 0xFF, nullptr },
+};
+
+static const RegInfo regInfos[] = {
+	{ ADXL345_Defs::REG_DEVID, "DEVID", false, nullptr },
+	{ ADXL345_Defs::REG_THRESH_TAP, "THRESH_TAP", false, nullptr },
+	{ ADXL345_Defs::REG_OFSX, "OFSX", false, nullptr },
+	{ ADXL345_Defs::REG_OFSY, "OFSY", false, nullptr },
+	{ ADXL345_Defs::REG_OFSZ, "OFSZ", false, nullptr },
+	{ ADXL345_Defs::REG_DUR, "DUR", false, nullptr },
+	{ ADXL345_Defs::REG_LATENT, "LATENT", false, nullptr },
+	{ ADXL345_Defs::REG_WINDOW, "WINDOW", false, nullptr },
+	{ ADXL345_Defs::REG_THRESH_ACT, "THRESH_ACT", false, nullptr },
+	{ ADXL345_Defs::REG_THRESH_INACT, "THRESH_INACT", false, nullptr },
+	{ ADXL345_Defs::REG_TIME_INACT, "TIME_INACT", false, nullptr },
+	{ ADXL345_Defs::REG_ACT_INACT_CTL, "ACT_INACT_CTL", false, actInactCtlBits },
+	{ ADXL345_Defs::REG_THRESH_FF, "THRESH_FF", false, nullptr },
+	{ ADXL345_Defs::REG_TIME_FF, "TIME_FF", false, nullptr },
+	{ ADXL345_Defs::REG_TAP_AXES, "TAP_AXES", false, tapAxesBits },
+	{ ADXL345_Defs::REG_ACT_TAP_STATUS, "ACT_TAP_STATUS", true, actTapStatusBits },
+	{ ADXL345_Defs::REG_BW_RATE, "BW_RATE", false, bwRateBits },
+	{ ADXL345_Defs::REG_POWER_CTL, "POWER_CTL", false, powerCtlBits },
+	{ ADXL345_Defs::REG_INT_ENABLE, "INT_ENABLE", false, intBits },
+	{ ADXL345_Defs::REG_INT_MAP, "INT_MAP", false, intBits },
+	{ ADXL345_Defs::REG_INT_SOURCE, "INT_SOURCE", true, intBits },
+	{ ADXL345_Defs::REG_DATA_FORMAT, "DATA_FORMAT", false, dataFormatBits },
+	{ ADXL345_Defs::REG_DATAX0, "DATAX0", true, nullptr },
+	{ ADXL345_Defs::REG_DATAX1, "DATAX1", true, nullptr },
+	{ ADXL345_Defs::REG_DATAY0, "DATAY0", true, nullptr },
+	{ ADXL345_Defs::REG_DATAY1, "DATAY1", true, nullptr },
+	{ ADXL345_Defs::REG_DATAZ0, "DATAZ0", true, nullptr },
+	{ ADXL345_Defs::REG_DATAZ1, "DATAZ1", true, nullptr },
+	{ ADXL345_Defs::REG_FIFO_CTL, "FIFO_CTL", false, fifoCtlBits },
+	{ ADXL345_Defs::REG_FIFO_STATUS, "FIFO_STATUS", true, fifoStatusBits },
+};
+
+static const RegInfo *FindReg(uint8_t reg) {
+	for (size_t i=0; i<sizeof(regInfos)/sizeof(regInfos[0]); i++) {
+		if (regInfos[i].reg == reg) { return &regInfos[i]; }
+	}
+	return nullptr;
+}
+
+static uint32_t GetU32(const uint8_t *p) {
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+struct RegStats {
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t bytes;
+	uint64_t cycles;
+	uint32_t redundantReads;
+	uint64_t redundantCycles;
+};
+
+static void PrintTransfer(const ADXL345_TraceEntry &e, double usPerCycle, uint32_t t0) {
+	const RegInfo *info = FindReg(e.reg);
+	const bool write = e.info & ADXL345_TraceEntry::INFO_WRITE;
+	const uint8_t n = e.info & ADXL345_TraceEntry::INFO_N_MASK;
+	printf("%12.1f us %6.1f us  %c %-14s", (e.start - t0) * usPerCycle, (e.end - e.start) * usPerCycle,
+			write ? 'W' : 'R', info ? info->name : "?");
+	for (uint8_t i=0; i<n; i++) {
+		printf(" %02X", e.data[i]);
+	}
+	if (info && info->bits && n == 1) {
+		printf("  [");
+		bool first = true;
+		for (const BitName *b = info->bits; b->name; b++) {
+			if ((e.data[0] >> b->bit) & 1) {
+				printf("%s%s", first ? "" : " ", b->name);
+				first = false;
+			}
+		}
+		printf("]");
+	}
+	if (e.status) { printf("  status %u", e.status); }
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	bool verbose = false;
+	const char *path = nullptr;
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-v")) { verbose = true; }
+		else { path = argv[i]; }
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s [-v] trace.bin\n", argv[0]);
+		return 2;
+	}
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	uint8_t header[20];
+	if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "AXTR", 4)
+		|| header[4] != ADXL345_Tracer::FORMAT_VERSION || header[5] != sizeof(ADXL345_TraceEntry)) {
+		fprintf(stderr, "%s: not an ADXL345 trace\n", path);
+		fclose(f);
+		return 1;
+	}
+	const uint32_t clockHz = GetU32(header + 8);
+	const uint32_t count = GetU32(header + 12);
+	const uint32_t dropped = GetU32(header + 16);
+	const double usPerCycle = clockHz ? 1e6 / clockHz : 1.0;
+
+	vector<ADXL345_TraceEntry> entries;
+	for (uint32_t k=0; k<count; k++) {
+		uint8_t raw[sizeof(ADXL345_TraceEntry)];
+		if (fread(raw, 1, sizeof(raw), f) != sizeof(raw)) { break; }
+		ADXL345_TraceEntry e;
+		e.start = GetU32(raw);
+		e.end = GetU32(raw + 4);
+		e.reg = raw[8];
+		e.info = raw[9];
+		e.status = raw[10];
+		memcpy(e.data, raw + 11, ADXL345_Defs::BUFFER_MAX);
+		entries.push_back(e);
+	}
+	fclose(f);
+	if (entries.empty()) {
+		printf("empty trace\n");
+		return 0;
+	}
+
+	RegStats stats[256];
+	memset(stats, 0, sizeof(stats));
+	// Last known value per register, -1 if unknown.
+	int known[256];
+	for (int i=0; i<256; i++) { known[i] = -1; }
+	uint64_t busy = 0;
+	uint32_t errors = 0;
+	vector<uint32_t> gaps;
+	const uint32_t t0 = entries.front().start;
+
+	for (size_t k=0; k<entries.size(); k++) {
+		const ADXL345_TraceEntry &e = entries[k];
+		const bool write = e.info & ADXL345_TraceEntry::INFO_WRITE;
+		const uint8_t n = e.info & ADXL345_TraceEntry::INFO_N_MASK;
+		const uint32_t cycles = e.end - e.start;
+		if (verbose) { PrintTransfer(e, usPerCycle, t0); }
+		RegStats &s = stats[e.reg];
+		(write ? s.writes : s.reads)++;
+		s.bytes += n;
+		s.cycles += cycles;
+		busy += cycles;
+		if (e.status) { errors++; }
+		if (k) { gaps.push_back(e.start - entries[k-1].end); }
+
+		for (uint8_t i=0; i<n; i++) {
+			const uint8_t reg = e.reg + i;
+			const RegInfo *info = FindReg(reg);
+			if (e.status || (info && info->volatileValue)) {
+				known[reg] = -1;
+				continue;
+			}
+			if (write) {
+				known[reg] = e.data[i];
+			}
+			else {
+				// Reading back a value that is already known, e.g. the read-modify-write of the bit setters.
+				if (i == 0 && n == 1 && known[reg] == e.data[i]) {
+					s.redundantReads++;
+					s.redundantCycles += cycles;
+				}
+				known[reg] = e.data[i];
+			}
+		}
+	}
+
+	const uint32_t span = entries.back().end - t0;
+	printf("transfers      %zu (%u dropped before the dump)\n", entries.size(), dropped);
+	printf("errors         %u\n", errors);
+	printf("time span      %.1f us\n", span * usPerCycle);
+	printf("bus busy       %.1f us (%.2f %%)\n", busy * usPerCycle, span ? 100.0 * busy / span : 0.0);
+
+	printf("\n%-14s %8s %8s %8s %12s %10s %12s\n", "register", "reads", "writes", "bytes", "busy us", "redundant", "wasted us");
+	uint64_t wasted = 0;
+	uint32_t redundant = 0;
+	for (int reg=0; reg<256; reg++) {
+		const RegStats &s = stats[reg];
+		if (!s.reads && !s.writes) { continue; }
+		const RegInfo *info = FindReg(uint8_t(reg));
+		printf("%-14s %8u %8u %8u %12.1f %10u %12.1f\n", info ? info->name : "?", s.reads, s.writes, s.bytes,
+				s.cycles * usPerCycle, s.redundantReads, s.redundantCycles * usPerCycle);
+		wasted += s.redundantCycles;
+		redundant += s.redundantReads;
+	}
+	printf("\nredundant reads %u, %.1f us (%.2f %% of bus time)\n", redundant, wasted * usPerCycle, busy ? 100.0 * wasted / busy : 0.0);
+
+	if (!gaps.empty()) {
+		vector<uint32_t> sorted(gaps);
+		sort(sorted.begin(), sorted.end());
+		printf("\nidle gaps      min %.1f us, median %.1f us, p99 %.1f us, max %.1f us\n",
+				sorted.front() * usPerCycle, sorted[sorted.size() / 2] * usPerCycle,
+				sorted[sorted.size() * 99 / 100] * usPerCycle, sorted.back() * usPerCycle);
+		const double bounds[] = { 10, 100, 1000, 10000 };
+		uint32_t histogram[5] = { 0 };
+		for (size_t i=0; i<gaps.size(); i++) {
+			const double us = gaps[i] * usPerCycle;
+			uint8_t b = 0;
+			while (b < 4 && us >= bounds[b]) { b++; }
+			histogram[b]++;
+		}
+		printf("  < 10 us %u, < 100 us %u, < 1 ms %u, < 10 ms %u, >= 10 ms %u\n",
+				histogram[0], histogram[1], histogram[2], histogram[3], histogram[4]);
+	}
+	return 0;
+}